@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Glue code for the SHA-1 Secure Hash Algorithm implementation using the
+ * ARMv8 Crypto Extensions.
+ *
+ * Based on the Linux kernel implementation:
+ * Copyright (C) 2014 Linaro Ltd <ard.biesheuvel@linaro.org>
+ */
+
+#include <common.h>
+#include <digest.h>
+#include <init.h>
+#include <crypto/sha.h>
+#include <crypto/internal.h>
+#include <asm/unaligned.h>
+#include <asm/byteorder.h>
+#include <asm/system.h>
+
+void sha1_ce_transform(u32 *state, const u8 *src, int blocks);
+
+static int sha1_ce_init(struct digest *desc)
+{
+	struct sha1_state *sctx = digest_ctx(desc);
+
+	sctx->state[0] = SHA1_H0;
+	sctx->state[1] = SHA1_H1;
+	sctx->state[2] = SHA1_H2;
+	sctx->state[3] = SHA1_H3;
+	sctx->state[4] = SHA1_H4;
+	sctx->count = 0;
+
+	return 0;
+}
+
+static int sha1_ce_update(struct digest *desc, const void *_data,
+			  unsigned long len)
+{
+	struct sha1_state *sctx = digest_ctx(desc);
+	unsigned int partial = sctx->count % SHA1_BLOCK_SIZE;
+	const u8 *data = _data;
+
+	sctx->count += len;
+
+	if (partial + len < SHA1_BLOCK_SIZE) {
+		memcpy(sctx->buffer + partial, data, len);
+		return 0;
+	}
+
+	if (partial) {
+		unsigned int fill = SHA1_BLOCK_SIZE - partial;
+
+		memcpy(sctx->buffer + partial, data, fill);
+		sha1_ce_transform(sctx->state, sctx->buffer, 1);
+		data += fill;
+		len -= fill;
+	}
+
+	if (len >= SHA1_BLOCK_SIZE) {
+		int blocks = len / SHA1_BLOCK_SIZE;
+
+		sha1_ce_transform(sctx->state, data, blocks);
+		data += blocks * SHA1_BLOCK_SIZE;
+		len -= blocks * SHA1_BLOCK_SIZE;
+	}
+
+	memcpy(sctx->buffer, data, len);
+
+	return 0;
+}
+
+/* Add padding and return the message digest. */
+static int sha1_ce_final(struct digest *desc, u8 *out)
+{
+	struct sha1_state *sctx = digest_ctx(desc);
+	static const u8 padding[SHA1_BLOCK_SIZE] = { 0x80, };
+	unsigned int i, index, padlen;
+	__be64 bits;
+
+	/* save number of bits */
+	bits = cpu_to_be64(sctx->count << 3);
+
+	/* Pad out to 56 mod 64 and append length */
+	index = sctx->count % SHA1_BLOCK_SIZE;
+	padlen = (index < 56) ? (56 - index) : ((SHA1_BLOCK_SIZE + 56) - index);
+
+	sha1_ce_update(desc, padding, padlen);
+	sha1_ce_update(desc, &bits, sizeof(bits));
+
+	/* Store state in digest */
+	for (i = 0; i < 5; i++)
+		put_unaligned_be32(sctx->state[i], out + i * 4);
+
+	/* Wipe context */
+	memset(sctx, 0, sizeof(*sctx));
+
+	return 0;
+}
+
+static struct digest_algo sha1_ce = {
+	.base = {
+		.name		=	"sha1",
+		.driver_name	=	"sha1-ce",
+		.priority	=	200,
+		.algo		=	HASH_ALGO_SHA1,
+	},
+
+	.length	=	SHA1_DIGEST_SIZE,
+	.init	=	sha1_ce_init,
+	.update	=	sha1_ce_update,
+	.final	=	sha1_ce_final,
+	.digest	=	digest_generic_digest,
+	.verify	=	digest_generic_verify,
+	.ctx_length =	sizeof(struct sha1_state),
+};
+
+static int sha1_ce_digest_register(void)
+{
+	/* The Crypto Extensions are optional, keep the generic code otherwise */
+	if (!id_aa64isar0_field(SHA1))
+		return 0;
+
+	return digest_algo_register(&sha1_ce);
+}
+coredevice_initcall(sha1_ce_digest_register);
@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Glue code for the SHA-224/SHA-256 Secure Hash Algorithm implementation
+ * using the ARMv8 Crypto Extensions.
+ *
+ * Based on the Linux kernel implementation:
+ * Copyright (C) 2014 Linaro Ltd <ard.biesheuvel@linaro.org>
+ */
+
+#include <common.h>
+#include <digest.h>
+#include <init.h>
+#include <crypto/sha.h>
+#include <crypto/internal.h>
+#include <asm/unaligned.h>
+#include <asm/byteorder.h>
+#include <asm/system.h>
+
+void sha2_ce_transform(u32 *state, const u8 *src, int blocks);
+
+static int sha256_ce_init(struct digest *desc)
+{
+	struct sha256_state *sctx = digest_ctx(desc);
+
+	sctx->state[0] = SHA256_H0;
+	sctx->state[1] = SHA256_H1;
+	sctx->state[2] = SHA256_H2;
+	sctx->state[3] = SHA256_H3;
+	sctx->state[4] = SHA256_H4;
+	sctx->state[5] = SHA256_H5;
+	sctx->state[6] = SHA256_H6;
+	sctx->state[7] = SHA256_H7;
+	sctx->count = 0;
+
+	return 0;
+}
+
+static int sha224_ce_init(struct digest *desc)
+{
+	struct sha256_state *sctx = digest_ctx(desc);
+
+	sctx->state[0] = SHA224_H0;
+	sctx->state[1] = SHA224_H1;
+	sctx->state[2] = SHA224_H2;
+	sctx->state[3] = SHA224_H3;
+	sctx->state[4] = SHA224_H4;
+	sctx->state[5] = SHA224_H5;
+	sctx->state[6] = SHA224_H6;
+	sctx->state[7] = SHA224_H7;
+	sctx->count = 0;
+
+	return 0;
+}
+
+static int sha256_ce_update(struct digest *desc, const void *_data,
+			    unsigned long len)
+{
+	struct sha256_state *sctx = digest_ctx(desc);
+	unsigned int partial = sctx->count % SHA256_BLOCK_SIZE;
+	const u8 *data = _data;
+
+	sctx->count += len;
+
+	if (partial + len < SHA256_BLOCK_SIZE) {
+		memcpy(sctx->buf + partial, data, len);
+		return 0;
+	}
+
+	if (partial) {
+		unsigned int fill = SHA256_BLOCK_SIZE - partial;
+
+		memcpy(sctx->buf + partial, data, fill);
+		sha2_ce_transform(sctx->state, sctx->buf, 1);
+		data += fill;
+		len -= fill;
+	}
+
+	if (len >= SHA256_BLOCK_SIZE) {
+		int blocks = len / SHA256_BLOCK_SIZE;
+
+		sha2_ce_transform(sctx->state, data, blocks);
+		data += blocks * SHA256_BLOCK_SIZE;
+		len -= blocks * SHA256_BLOCK_SIZE;
+	}
+
+	memcpy(sctx->buf, data, len);
+
+	return 0;
+}
+
+static void sha256_ce_pad(struct digest *desc)
+{
+	struct sha256_state *sctx = digest_ctx(desc);
+	static const u8 padding[SHA256_BLOCK_SIZE] = { 0x80, };
+	unsigned int index, padlen;
+	__be64 bits;
+
+	/* save number of bits */
+	bits = cpu_to_be64(sctx->count << 3);
+
+	/* Pad out to 56 mod 64 and append length */
+	index = sctx->count % SHA256_BLOCK_SIZE;
+	padlen = (index < 56) ? (56 - index) : ((SHA256_BLOCK_SIZE + 56) - index);
+
+	sha256_ce_update(desc, padding, padlen);
+	sha256_ce_update(desc, &bits, sizeof(bits));
+}
+
+static int sha256_ce_final(struct digest *desc, u8 *out)
+{
+	struct sha256_state *sctx = digest_ctx(desc);
+	int i;
+
+	sha256_ce_pad(desc);
+
+	for (i = 0; i < SHA256_DIGEST_SIZE / 4; i++)
+		put_unaligned_be32(sctx->state[i], out + i * 4);
+
+	/* Wipe context */
+	memset(sctx, 0, sizeof(*sctx));
+
+	return 0;
+}
+
+static int sha224_ce_final(struct digest *desc, u8 *out)
+{
+	struct sha256_state *sctx = digest_ctx(desc);
+	int i;
+
+	sha256_ce_pad(desc);
+
+	for (i = 0; i < SHA224_DIGEST_SIZE / 4; i++)
+		put_unaligned_be32(sctx->state[i], out + i * 4);
+
+	/* Wipe context */
+	memset(sctx, 0, sizeof(*sctx));
+
+	return 0;
+}
+
+static struct digest_algo sha224_ce = {
+	.base = {
+		.name		=	"sha224",
+		.driver_name	=	"sha224-ce",
+		.priority	=	200,
+		.algo		=	HASH_ALGO_SHA224,
+	},
+
+	.length	=	SHA224_DIGEST_SIZE,
+	.init	=	sha224_ce_init,
+	.update	=	sha256_ce_update,
+	.final	=	sha224_ce_final,
+	.digest	=	digest_generic_digest,
+	.verify	=	digest_generic_verify,
+	.ctx_length =	sizeof(struct sha256_state),
+};
+
+static struct digest_algo sha256_ce = {
+	.base = {
+		.name		=	"sha256",
+		.driver_name	=	"sha256-ce",
+		.priority	=	200,
+		.algo		=	HASH_ALGO_SHA256,
+	},
+
+	.length	=	SHA256_DIGEST_SIZE,
+	.init	=	sha256_ce_init,
+	.update	=	sha256_ce_update,
+	.final	=	sha256_ce_final,
+	.digest	=	digest_generic_digest,
+	.verify	=	digest_generic_verify,
+	.ctx_length =	sizeof(struct sha256_state),
+};
+
+static int sha2_ce_digest_register(void)
+{
+	int ret;
+
+	/* The Crypto Extensions are optional, keep the generic code otherwise */
+	if (!id_aa64isar0_field(SHA2))
+		return 0;
+
+	ret = digest_algo_register(&sha224_ce);
+	if (ret)
+		return ret;
+
+	return digest_algo_register(&sha256_ce);
+}
+coredevice_initcall(sha2_ce_digest_register);
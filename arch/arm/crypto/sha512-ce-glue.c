@@ -0,0 +1,192 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Glue code for the SHA-384/SHA-512 Secure Hash Algorithm implementation
+ * using the ARMv8.2 SHA512 Crypto Extensions.
+ *
+ * Based on the Linux kernel implementation:
+ * Copyright (C) 2018 Linaro Ltd <ard.biesheuvel@linaro.org>
+ */
+
+#include <common.h>
+#include <digest.h>
+#include <init.h>
+#include <crypto/sha.h>
+#include <crypto/internal.h>
+#include <asm/unaligned.h>
+#include <asm/byteorder.h>
+#include <asm/system.h>
+
+void sha512_ce_transform(u64 *state, const u8 *src, int blocks);
+
+static int sha512_ce_init(struct digest *desc)
+{
+	struct sha512_state *sctx = digest_ctx(desc);
+
+	sctx->state[0] = SHA512_H0;
+	sctx->state[1] = SHA512_H1;
+	sctx->state[2] = SHA512_H2;
+	sctx->state[3] = SHA512_H3;
+	sctx->state[4] = SHA512_H4;
+	sctx->state[5] = SHA512_H5;
+	sctx->state[6] = SHA512_H6;
+	sctx->state[7] = SHA512_H7;
+	sctx->count[0] = sctx->count[1] = 0;
+
+	return 0;
+}
+
+static int sha384_ce_init(struct digest *desc)
+{
+	struct sha512_state *sctx = digest_ctx(desc);
+
+	sctx->state[0] = SHA384_H0;
+	sctx->state[1] = SHA384_H1;
+	sctx->state[2] = SHA384_H2;
+	sctx->state[3] = SHA384_H3;
+	sctx->state[4] = SHA384_H4;
+	sctx->state[5] = SHA384_H5;
+	sctx->state[6] = SHA384_H6;
+	sctx->state[7] = SHA384_H7;
+	sctx->count[0] = sctx->count[1] = 0;
+
+	return 0;
+}
+
+static int sha512_ce_update(struct digest *desc, const void *_data,
+			    unsigned long len)
+{
+	struct sha512_state *sctx = digest_ctx(desc);
+	unsigned int partial = sctx->count[0] % SHA512_BLOCK_SIZE;
+	const u8 *data = _data;
+
+	sctx->count[0] += len;
+	if (sctx->count[0] < len)
+		sctx->count[1]++;
+
+	if (partial + len < SHA512_BLOCK_SIZE) {
+		memcpy(sctx->buf + partial, data, len);
+		return 0;
+	}
+
+	if (partial) {
+		unsigned int fill = SHA512_BLOCK_SIZE - partial;
+
+		memcpy(sctx->buf + partial, data, fill);
+		sha512_ce_transform(sctx->state, sctx->buf, 1);
+		data += fill;
+		len -= fill;
+	}
+
+	if (len >= SHA512_BLOCK_SIZE) {
+		int blocks = len / SHA512_BLOCK_SIZE;
+
+		sha512_ce_transform(sctx->state, data, blocks);
+		data += blocks * SHA512_BLOCK_SIZE;
+		len -= blocks * SHA512_BLOCK_SIZE;
+	}
+
+	memcpy(sctx->buf, data, len);
+
+	return 0;
+}
+
+static void sha512_ce_pad(struct digest *desc)
+{
+	struct sha512_state *sctx = digest_ctx(desc);
+	static const u8 padding[SHA512_BLOCK_SIZE] = { 0x80, };
+	unsigned int index, padlen;
+	__be64 bits[2];
+
+	/* save number of bits */
+	bits[1] = cpu_to_be64(sctx->count[0] << 3);
+	bits[0] = cpu_to_be64(sctx->count[1] << 3 | sctx->count[0] >> 61);
+
+	/* Pad out to 112 mod 128 and append length */
+	index = sctx->count[0] % SHA512_BLOCK_SIZE;
+	padlen = (index < 112) ? (112 - index) : ((SHA512_BLOCK_SIZE + 112) - index);
+
+	sha512_ce_update(desc, padding, padlen);
+	sha512_ce_update(desc, bits, sizeof(bits));
+}
+
+static int sha512_ce_final(struct digest *desc, u8 *out)
+{
+	struct sha512_state *sctx = digest_ctx(desc);
+	int i;
+
+	sha512_ce_pad(desc);
+
+	for (i = 0; i < SHA512_DIGEST_SIZE / 8; i++)
+		put_unaligned_be64(sctx->state[i], out + i * 8);
+
+	/* Wipe context */
+	memset(sctx, 0, sizeof(*sctx));
+
+	return 0;
+}
+
+static int sha384_ce_final(struct digest *desc, u8 *out)
+{
+	struct sha512_state *sctx = digest_ctx(desc);
+	int i;
+
+	sha512_ce_pad(desc);
+
+	for (i = 0; i < SHA384_DIGEST_SIZE / 8; i++)
+		put_unaligned_be64(sctx->state[i], out + i * 8);
+
+	/* Wipe context */
+	memset(sctx, 0, sizeof(*sctx));
+
+	return 0;
+}
+
+static struct digest_algo sha384_ce = {
+	.base = {
+		.name		=	"sha384",
+		.driver_name	=	"sha384-ce",
+		.priority	=	200,
+		.algo		=	HASH_ALGO_SHA384,
+	},
+
+	.length	=	SHA384_DIGEST_SIZE,
+	.init	=	sha384_ce_init,
+	.update	=	sha512_ce_update,
+	.final	=	sha384_ce_final,
+	.digest	=	digest_generic_digest,
+	.verify	=	digest_generic_verify,
+	.ctx_length =	sizeof(struct sha512_state),
+};
+
+static struct digest_algo sha512_ce = {
+	.base = {
+		.name		=	"sha512",
+		.driver_name	=	"sha512-ce",
+		.priority	=	200,
+		.algo		=	HASH_ALGO_SHA512,
+	},
+
+	.length	=	SHA512_DIGEST_SIZE,
+	.init	=	sha512_ce_init,
+	.update	=	sha512_ce_update,
+	.final	=	sha512_ce_final,
+	.digest	=	digest_generic_digest,
+	.verify	=	digest_generic_verify,
+	.ctx_length =	sizeof(struct sha512_state),
+};
+
+static int sha512_ce_digest_register(void)
+{
+	int ret;
+
+	/* SHA512 instructions are reported as SHA2 field value 2 */
+	if (id_aa64isar0_field(SHA2) < 2)
+		return 0;
+
+	ret = digest_algo_register(&sha384_ce);
+	if (ret)
+		return ret;
+
+	return digest_algo_register(&sha512_ce);
+}
+coredevice_initcall(sha512_ce_digest_register);
@@ -124,6 +124,24 @@ static inline unsigned long read_mpidr(void)
 	return val;
 }
 
+#define ID_AA64ISAR0_EL1_AES_SHIFT	4
+#define ID_AA64ISAR0_EL1_SHA1_SHIFT	8
+#define ID_AA64ISAR0_EL1_SHA2_SHIFT	12
+#define ID_AA64ISAR0_EL1_CRC32_SHIFT	16
+
+static inline unsigned long read_id_aa64isar0(void)
+{
+	unsigned long val;
+
+	asm volatile("mrs %0, id_aa64isar0_el1" : "=r" (val));
+
+	return val;
+}
+
+/* Get a 4 bit field of the ID_AA64ISAR0_EL1 register */
+#define id_aa64isar0_field(field) \
+	((read_id_aa64isar0() >> ID_AA64ISAR0_EL1_##field##_SHIFT) & 0xf)
+
 static inline void set_cntfrq(unsigned long cntfrq)
 {
 	asm volatile("msr cntfrq_el0, %0" : : "r" (cntfrq) : "memory");
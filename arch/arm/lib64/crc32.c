@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * crc32() using the ARMv8 CRC32 instructions. These are optional in
+ * ARMv8.0, so their presence is checked at runtime.
+ */
+
+#include <common.h>
+#include <crc.h>
+#include <asm/system.h>
+
+int crc32_arm64_available(void)
+{
+	static int available = -1;
+
+	if (available < 0)
+		available = id_aa64isar0_field(CRC32) != 0;
+
+	return available;
+}
+
+static inline u32 __crc32b(u32 crc, u8 val)
+{
+	asm("crc32b %w0, %w0, %w1" : "+r" (crc) : "r" (val));
+	return crc;
+}
+
+static inline u32 __crc32w(u32 crc, u32 val)
+{
+	asm("crc32w %w0, %w0, %w1" : "+r" (crc) : "r" (val));
+	return crc;
+}
+
+static inline u32 __crc32x(u32 crc, u64 val)
+{
+	asm("crc32x %w0, %w0, %x1" : "+r" (crc) : "r" (val));
+	return crc;
+}
+
+uint32_t crc32_le_arm64(uint32_t crc, const void *_buf, unsigned int len)
+{
+	const u8 *buf = _buf;
+
+	/*
+	 * Use aligned loads only, unaligned accesses fault when running
+	 * with the MMU disabled.
+	 */
+	while (len && ((unsigned long)buf & 7)) {
+		crc = __crc32b(crc, *buf++);
+		len--;
+	}
+
+	while (len >= 8) {
+		crc = __crc32x(crc, *(const u64 *)buf);
+		buf += 8;
+		len -= 8;
+	}
+
+	if (len >= 4) {
+		crc = __crc32w(crc, *(const u32 *)buf);
+		buf += 4;
+		len -= 4;
+	}
+
+	while (len--)
+		crc = __crc32b(crc, *buf++);
+
+	return crc;
+}
@@ -12,6 +12,7 @@
 #include <digest.h>
 #include <getopt.h>
 #include <libfile.h>
+#include <linux/sizes.h>
 
 #include "internal.h"
 
@@ -93,14 +94,17 @@ static int do_digest(int argc, char *argv[])
 	size_t keylen = 0;
 	size_t digestlen = 0;
 	char *algo = NULL;
-	int opt;
+	int opt, bench = 0;
 	int ret = COMMAND_ERROR;
 
 	if (argc < 2)
 		return COMMAND_ERROR_USAGE;
 
-	while((opt = getopt(argc, argv, "a:k:K:s:S:")) > 0) {
+	while((opt = getopt(argc, argv, "a:bk:K:s:S:")) > 0) {
 		switch(opt) {
+		case 'b':
+			bench = 1;
+			break;
 		case 'k':
 			key = optarg;
 			keylen = strlen(key);
@@ -121,6 +125,18 @@ static int do_digest(int argc, char *argv[])
 		}
 	}
 
+	if (bench) {
+		unsigned long size = SZ_1M;
+
+		if (optind < argc)
+			size = strtoull_suffix(argv[optind], NULL, 0);
+
+		if (!size)
+			return COMMAND_ERROR_USAGE;
+
+		return digest_algo_bench(algo, size) ? COMMAND_ERROR : COMMAND_SUCCESS;
+	}
+
 	if (!algo)
 		return COMMAND_ERROR_USAGE;
 
@@ -189,8 +205,11 @@ err:
 
 BAREBOX_CMD_HELP_START(digest)
 BAREBOX_CMD_HELP_TEXT("Calculate a digest over a FILE or a memory area.")
+BAREBOX_CMD_HELP_TEXT("With -b the throughput of all registered drivers (or only")
+BAREBOX_CMD_HELP_TEXT("the ones for <algo>) is measured over SIZE bytes (default 1M).")
 BAREBOX_CMD_HELP_TEXT("Options:")
 BAREBOX_CMD_HELP_OPT ("-a <algo>\t",  "hash or signature algorithm to use")
+BAREBOX_CMD_HELP_OPT ("-b\t",         "benchmark the digest drivers")
 BAREBOX_CMD_HELP_OPT ("-k <key>\t",   "use supplied <key> (ASCII or hex) for MAC")
 BAREBOX_CMD_HELP_OPT ("-K <file>\t",  "use key from <file> (binary) for MAC")
 BAREBOX_CMD_HELP_OPT ("-s <hex>\t",   "verify data against supplied <hex> (hash, MAC or signature)")
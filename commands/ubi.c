@@ -281,6 +281,52 @@ BAREBOX_CMD_START(ubidetach)
 	BAREBOX_CMD_GROUP(CMD_GRP_PART)
 BAREBOX_CMD_END
 
+static int do_ubifastmap(int argc, char *argv[])
+{
+	struct mtd_info_user user;
+	int fd, ret, ubi_num;
+
+	if (argc != 2)
+		return COMMAND_ERROR_USAGE;
+
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0) {
+		ubi_num = simple_strtoul(argv[1], NULL, 0);
+	} else {
+		ret = ioctl(fd, MEMGETINFO, &user);
+		close(fd);
+		if (ret)
+			goto out;
+
+		ubi_num = ubi_num_get_by_mtd(user.mtd);
+		if (ubi_num < 0) {
+			ret = ubi_num;
+			goto out;
+		}
+	}
+
+	ret = ubi_write_fastmap(ubi_num);
+out:
+	if (ret)
+		printf("failed to write fastmap: %s\n", strerror(-ret));
+
+	return ret ? 1 : 0;
+}
+
+BAREBOX_CMD_HELP_START(ubifastmap)
+BAREBOX_CMD_HELP_TEXT("Write a new fastmap to the UBI device attached to mtd")
+BAREBOX_CMD_HELP_TEXT("device MTDDEV or with number UBINUM. Devices attached by")
+BAREBOX_CMD_HELP_TEXT("scanning get a fastmap, so that the next attach is fast.")
+BAREBOX_CMD_HELP_END
+
+BAREBOX_CMD_START(ubifastmap)
+	.cmd		= do_ubifastmap,
+	BAREBOX_CMD_DESC("write an UBI fastmap")
+	BAREBOX_CMD_OPTS("MTDDEV/UBINUM")
+	BAREBOX_CMD_GROUP(CMD_GRP_PART)
+	BAREBOX_CMD_HELP(cmd_ubifastmap_help)
+BAREBOX_CMD_END
+
 static int do_ubirmvol(int argc, char *argv[])
 {
 	struct ubi_volume_desc *desc;
@@ -7,8 +7,13 @@
 #include <common.h>
 #include <block.h>
 #include <malloc.h>
+#include <init.h>
+#include <globalvar.h>
+#include <magicvar.h>
 #include <linux/err.h>
 #include <linux/list.h>
+#include <linux/list_sort.h>
+#include <linux/sizes.h>
 #include <dma.h>
 
 #define BLOCKSIZE(blk)	(1 << blk->blockbits)
@@ -22,38 +27,174 @@ struct chunk {
 	int dirty; /* need to write back to device */
 	int num; /* number of chunk, debugging only */
 	struct list_head list;
+	struct hlist_node hash; /* entry in blk->chunk_hash */
+	struct list_head wb; /* entry in the list of chunks to write back */
 };
 
 #define BUFSIZE (PAGE_SIZE * 16)
 
+/* maximum number of chunks read ahead or written back with a single request */
+#define BATCH_CHUNKS	4
+
+#define CHUNK_HASH_SIZE	64
+
+/* default cache size per block device in KiB */
+static int block_cache_size = 8 * BUFSIZE / SZ_1K;
+
 static int writebuffer_io_len(struct block_device *blk, struct chunk *chunk)
 {
 	return min_t(blkcnt_t, blk->rdbufsize, blk->num_blocks - chunk->block_start);
 }
 
+static unsigned int chunk_hash(struct block_device *blk, sector_t block)
+{
+	return (block >> __ffs(blk->rdbufsize)) & (CHUNK_HASH_SIZE - 1);
+}
+
 /*
- * Write all dirty chunks back to the device
+ * The number of chunks a block device may use, either from the device's
+ * own cache_size or from global.block.cache_size.
  */
-static int writebuffer_flush(struct block_device *blk)
+static unsigned int block_max_chunks(struct block_device *blk)
 {
+	size_t size = blk->cache_size;
+
+	if (!size)
+		size = (size_t)block_cache_size * SZ_1K;
+
+	/* two chunks are needed for read-modify-write of unaligned data */
+	return max_t(size_t, size / BUFSIZE, 2);
+}
+
+/*
+ * Lazily allocated bounce buffer used to transfer multiple chunks
+ * with a single request.
+ */
+static void *block_iobuf(struct block_device *blk)
+{
+	if (!blk->iobuf)
+		blk->iobuf = dma_alloc(BATCH_CHUNKS * BUFSIZE);
+
+	return blk->iobuf;
+}
+
+static int chunk_cmp(void *priv, struct list_head *a, struct list_head *b)
+{
+	struct chunk *ca = list_entry(a, struct chunk, wb);
+	struct chunk *cb = list_entry(b, struct chunk, wb);
+
+	if (ca->block_start < cb->block_start)
+		return -1;
+
+	return ca->block_start > cb->block_start;
+}
+
+/*
+ * Write back a run of adjacent dirty chunks. The first chunk is written
+ * from its own buffer, runs of multiple chunks through the bounce buffer.
+ */
+static int writebuffer_write_run(struct block_device *blk,
+				 struct list_head *run, int num)
+{
+	struct chunk *first = list_first_entry(run, struct chunk, wb);
 	struct chunk *chunk;
+	blkcnt_t len = 0;
+	void *buf;
 	int ret;
 
-	if (!IS_ENABLED(CONFIG_BLOCK_WRITE))
-		return 0;
-
-	list_for_each_entry(chunk, &blk->buffered_blocks, list) {
-		if (chunk->dirty) {
+	buf = num > 1 ? block_iobuf(blk) : NULL;
+	if (!buf) {
+		list_for_each_entry(chunk, run, wb) {
 			ret = blk->ops->write(blk, chunk->data,
 					      chunk->block_start,
 					      writebuffer_io_len(blk, chunk));
 			if (ret < 0)
 				return ret;
-
 			chunk->dirty = 0;
 		}
+
+		return 0;
+	}
+
+	list_for_each_entry(chunk, run, wb) {
+		memcpy(buf + (len << blk->blockbits), chunk->data,
+		       writebuffer_io_len(blk, chunk) << blk->blockbits);
+		len += writebuffer_io_len(blk, chunk);
+	}
+
+	dev_dbg(blk->dev, "%s: %llu, %d chunks\n", __func__,
+		first->block_start, num);
+
+	ret = blk->ops->write(blk, buf, first->block_start, len);
+	if (ret < 0)
+		return ret;
+
+	list_for_each_entry(chunk, run, wb)
+		chunk->dirty = 0;
+
+	return 0;
+}
+
+/*
+ * Write all dirty chunks back to the device. The chunks are sorted by
+ * their position on the device and adjacent chunks are merged into a
+ * single write request.
+ */
+static int writebuffer_write(struct block_device *blk)
+{
+	struct chunk *chunk, *tmp;
+	LIST_HEAD(dirty);
+	LIST_HEAD(run);
+	int num = 0;
+	int ret = 0;
+
+	if (!IS_ENABLED(CONFIG_BLOCK_WRITE))
+		return 0;
+
+	list_for_each_entry(chunk, &blk->buffered_blocks, list)
+		if (chunk->dirty)
+			list_add_tail(&chunk->wb, &dirty);
+
+	list_sort(NULL, &dirty, chunk_cmp);
+
+	list_for_each_entry_safe(chunk, tmp, &dirty, wb) {
+		if (num) {
+			struct chunk *last = list_last_entry(&run, struct chunk, wb);
+
+			if (num == BATCH_CHUNKS ||
+			    last->block_start + blk->rdbufsize != chunk->block_start) {
+				ret = writebuffer_write_run(blk, &run, num);
+				if (ret)
+					break;
+				INIT_LIST_HEAD(&run);
+				num = 0;
+			}
+		}
+
+		list_move_tail(&chunk->wb, &run);
+		num++;
 	}
 
+	if (!ret && num)
+		ret = writebuffer_write_run(blk, &run, num);
+
+	return ret;
+}
+
+/*
+ * Write all dirty chunks back to the device
+ */
+static int writebuffer_flush(struct block_device *blk)
+{
+	int ret;
+
+	if (!IS_ENABLED(CONFIG_BLOCK_WRITE))
+		return 0;
+
+	ret = writebuffer_write(blk);
+	if (ret)
+		return ret;
+
 	if (blk->ops->flush)
 		return blk->ops->flush(blk);
 
@@ -67,10 +208,10 @@ static int writebuffer_flush(struct block_device *blk)
 static struct chunk *chunk_get_cached(struct block_device *blk, sector_t block)
 {
 	struct chunk *chunk;
+	sector_t block_start = block & ~(sector_t)blk->blkmask;
 
-	list_for_each_entry(chunk, &blk->buffered_blocks, list) {
-		if (block >= chunk->block_start &&
-				block < chunk->block_start + blk->rdbufsize) {
+	hlist_for_each_entry(chunk, &blk->chunk_hash[chunk_hash(blk, block)], hash) {
+		if (chunk->block_start == block_start) {
 			dev_dbg(blk->dev, "%s: found %llu in %d\n", __func__,
 				block, chunk->num);
 			/*
@@ -99,35 +240,144 @@ static void *block_get_cached(struct block_device *blk, sector_t block)
 	return chunk->data + (block - chunk->block_start) * BLOCKSIZE(blk);
 }
 
+static struct chunk *chunk_alloc(struct block_device *blk)
+{
+	struct chunk *chunk;
+
+	chunk = xzalloc(sizeof(*chunk));
+	chunk->data = dma_alloc(BUFSIZE);
+	if (!chunk->data) {
+		free(chunk);
+		return NULL;
+	}
+
+	chunk->num = blk->num_chunks++;
+
+	return chunk;
+}
+
+static void chunk_free(struct block_device *blk, struct chunk *chunk)
+{
+	dma_free(chunk->data);
+	free(chunk);
+	blk->num_chunks--;
+}
+
+static void chunk_insert(struct block_device *blk, struct chunk *chunk)
+{
+	list_add(&chunk->list, &blk->buffered_blocks);
+	hlist_add_head(&chunk->hash,
+		       &blk->chunk_hash[chunk_hash(blk, chunk->block_start)]);
+}
+
 /*
- * Get a data chunk, either from the idle list or if the idle list
- * is empty, the least recently used is written back to disk and
- * returned.
+ * Get a data chunk, either from the idle list, a newly allocated one
+ * when the cache has not reached its size yet, or the least recently
+ * used one. Evicting a dirty chunk writes back all dirty chunks.
  */
 static struct chunk *get_chunk(struct block_device *blk)
 {
+	unsigned int max_chunks = block_max_chunks(blk);
 	struct chunk *chunk;
 	int ret;
 
-	if (list_empty(&blk->idle_blocks)) {
+	if (!list_empty(&blk->idle_blocks)) {
+		chunk = list_first_entry(&blk->idle_blocks, struct chunk, list);
+		list_del(&chunk->list);
+		return chunk;
+	}
+
+	if (blk->num_chunks < max_chunks) {
+		chunk = chunk_alloc(blk);
+		if (chunk)
+			return chunk;
+	}
+
+	while (1) {
 		/* use last entry which is the most unused */
 		chunk = list_last_entry(&blk->buffered_blocks, struct chunk, list);
 		if (chunk->dirty) {
-			ret = blk->ops->write(blk, chunk->data,
-					      chunk->block_start,
-					      writebuffer_io_len(blk, chunk));
+			ret = writebuffer_write(blk);
 			if (ret < 0)
 				return ERR_PTR(ret);
+		}
 
-			chunk->dirty = 0;
+		list_del(&chunk->list);
+		hlist_del(&chunk->hash);
+
+		/* shrink the cache when its size has been reduced */
+		if (blk->num_chunks <= max_chunks)
+			return chunk;
+
+		chunk_free(blk, chunk);
+	}
+}
+
+/*
+ * Read multiple chunks following @block_start with a single request when
+ * the device is accessed sequentially. Returns the number of chunks read,
+ * 0 when nothing has been read ahead.
+ */
+static int block_readahead(struct block_device *blk, sector_t block_start)
+{
+	struct chunk *chunks[BATCH_CHUNKS];
+	unsigned int max_chunks = block_max_chunks(blk);
+	int i, num, ret;
+	blkcnt_t len = 0;
+	void *buf;
+
+	if (block_start != blk->ra_next || blk->discard_size)
+		return 0;
+
+	/* don't let read ahead push the whole working set out of the cache */
+	num = min_t(int, BATCH_CHUNKS, max_chunks / 2);
+
+	for (i = 1; i < num; i++) {
+		sector_t start = block_start + i * blk->rdbufsize;
+
+		if (start >= blk->num_blocks || chunk_get_cached(blk, start))
+			break;
+	}
+
+	num = i;
+	if (num < 2)
+		return 0;
+
+	buf = block_iobuf(blk);
+	if (!buf)
+		return 0;
+
+	for (i = 0; i < num; i++) {
+		chunks[i] = get_chunk(blk);
+		if (IS_ERR(chunks[i])) {
+			ret = PTR_ERR(chunks[i]);
+			goto out;
 		}
-	} else {
-		chunk = list_first_entry(&blk->idle_blocks, struct chunk, list);
+
+		chunks[i]->block_start = block_start + i * blk->rdbufsize;
+		len += writebuffer_io_len(blk, chunks[i]);
 	}
 
-	list_del(&chunk->list);
+	dev_dbg(blk->dev, "%s: %llu, %d chunks\n", __func__, block_start, num);
 
-	return chunk;
+	ret = blk->ops->read(blk, buf, block_start, len);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < num; i++) {
+		memcpy(chunks[i]->data, buf + ((blkcnt_t)i * blk->rdbufsize << blk->blockbits),
+		       writebuffer_io_len(blk, chunks[i]) << blk->blockbits);
+		chunk_insert(blk, chunks[i]);
+	}
+
+	blk->ra_next = block_start + num * blk->rdbufsize;
+
+	return num;
+out:
+	while (i--)
+		list_add_tail(&chunks[i]->list, &blk->idle_blocks);
+
+	return ret;
 }
 
 /*
@@ -138,13 +388,18 @@ static struct chunk *get_chunk(struct block_device *blk)
 static int block_cache(struct block_device *blk, sector_t block)
 {
 	struct chunk *chunk;
+	sector_t block_start = block & ~(sector_t)blk->blkmask;
 	int ret;
 
+	ret = block_readahead(blk, block_start);
+	if (ret)
+		return ret < 0 ? ret : 0;
+
 	chunk = get_chunk(blk);
 	if (IS_ERR(chunk))
 		return PTR_ERR(chunk);
 
-	chunk->block_start = block & ~blk->blkmask;
+	chunk->block_start = block_start;
 
 	dev_dbg(blk->dev, "%s: %llu to %d\n", __func__, chunk->block_start,
 		chunk->num);
@@ -153,7 +408,7 @@ static int block_cache(struct block_device *blk, sector_t block)
 	    chunk->block_start * BLOCKSIZE(blk) + writebuffer_io_len(blk, chunk)
 	    <= blk->discard_start + blk->discard_size) {
 		memset(chunk->data, 0, writebuffer_io_len(blk, chunk));
-		list_add(&chunk->list, &blk->buffered_blocks);
+		chunk_insert(blk, chunk);
 		return 0;
 	}
 
@@ -163,7 +418,9 @@ static int block_cache(struct block_device *blk, sector_t block)
 		list_add_tail(&chunk->list, &blk->idle_blocks);
 		return ret;
 	}
-	list_add(&chunk->list, &blk->buffered_blocks);
+	chunk_insert(blk, chunk);
+
+	blk->ra_next = block_start + blk->rdbufsize;
 
 	return 0;
 }
@@ -195,6 +452,66 @@ static void *block_get(struct block_device *blk, sector_t block)
 	return outdata;
 }
 
+/*
+ * Block aligned transfers of at least a chunk bypass the cache and go
+ * directly between the device and the caller's buffer.
+ */
+static bool block_direct_io(struct block_device *blk, const void *buf,
+			    blkcnt_t blocks)
+{
+	return blocks >= blk->rdbufsize &&
+		IS_ALIGNED((unsigned long)buf, DMA_ALIGNMENT);
+}
+
+/*
+ * Get the blocks of a chunk which are within a given range. Returns false
+ * when the chunk does not overlap with the range.
+ */
+static bool chunk_overlap(struct block_device *blk, struct chunk *chunk,
+			  sector_t block, blkcnt_t blocks,
+			  sector_t *start, blkcnt_t *num)
+{
+	sector_t s = max(chunk->block_start, block);
+	sector_t e = min_t(sector_t, chunk->block_start + writebuffer_io_len(blk, chunk),
+			   block + blocks);
+
+	if (s >= e)
+		return false;
+
+	*start = s;
+	*num = e - s;
+
+	return true;
+}
+
+static int block_read_direct(struct block_device *blk, void *buf,
+			     sector_t block, blkcnt_t blocks)
+{
+	struct chunk *chunk;
+	sector_t start;
+	blkcnt_t num;
+	int ret;
+
+	dev_dbg(blk->dev, "%s: %llu, %llu blocks\n", __func__, block, blocks);
+
+	ret = blk->ops->read(blk, buf, block, blocks);
+	if (ret)
+		return ret;
+
+	/* dirty chunks are newer than the data on the device */
+	list_for_each_entry(chunk, &blk->buffered_blocks, list) {
+		if (!chunk->dirty ||
+		    !chunk_overlap(blk, chunk, block, blocks, &start, &num))
+			continue;
+
+		memcpy(buf + ((start - block) << blk->blockbits),
+		       chunk->data + ((start - chunk->block_start) << blk->blockbits),
+		       num << blk->blockbits);
+	}
+
+	return 0;
+}
+
 static ssize_t block_op_read(struct cdev *cdev, void *buf, size_t count,
 		loff_t offset, unsigned long flags)
 {
@@ -221,6 +538,18 @@ static ssize_t block_op_read(struct cdev *cdev, void *buf, size_t count,
 
 	blocks = count >> blk->blockbits;
 
+	if (block_direct_io(blk, buf, blocks)) {
+		int ret = block_read_direct(blk, buf, block, blocks);
+
+		if (ret)
+			return ret;
+
+		buf += blocks << blk->blockbits;
+		count -= blocks << blk->blockbits;
+		block += blocks;
+		blocks = 0;
+	}
+
 	while (blocks) {
 		void *iobuf = block_get(blk, block);
 
@@ -272,6 +601,38 @@ static int block_put(struct block_device *blk, const void *buf, sector_t block)
 	return 0;
 }
 
+static int block_write_direct(struct block_device *blk, const void *buf,
+			      sector_t block, blkcnt_t blocks)
+{
+	struct chunk *chunk, *tmp;
+	sector_t start;
+	blkcnt_t num;
+
+	dev_dbg(blk->dev, "%s: %llu, %llu blocks\n", __func__, block, blocks);
+
+	/*
+	 * Drop chunks which are completely overwritten and update the ones
+	 * which partly overlap, so that the cache stays coherent.
+	 */
+	list_for_each_entry_safe(chunk, tmp, &blk->buffered_blocks, list) {
+		if (!chunk_overlap(blk, chunk, block, blocks, &start, &num))
+			continue;
+
+		if (num == writebuffer_io_len(blk, chunk)) {
+			chunk->dirty = 0;
+			hlist_del(&chunk->hash);
+			list_move_tail(&chunk->list, &blk->idle_blocks);
+			continue;
+		}
+
+		memcpy(chunk->data + ((start - chunk->block_start) << blk->blockbits),
+		       buf + ((start - block) << blk->blockbits),
+		       num << blk->blockbits);
+	}
+
+	return blk->ops->write(blk, buf, block, blocks);
+}
+
 static ssize_t block_op_write(struct cdev *cdev, const void *buf, size_t count,
 		loff_t offset, ulong flags)
 {
@@ -303,6 +664,17 @@ static ssize_t block_op_write(struct cdev *cdev, const void *buf, size_t count,
 
 	blocks = count >> blk->blockbits;
 
+	if (block_direct_io(blk, buf, blocks)) {
+		ret = block_write_direct(blk, buf, block, blocks);
+		if (ret)
+			return ret;
+
+		buf += blocks << blk->blockbits;
+		count -= blocks << blk->blockbits;
+		block += blocks;
+		blocks = 0;
+	}
+
 	while (blocks) {
 		ret = block_put(blk, buf, block);
 		if (ret)
@@ -376,20 +748,22 @@ int blockdevice_register(struct block_device *blk)
 	INIT_LIST_HEAD(&blk->buffered_blocks);
 	INIT_LIST_HEAD(&blk->idle_blocks);
 	blk->blkmask = blk->rdbufsize - 1;
+	blk->num_chunks = 0;
+	blk->ra_next = ~(sector_t)0;
+	blk->iobuf = NULL;
+
+	blk->chunk_hash = xzalloc(sizeof(*blk->chunk_hash) * CHUNK_HASH_SIZE);
+	for (i = 0; i < CHUNK_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&blk->chunk_hash[i]);
 
 	dev_dbg(blk->dev, "rdbufsize: %d blockbits: %d blkmask: 0x%08x\n",
 		blk->rdbufsize, blk->blockbits, blk->blkmask);
 
-	for (i = 0; i < 8; i++) {
-		struct chunk *chunk = xzalloc(sizeof(*chunk));
-		chunk->data = dma_alloc(BUFSIZE);
-		chunk->num = i;
-		list_add_tail(&chunk->list, &blk->idle_blocks);
-	}
-
 	ret = devfs_create(&blk->cdev);
-	if (ret)
+	if (ret) {
+		free(blk->chunk_hash);
 		return ret;
+	}
 
 	list_add_tail(&blk->list, &block_device_list);
 
@@ -404,15 +778,14 @@ int blockdevice_unregister(struct block_device *blk)
 
 	writebuffer_flush(blk);
 
-	list_for_each_entry_safe(chunk, tmp, &blk->buffered_blocks, list) {
-		dma_free(chunk->data);
-		free(chunk);
-	}
+	list_for_each_entry_safe(chunk, tmp, &blk->buffered_blocks, list)
+		chunk_free(blk, chunk);
 
-	list_for_each_entry_safe(chunk, tmp, &blk->idle_blocks, list) {
-		dma_free(chunk->data);
-		free(chunk);
-	}
+	list_for_each_entry_safe(chunk, tmp, &blk->idle_blocks, list)
+		chunk_free(blk, chunk);
+
+	free(blk->chunk_hash);
+	dma_free(blk->iobuf);
 
 	devfs_remove(&blk->cdev);
 	list_del(&blk->list);
@@ -441,3 +814,29 @@ int block_write(struct block_device *blk, void *buf, sector_t block, blkcnt_t nu
 
 	return ret < 0 ? ret : 0;
 }
+
+/**
+ * cdev_get_block_device - get the block device behind a cdev
+ * @cdev:	the cdev, either of a block device or a partition on it
+ *
+ * Return: the block device or NULL if @cdev is no block device. For
+ * partitions cdev->offset is the start of the partition on the device.
+ */
+struct block_device *cdev_get_block_device(const struct cdev *cdev)
+{
+	if (!cdev || cdev->ops != &block_ops)
+		return NULL;
+
+	return cdev->priv;
+}
+
+static int block_cache_init(void)
+{
+	globalvar_add_simple_int("block.cache_size", &block_cache_size, "%u");
+
+	return 0;
+}
+core_initcall(block_cache_init);
+
+BAREBOX_MAGICVAR(global.block.cache_size,
+		 "Default size of the cache of each block device in KiB");
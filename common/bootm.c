@@ -218,11 +218,10 @@ int bootm_load_initrd(struct image_data *data, unsigned long load_address)
 
 	if (IS_ENABLED(CONFIG_FITIMAGE) && data->os_fit &&
 	    fit_has_image(data->os_fit, data->fit_config, "ramdisk")) {
-		const void *initrd;
 		unsigned long initrd_size;
 
-		ret = fit_open_image(data->os_fit, data->fit_config, "ramdisk",
-				     &initrd, &initrd_size);
+		ret = fit_get_image_size(data->os_fit, data->fit_config,
+					 "ramdisk", &initrd_size);
 		if (ret) {
 			pr_err("Cannot open ramdisk image in FIT image: %s\n",
 					strerror(-ret));
@@ -238,7 +237,16 @@ int bootm_load_initrd(struct image_data *data, unsigned long load_address)
 				(unsigned long long)load_address + initrd_size - 1);
 			return -ENOMEM;
 		}
-		memcpy((void *)load_address, initrd, initrd_size);
+		/* load and verify in one go, no intermediate copy */
+		ret = fit_load_image(data->os_fit, data->fit_config, "ramdisk",
+				     (void *)load_address, initrd_size);
+		if (ret) {
+			pr_err("Cannot open ramdisk image in FIT image: %s\n",
+					strerror(-ret));
+			release_sdram_region(data->initrd_res);
+			data->initrd_res = NULL;
+			return ret;
+		}
 		pr_info("Loaded initrd from FIT image\n");
 		goto done1;
 	}
@@ -889,6 +897,12 @@ static struct image_handler xz_bootm_handler = {
 	.filetype = filetype_xz_compressed,
 };
 
+static struct image_handler zstd_bootm_handler = {
+	.name = "ZSTD compressed file",
+	.bootm = do_bootm_compressed,
+	.filetype = filetype_zstd_compressed,
+};
+
 static int bootm_init(void)
 {
 	globalvar_add_simple("bootm.image", NULL);
@@ -922,6 +936,8 @@ static int bootm_init(void)
 		register_image_handler(&lz4_bootm_handler);
 	if (IS_ENABLED(CONFIG_XZ_DECOMPRESS))
 		register_image_handler(&xz_bootm_handler);
+	if (IS_ENABLED(CONFIG_ZSTD_DECOMPRESS))
+		register_image_handler(&zstd_bootm_handler);
 
 	return 0;
 }
@@ -14,6 +14,7 @@
 #include <malloc.h>
 #include <environment.h>
 #include <linux/list.h>
+#include <linux/hash.h>
 #include <init.h>
 #include <complete.h>
 #include <getopt.h>
@@ -21,6 +22,25 @@
 LIST_HEAD(command_list);
 EXPORT_SYMBOL(command_list);
 
+/*
+ * Commands are additionally kept in a hash table indexed by name so that
+ * find_cmd() does not have to walk the whole (sorted) command list for
+ * every command a script executes.
+ */
+#define COMMAND_HASH_BITS	7
+
+static struct hlist_head command_hash[1 << COMMAND_HASH_BITS];
+
+static unsigned int command_hash_name(const char *name)
+{
+	u32 hash = 0;
+
+	while (*name)
+		hash = hash * 31 + (unsigned char)*name++;
+
+	return hash_32(hash, COMMAND_HASH_BITS);
+}
+
 void barebox_cmd_usage(struct command *cmdtp)
 {
 	putchar('\n');
@@ -89,6 +109,8 @@ int register_command(struct command *cmd)
 	debug("register command %s\n", cmd->name);
 
 	list_add_sort(&cmd->list, &command_list, compare);
+	/* newer entries shadow older ones with the same name */
+	hlist_add_head(&cmd->hash, &command_hash[command_hash_name(cmd->name)]);
 
 	if (cmd->aliases) {
 		const char * const *aliases = cmd->aliases;
@@ -120,7 +142,7 @@ struct command *find_cmd (const char *cmd)
 {
 	struct command *cmdtp;
 
-	for_each_command(cmdtp)
+	hlist_for_each_entry(cmdtp, &command_hash[command_hash_name(cmd)], hash)
 		if (!strcmp(cmd, cmdtp->name))
 			return cmdtp;
 
@@ -117,12 +117,19 @@ static int path_command_complete(struct string_list *sl, char *instr)
 int command_complete(struct string_list *sl, char *instr)
 {
 	struct command *cmdtp;
+	int len, cmp;
 
 	if (!instr)
 		instr = "";
 
+	len = strlen(instr);
+
+	/* command_list is sorted, so all matches are adjacent */
 	for_each_command(cmdtp) {
-		if (strncmp(instr, cmdtp->name, strlen(instr)))
+		cmp = strncmp(instr, cmdtp->name, len);
+		if (cmp < 0)
+			break;
+		if (cmp)
 			continue;
 
 		string_list_add_asprintf(sl, "%s ", cmdtp->name);
@@ -336,24 +343,27 @@ void complete_reset(void)
 static char* cmd_complete_lookup(struct string_list *sl, char *instr)
 {
 	struct command *cmdtp;
-	int len;
 	int ret = COMPLETE_END;
 	char *res = NULL;
-	char *t;
+	char *name, *t;
 
-	for_each_command(cmdtp) {
-		len = strlen(cmdtp->name);
-		if (!strncmp(instr, cmdtp->name, len) && instr[len] == ' ') {
-			instr += len + 1;
-			t = strrchr(instr, ' ');
-			if (t)
-				instr = t + 1;
-
-			if (cmdtp->complete) {
-				ret = cmdtp->complete(sl, instr);
-				res = instr;
-			}
-			goto end;
+	t = strchr(instr, ' ');
+	if (!t)
+		goto end;
+
+	name = xstrndup(instr, t - instr);
+	cmdtp = find_cmd(name);
+	free(name);
+
+	if (cmdtp) {
+		instr = t + 1;
+		t = strrchr(instr, ' ');
+		if (t)
+			instr = t + 1;
+
+		if (cmdtp->complete) {
+			ret = cmdtp->complete(sl, instr);
+			res = instr;
 		}
 	}
 
@@ -42,13 +42,46 @@
 #include <linux/mtd/mtd.h>
 #include <fastboot.h>
 #include <system-partitions.h>
+#include <work.h>
 
 #define FASTBOOT_VERSION		"0.4"
 
+#define FASTBOOT_SPARSE_BUF_SIZE	SZ_128K
+
 static unsigned int fastboot_max_download_size = SZ_8M;
 static int fastboot_bbu;
 static char *fastboot_partitions;
 
+/*
+ * A sparse image which is written to flash while it is still being
+ * downloaded. The downloaded data is passed to the sparse image parser
+ * from a work queue whenever new data has arrived, the download itself
+ * continues from the pollers while the flash driver waits for the hardware.
+ */
+struct fastboot_stream {
+	struct work_struct work;
+	struct fastboot *fb;
+	struct file_list_entry *fentry;
+	/* NULL until the download is detected as sparse image */
+	struct fastboot_sparse *sparse;
+	/* the download is no sparse image and is handled after the download */
+	bool no_sparse;
+	bool queued;
+	/* temp file opened for reading once the download is finished */
+	int fd;
+	/* number of downloaded bytes passed to the sparse image parser */
+	size_t bytes;
+	void *buf;
+	int ret;
+};
+
+static void fastboot_stream_work(struct work_struct *work);
+static void fastboot_stream_work_cancel(struct work_struct *work);
+static void fastboot_stream_start(struct fastboot *fb);
+static int fastboot_stream_queue(struct fastboot *fb);
+static void fastboot_stream_abort(struct fastboot *fb);
+static void fastboot_stream_free(struct fastboot *fb);
+
 struct fb_variable {
 	char *name;
 	char *value;
@@ -180,6 +213,10 @@ int fastboot_generic_init(struct fastboot *fb, bool export_bbu)
 			return ret;
 	}
 
+	fb->stream_wq.fn = fastboot_stream_work;
+	fb->stream_wq.cancel = fastboot_stream_work_cancel;
+	wq_register(&fb->stream_wq);
+
 	return 0;
 }
 
@@ -194,6 +231,10 @@ void fastboot_generic_free(struct fastboot *fb)
 		free(var);
 	}
 
+	fastboot_stream_free(fb);
+	fb->stream_entry = NULL;
+	wq_unregister(&fb->stream_wq);
+
 	free(fb->tempname);
 
 	fb->active = false;
@@ -321,7 +362,8 @@ int fastboot_handle_download_data(struct fastboot *fb, const void *buffer,
 
 	fb->download_bytes += len;
 	show_progress(fb->download_bytes);
-	return 0;
+
+	return fastboot_stream_queue(fb);
 }
 
 void fastboot_download_finished(struct fastboot *fb)
@@ -346,6 +388,8 @@ void fastboot_abort(struct fastboot *fb)
 
 	fb->active = false;
 
+	fastboot_stream_abort(fb);
+
 	unlink(fb->tempname);
 }
 
@@ -364,12 +408,18 @@ static void cb_download(struct fastboot *fb, const char *cmd)
 		close(fb->download_fd);
 	}
 
-	fb->download_fd = open(fb->tempname, O_WRONLY | O_CREAT | O_TRUNC);
+	fastboot_stream_free(fb);
+
+	/* opened read-write, a stream reads back the data while downloading */
+	fb->download_fd = open(fb->tempname, O_RDWR | O_CREAT | O_TRUNC);
 	if (fb->download_fd < 0) {
 		fastboot_tx_print(fb, FASTBOOT_MSG_FAIL, "internal error");
 			return;
 	}
 
+	if (IS_ENABLED(CONFIG_FASTBOOT_SPARSE) && fb->stream_entry)
+		fastboot_stream_start(fb);
+
 	if (!fb->download_size)
 		fastboot_tx_print(fb, FASTBOOT_MSG_FAIL,
 					  "data invalid size");
@@ -496,113 +546,356 @@ static int check_ubi(struct fastboot *fb, struct file_list_entry *fentry,
 	}
 }
 
-static int fastboot_handle_sparse(struct fastboot *fb,
-				  struct file_list_entry *fentry)
+struct fastboot_sparse {
+	struct fastboot *fb;
+	struct file_list_entry *fentry;
+	struct sparse_stream *stream;
+	struct mtd_info *mtd;
+	int fd;
+	bool regular;
+	/* written during download, no messages can be sent to the host */
+	bool streaming;
+};
+
+static int fastboot_sparse_start(void *priv, loff_t size)
 {
-	struct sparse_image_ctx *sparse;
-	void *buf = NULL;
-	int ret, fd;
+	struct fastboot_sparse *fs = priv;
+
+	if (!fs->regular)
+		return 0;
+
+	return ftruncate(fs->fd, size);
+}
+
+static int fastboot_sparse_write(void *priv, loff_t pos, const void *buf,
+				 size_t len)
+{
+	struct fastboot_sparse *fs = priv;
+	int ret;
+
+	if (pos == 0 && !fs->streaming) {
+		ret = check_ubi(fs->fb, fs->fentry, file_detect_type(buf, len));
+		if (ret < 0)
+			return ret;
+	}
+
+	if (fs->mtd) {
+		if (!IS_ENABLED(CONFIG_UBIFORMAT))
+			return -ENOSYS;
+
+		if (pos == 0) {
+			ret = do_ubiformat(fs->fb, fs->mtd, NULL, 0);
+			if (ret)
+				return ret;
+		}
+
+		return ubiformat_write(fs->mtd, buf, len, pos);
+	}
+
+	discard_range(fs->fd, len, pos);
+
+	pos = lseek(fs->fd, pos, SEEK_SET);
+	if (pos == -1)
+		return -errno;
+
+	ret = write_full(fs->fd, buf, len);
+	if (ret < 0)
+		return ret;
+
+	return 0;
+}
+
+static const struct sparse_stream_ops fastboot_sparse_ops = {
+	.start = fastboot_sparse_start,
+	.write = fastboot_sparse_write,
+};
+
+static struct fastboot_sparse *fastboot_sparse_open(struct fastboot *fb,
+						    struct file_list_entry *fentry)
+{
+	struct fastboot_sparse *fs;
 	unsigned int flags = O_RDWR;
-	int bufsiz = SZ_128K;
 	struct stat s;
-	struct mtd_info *mtd = NULL;
+	int ret;
 
 	ret = stat(fentry->filename, &s);
 	if (ret) {
 		if (fentry->flags & FILE_LIST_FLAG_CREATE)
 			flags |= O_CREAT;
 		else
-			return ret;
+			return ERR_PTR(ret);
 	}
 
-	fd = open(fentry->filename, flags);
-	if (fd < 0)
-		return -errno;
+	fs = xzalloc(sizeof(*fs));
+	fs->fb = fb;
+	fs->fentry = fentry;
 
-	ret = fstat(fd, &s);
+	fs->fd = open(fentry->filename, flags);
+	if (fs->fd < 0) {
+		ret = -errno;
+		goto out_free;
+	}
+
+	ret = fstat(fs->fd, &s);
 	if (ret)
 		goto out_close_fd;
 
-	sparse = sparse_image_open(fb->tempname);
-	if (IS_ERR(sparse)) {
-		pr_err("Cannot open sparse image\n");
-		ret = PTR_ERR(sparse);
-		goto out_close_fd;
+	fs->regular = S_ISREG(s.st_mode);
+
+	if (fentry->flags & FILE_LIST_FLAG_UBI) {
+		fs->mtd = get_mtd(fb, fentry->filename);
+		if (IS_ERR(fs->mtd)) {
+			ret = PTR_ERR(fs->mtd);
+			goto out_close_fd;
+		}
 	}
 
-	if (S_ISREG(s.st_mode)) {
-		ret = ftruncate(fd, sparse_image_size(sparse));
-		if (ret)
-			goto out;
+	fs->stream = sparse_stream_new(&fastboot_sparse_ops, fs,
+				       fs->mtd ? fs->mtd->writesize : 1);
+
+	return fs;
+
+out_close_fd:
+	close(fs->fd);
+out_free:
+	free(fs);
+
+	return ERR_PTR(ret);
+}
+
+static void fastboot_sparse_close(struct fastboot_sparse *fs)
+{
+	sparse_stream_free(fs->stream);
+	close(fs->fd);
+	free(fs);
+}
+
+static int fastboot_handle_sparse(struct fastboot *fb,
+				  struct file_list_entry *fentry)
+{
+	struct fastboot_sparse *fs;
+	void *buf = NULL;
+	int ret, fd;
+
+	fs = fastboot_sparse_open(fb, fentry);
+	if (IS_ERR(fs))
+		return PTR_ERR(fs);
+
+	fd = open(fb->tempname, O_RDONLY);
+	if (fd < 0) {
+		ret = -errno;
+		goto out_close;
 	}
 
-	buf = malloc(bufsiz);
+	buf = malloc(FASTBOOT_SPARSE_BUF_SIZE);
 	if (!buf) {
 		ret = -ENOMEM;
 		goto out;
 	}
 
-	if (fentry->flags & FILE_LIST_FLAG_UBI) {
-		mtd = get_mtd(fb, fentry->filename);
-		if (IS_ERR(mtd)) {
-			ret = PTR_ERR(mtd);
-			goto out;
-		}
-	}
-
 	while (1) {
-		size_t retlen;
-		loff_t pos;
+		ret = read(fd, buf, FASTBOOT_SPARSE_BUF_SIZE);
+		if (ret < 0)
+			goto out;
+		if (!ret)
+			break;
 
-		ret = sparse_image_read(sparse, buf, &pos, bufsiz, &retlen);
+		ret = sparse_stream_feed(fs->stream, buf, ret);
 		if (ret)
 			goto out;
-		if (!retlen)
-			break;
+	}
 
-		if (pos == 0) {
-			ret = check_ubi(fb, fentry, file_detect_type(buf, retlen));
-			if (ret < 0)
-				goto out;
+	ret = sparse_stream_finish(fs->stream);
+	if (ret)
+		pr_err("Sparse image is truncated\n");
+out:
+	free(buf);
+	close(fd);
+out_close:
+	fastboot_sparse_close(fs);
+
+	return ret;
+}
+
+/*
+ * Pass the data downloaded so far to the sparse image parser. This writes
+ * to flash, so it must be called from command context.
+ */
+static int fastboot_stream_process(struct fastboot_stream *st)
+{
+	struct fastboot *fb = st->fb;
+	struct sparse_header hdr;
+	ssize_t now;
+	int fd;
+
+	while (!st->ret && !st->no_sparse && st->bytes < fb->download_bytes) {
+		if (fb->download_fd > 0) {
+			fd = fb->download_fd;
+		} else {
+			if (st->fd <= 0) {
+				st->fd = open(fb->tempname, O_RDONLY);
+				if (st->fd < 0) {
+					st->ret = -errno;
+					break;
+				}
+			}
+			fd = st->fd;
 		}
 
-		if (fentry->flags & FILE_LIST_FLAG_UBI) {
-			if (!IS_ENABLED(CONFIG_UBIFORMAT)) {
-				ret = -ENOSYS;
-				goto out;
+		if (!st->sparse) {
+			if (fb->download_bytes < sizeof(hdr))
+				break;
+
+			now = pread(fd, &hdr, sizeof(hdr), 0);
+			if (now < (ssize_t)sizeof(hdr)) {
+				st->ret = now < 0 ? now : -EIO;
+				break;
 			}
 
-			if (pos == 0) {
-				ret = do_ubiformat(fb, mtd, NULL, 0);
-				if (ret)
-					goto out;
+			if (!is_sparse_image(&hdr)) {
+				st->no_sparse = true;
+				break;
 			}
 
-			ret = ubiformat_write(mtd, buf, retlen, pos);
-			if (ret)
-				goto out;
-		} else {
-			discard_range(fd, retlen, pos);
+			pr_info("Writing sparse image to %s while downloading\n",
+				st->fentry->name);
 
-			pos = lseek(fd, pos, SEEK_SET);
-			if (pos == -1) {
-				ret = -errno;
-				goto out;
+			st->sparse = fastboot_sparse_open(fb, st->fentry);
+			if (IS_ERR(st->sparse)) {
+				st->ret = PTR_ERR(st->sparse);
+				st->sparse = NULL;
+				break;
 			}
 
-			ret = write_full(fd, buf, retlen);
-			if (ret < 0)
-				goto out;
+			st->sparse->streaming = true;
 		}
+
+		now = min_t(size_t, fb->download_bytes - st->bytes,
+			    FASTBOOT_SPARSE_BUF_SIZE);
+
+		now = pread(fd, st->buf, now, st->bytes);
+		if (now <= 0) {
+			st->ret = now < 0 ? now : -EIO;
+			break;
+		}
+
+		st->ret = sparse_stream_feed(st->sparse->stream, st->buf, now);
+		st->bytes += now;
 	}
 
-	ret = 0;
+	return st->ret;
+}
+
+static void fastboot_stream_work(struct work_struct *work)
+{
+	struct fastboot_stream *st = container_of(work, struct fastboot_stream, work);
+
+	st->queued = false;
+
+	fastboot_stream_process(st);
+}
+
+static void fastboot_stream_work_cancel(struct work_struct *work)
+{
+	struct fastboot_stream *st = container_of(work, struct fastboot_stream, work);
+
+	st->queued = false;
+}
+
+static void fastboot_stream_start(struct fastboot *fb)
+{
+	struct fastboot_stream *st;
+
+	st = xzalloc(sizeof(*st));
+	st->fb = fb;
+	st->fentry = fb->stream_entry;
+	st->buf = xmalloc(FASTBOOT_SPARSE_BUF_SIZE);
+
+	fb->stream = st;
+}
+
+/* called from the download handler, possibly in poller context */
+static int fastboot_stream_queue(struct fastboot *fb)
+{
+	struct fastboot_stream *st = fb->stream;
+
+	if (!IS_ENABLED(CONFIG_FASTBOOT_SPARSE) || !st)
+		return 0;
+
+	if (st->ret)
+		return st->ret;
+
+	if (!st->queued && !st->no_sparse) {
+		st->queued = true;
+		wq_queue_work(&fb->stream_wq, &st->work);
+	}
+
+	return 0;
+}
+
+static void fastboot_stream_abort(struct fastboot *fb)
+{
+	if (!IS_ENABLED(CONFIG_FASTBOOT_SPARSE) || !fb->stream)
+		return;
+
+	/* Files are closed later in command context */
+	wq_cancel_work(&fb->stream_wq);
+	fb->stream->ret = -EINTR;
+}
+
+static void fastboot_stream_free(struct fastboot *fb)
+{
+	struct fastboot_stream *st = fb->stream;
+
+	if (!IS_ENABLED(CONFIG_FASTBOOT_SPARSE) || !st)
+		return;
+
+	wq_cancel_work(&fb->stream_wq);
+
+	if (st->sparse)
+		fastboot_sparse_close(st->sparse);
+	if (st->fd > 0)
+		close(st->fd);
+
+	free(st->buf);
+	free(st);
+
+	fb->stream = NULL;
+}
+
+/*
+ * Finish writing a sparse image which was streamed during download.
+ * Returns FASTBOOT_CMD_FALLTHROUGH when the download was not streamed and
+ * must be flashed the normal way.
+ */
+static int fastboot_stream_finish(struct fastboot *fb,
+				  struct file_list_entry *fentry)
+{
+	struct fastboot_stream *st = fb->stream;
+	int ret;
+
+	ret = fastboot_stream_process(st);
+	if (ret)
+		goto out;
+
+	if (!st->sparse) {
+		ret = FASTBOOT_CMD_FALLTHROUGH;
+		goto out;
+	}
+
+	if (st->fentry != fentry) {
+		fastboot_tx_print(fb, FASTBOOT_MSG_INFO,
+				  "sparse image was written to %s",
+				  st->fentry->name);
+		ret = -EINVAL;
+		goto out;
+	}
 
+	ret = sparse_stream_finish(st->sparse->stream);
+	if (ret)
+		pr_err("Sparse image is truncated\n");
 out:
-	free(buf);
-	sparse_image_close(sparse);
-out_close_fd:
-	close(fd);
+	fastboot_stream_free(fb);
 
 	return ret;
 }
@@ -628,6 +921,16 @@ static void cb_flash(struct fastboot *fb, const char *cmd)
 		goto out;
 	}
 
+	if (IS_ENABLED(CONFIG_FASTBOOT_SPARSE) && fb->stream) {
+		ret = fastboot_stream_finish(fb, fentry);
+		if (ret < 0)
+			fastboot_tx_print(fb, FASTBOOT_MSG_FAIL,
+					  "writing sparse image: %s",
+					  strerror(-ret));
+		if (ret != FASTBOOT_CMD_FALLTHROUGH)
+			goto out;
+	}
+
 	if (fb->cmd_flash) {
 		ret = fb->cmd_flash(fb, fentry, fb->tempname, fb->download_size);
 		if (ret != FASTBOOT_CMD_FALLTHROUGH)
@@ -845,6 +1148,51 @@ static void cb_oem_exec(struct fastboot *fb, const char *cmd)
 		fastboot_tx_print(fb, FASTBOOT_MSG_OKAY, "");
 }
 
+static void cb_oem_stream(struct fastboot *fb, const char *cmd)
+{
+	struct file_list_entry *fentry;
+
+	pr_debug("%s: \"%s\"\n", __func__, cmd);
+
+	if (!IS_ENABLED(CONFIG_FASTBOOT_SPARSE)) {
+		fastboot_tx_print(fb, FASTBOOT_MSG_FAIL,
+				  "sparse image not supported");
+		return;
+	}
+
+	cmd = skip_spaces(cmd);
+	if (!*cmd) {
+		fb->stream_entry = NULL;
+		fastboot_tx_print(fb, FASTBOOT_MSG_OKAY, "");
+		return;
+	}
+
+	/* The flash handler must see the downloaded file */
+	if (fb->cmd_flash) {
+		fastboot_tx_print(fb, FASTBOOT_MSG_FAIL,
+				  "streaming not supported");
+		return;
+	}
+
+	fentry = file_list_entry_by_name(fb->files, cmd);
+	if (!fentry) {
+		fastboot_tx_print(fb, FASTBOOT_MSG_FAIL, "No such partition: %s",
+				  cmd);
+		return;
+	}
+
+	/* ubiformat needs the image type checked before writing */
+	if (fentry->flags & FILE_LIST_FLAG_UBI) {
+		fastboot_tx_print(fb, FASTBOOT_MSG_FAIL,
+				  "streaming not supported for UBI partitions");
+		return;
+	}
+
+	fb->stream_entry = fentry;
+
+	fastboot_tx_print(fb, FASTBOOT_MSG_OKAY, "");
+}
+
 static const struct cmd_dispatch_info cmd_oem_dispatch_info[] = {
 	{
 		.cmd = "getenv ",
@@ -855,6 +1203,9 @@ static const struct cmd_dispatch_info cmd_oem_dispatch_info[] = {
 	}, {
 		.cmd = "exec ",
 		.cb = cb_oem_exec,
+	}, {
+		.cmd = "stream",
+		.cb = cb_oem_stream,
 	},
 };
 
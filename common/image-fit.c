@@ -22,6 +22,7 @@
 #include <stringlist.h>
 #include <rsa.h>
 #include <image-fit.h>
+#include <linux/sizes.h>
 
 #define FDT_MAX_DEPTH 32
 #define FDT_MAX_PATH_LEN 200
@@ -337,6 +338,9 @@ static int fit_verify_signature(struct device_node *sig_node, const void *fit)
 	}
 
 	string_list_add(&exc_props, "data");
+	string_list_add(&exc_props, "data-size");
+	string_list_add(&exc_props, "data-position");
+	string_list_add(&exc_props, "data-offset");
 
 	digest = fit_alloc_digest(sig_node, &algo);
 	if (IS_ERR(digest)) {
@@ -365,12 +369,23 @@ static int fit_verify_signature(struct device_node *sig_node, const void *fit)
 	return ret;
 }
 
-static int fit_verify_hash(struct fit_handle *handle, struct device_node *image,
-			   const void *data, int data_len)
+/*
+ * Images are verified while their data is streamed through the digest, so
+ * that loading and verifying an image takes a single pass over the data.
+ */
+struct fit_verify {
+	struct digest *digest;
+	struct device_node *node;	/* hash or signature node */
+	enum hash_algo algo;
+	const void *value;		/* expected hash value */
+};
+
+static int fit_verify_hash_start(struct fit_handle *handle,
+				 struct device_node *image,
+				 struct fit_verify *v)
 {
 	struct digest *d;
 	const char *algo;
-	const char *value_read;
 	int hash_len, ret;
 	struct device_node *hash;
 
@@ -394,8 +409,8 @@ static int fit_verify_hash(struct fit_handle *handle, struct device_node *image,
 		return ret;
 	}
 
-	value_read = of_get_property(hash, "value", &hash_len);
-	if (!value_read) {
+	v->value = of_get_property(hash, "value", &hash_len);
+	if (!v->value) {
 		pr_err("%s: \"value\" property not found\n", hash->full_name);
 		return -EINVAL;
 	}
@@ -413,35 +428,24 @@ static int fit_verify_hash(struct fit_handle *handle, struct device_node *image,
 
 	if (hash_len != digest_length(d)) {
 		pr_err("%s: invalid hash length %d\n", hash->full_name, hash_len);
-		ret = -EINVAL;
-		goto err_digest_free;
+		digest_free(d);
+		return -EINVAL;
 	}
 
 	digest_init(d);
-	digest_update(d, data, data_len);
-
-	if (digest_verify(d, value_read)) {
-		pr_info("%s: hash BAD\n", hash->full_name);
-		ret =  -EBADMSG;
-	} else {
-		pr_info("%s: hash OK\n", hash->full_name);
-		ret = 0;
-	}
 
-err_digest_free:
-	digest_free(d);
+	v->digest = d;
+	v->node = hash;
 
-	return ret;
+	return 0;
 }
 
-static int fit_image_verify_signature(struct fit_handle *handle,
+static int fit_verify_signature_start(struct fit_handle *handle,
 				      struct device_node *image,
-				      const void *data, int data_len)
+				      struct fit_verify *v)
 {
 	struct digest *digest;
 	struct device_node *sig_node;
-	enum hash_algo algo = 0;
-	void *hash;
 	int ret;
 
 	if (!IS_ENABLED(CONFIG_FITIMAGE_SIGNATURE))
@@ -465,23 +469,72 @@ static int fit_image_verify_signature(struct fit_handle *handle,
 		return ret;
 	}
 
-	digest = fit_alloc_digest(sig_node, &algo);
+	digest = fit_alloc_digest(sig_node, &v->algo);
 	if (IS_ERR(digest))
 		return PTR_ERR(digest);
 
-	digest_update(digest, data, data_len);
-	hash = xzalloc(digest_length(digest));
-	digest_final(digest, hash);
+	v->digest = digest;
+	v->node = sig_node;
 
-	ret = fit_check_rsa_signature(sig_node, algo, hash);
+	return 0;
+}
 
-	free(hash);
+/*
+ * fit_verify_start - prepare verifying an image
+ *
+ * If @configuration is NULL then the RSA signature of the image is checked,
+ * otherwise only its hash (the configuration signature already covers the
+ * image nodes). v->digest is left NULL when there is nothing to check.
+ */
+static int fit_verify_start(struct fit_handle *handle, void *configuration,
+			    struct device_node *image, struct fit_verify *v)
+{
+	memset(v, 0, sizeof(*v));
 
-	digest_free(digest);
+	if (configuration)
+		return fit_verify_hash_start(handle, image, v);
+	else
+		return fit_verify_signature_start(handle, image, v);
+}
+
+static int fit_verify_finish(struct fit_verify *v)
+{
+	void *hash;
+	int ret;
+
+	if (!v->digest)
+		return 0;
+
+	if (v->value) {
+		if (digest_verify(v->digest, v->value)) {
+			pr_info("%s: hash BAD\n", v->node->full_name);
+			ret = -EBADMSG;
+		} else {
+			pr_info("%s: hash OK\n", v->node->full_name);
+			ret = 0;
+		}
+	} else {
+		hash = xzalloc(digest_length(v->digest));
+		digest_final(v->digest, hash);
+
+		ret = fit_check_rsa_signature(v->node, v->algo, hash);
+
+		free(hash);
+	}
+
+	digest_free(v->digest);
+	v->digest = NULL;
 
 	return ret;
 }
 
+static void fit_verify_abort(struct fit_verify *v)
+{
+	if (v->digest)
+		digest_free(v->digest);
+	v->digest = NULL;
+}
+
 int fit_has_image(struct fit_handle *handle, void *configuration,
 		  const char *name)
 {
@@ -568,6 +621,136 @@ int fit_get_image_address(struct fit_handle *handle, void *configuration,
 	return ret;
 }
 
+/*
+ * Images either have their data embedded in the "data" property or, for FIT
+ * images created with mkimage -E, stored behind the device tree structure
+ * at "data-position" (absolute) or "data-offset" (relative to the 4 byte
+ * aligned end of the device tree) with "data-size" bytes.
+ */
+struct fit_image_data {
+	const void *data;	/* data in memory, or NULL */
+	loff_t offset;		/* file offset if data is NULL */
+	unsigned long size;
+};
+
+static int fit_get_image_data(struct fit_handle *handle,
+			      struct device_node *image,
+			      struct fit_image_data *d)
+{
+	u32 size, offset;
+	int len;
+
+	d->data = of_get_property(image, "data", &len);
+	if (d->data) {
+		d->size = len;
+		return 0;
+	}
+
+	if (of_property_read_u32(image, "data-size", &size)) {
+		pr_err("data not found\n");
+		return -EINVAL;
+	}
+
+	if (!of_property_read_u32(image, "data-position", &offset)) {
+		d->offset = offset;
+	} else if (!of_property_read_u32(image, "data-offset", &offset)) {
+		const struct fdt_header *fdt = handle->fit;
+
+		d->offset = ALIGN(fdt32_to_cpu(fdt->totalsize), 4) + offset;
+	} else {
+		pr_err("%s: no data position\n", image->full_name);
+		return -EINVAL;
+	}
+
+	d->size = size;
+
+	/* external data already in memory, either mapped or from a buffer */
+	if (d->offset + d->size <= handle->size) {
+		d->data = handle->fit + d->offset;
+		return 0;
+	}
+
+	/* read from the file on demand */
+	if (handle->fd >= 0)
+		return 0;
+
+	pr_err("%s: data outside of FIT image\n", image->full_name);
+	return -EINVAL;
+}
+
+static int fit_open_image_node(struct fit_handle *handle, void *configuration,
+			       const char *name, struct device_node **image,
+			       struct fit_image_data *d)
+{
+	const char *unit = name, *type = NULL, *desc= "(no description)";
+	int ret;
+
+	ret = fit_get_image(handle, configuration, &unit, image);
+	if (ret)
+		return ret;
+
+	of_property_read_string(*image, "description", &desc);
+	pr_info("image '%s': '%s'\n", unit, desc);
+
+	of_property_read_string(*image, "type", &type);
+	if (!type) {
+		pr_err("No \"type\" property found in %s\n", (*image)->full_name);
+		return -EINVAL;
+	}
+
+	return fit_get_image_data(handle, *image, d);
+}
+
+#define FIT_LOAD_CHUNK	SZ_256K
+
+/*
+ * Copy the image data to @dest chunk by chunk, feeding each chunk to the
+ * digest while it is still in the cache.
+ */
+static int fit_load_data(struct fit_handle *handle, void *configuration,
+			 struct device_node *image, struct fit_image_data *d,
+			 void *dest)
+{
+	struct fit_verify v;
+	unsigned long pos, now;
+	int ret;
+
+	ret = fit_verify_start(handle, configuration, image, &v);
+	if (ret)
+		return ret;
+
+	if (!d->data && lseek(handle->fd, d->offset, SEEK_SET) != d->offset) {
+		ret = -errno;
+		goto err;
+	}
+
+	for (pos = 0; pos < d->size; pos += now) {
+		now = min_t(unsigned long, d->size - pos, FIT_LOAD_CHUNK);
+
+		if (d->data) {
+			memcpy(dest + pos, d->data + pos, now);
+		} else {
+			ret = read_full(handle->fd, dest + pos, now);
+			if (ret < 0)
+				goto err;
+			if (ret < now) {
+				pr_err("%s: short read\n", image->full_name);
+				ret = -EIO;
+				goto err;
+			}
+		}
+
+		if (v.digest)
+			digest_update(v.digest, dest + pos, now);
+	}
+
+	return fit_verify_finish(&v);
+err:
+	fit_verify_abort(&v);
+
+	return ret;
+}
+
 /**
  * fit_open_image - Open an image in a FIT image
  * @handle: The FIT image handle
@@ -590,44 +773,117 @@ int fit_open_image(struct fit_handle *handle, void *configuration,
 		   unsigned long *outsize)
 {
 	struct device_node *image;
-	const char *unit = name, *type = NULL, *desc= "(no description)";
-	const void *data;
-	int data_len;
-	int ret = 0;
+	struct fit_image_data d;
+	struct fit_verify v;
+	struct fit_image_buf *buf;
+	int ret;
 
-	ret = fit_get_image(handle, configuration, &unit, &image);
+	ret = fit_open_image_node(handle, configuration, name, &image, &d);
 	if (ret)
 		return ret;
 
-	of_property_read_string(image, "description", &desc);
-	pr_info("image '%s': '%s'\n", unit, desc);
+	if (d.data) {
+		ret = fit_verify_start(handle, configuration, image, &v);
+		if (ret)
+			return ret;
 
-	of_property_read_string(image, "type", &type);
-	if (!type) {
-		pr_err("No \"type\" property found in %s\n", image->full_name);
-		return -EINVAL;
+		if (v.digest)
+			digest_update(v.digest, d.data, d.size);
+
+		ret = fit_verify_finish(&v);
+		if (ret < 0)
+			return ret;
+
+		*outdata = d.data;
+		*outsize = d.size;
+
+		return 0;
 	}
 
-	data = of_get_property(image, "data", &data_len);
-	if (!data) {
-		pr_err("data not found\n");
-		return -EINVAL;
+	buf = xzalloc(sizeof(*buf));
+	buf->data = malloc(d.size);
+	if (!buf->data) {
+		free(buf);
+		return -ENOMEM;
 	}
 
-	if (configuration)
-		ret = fit_verify_hash(handle, image, data, data_len);
-	else
-		ret = fit_image_verify_signature(handle, image, data, data_len);
+	ret = fit_load_data(handle, configuration, image, &d, buf->data);
+	if (ret < 0) {
+		free(buf->data);
+		free(buf);
+		return ret;
+	}
 
-	if (ret < 0)
+	list_add(&buf->list, &handle->buffers);
+
+	*outdata = buf->data;
+	*outsize = d.size;
+
+	return 0;
+}
+
+/**
+ * fit_get_image_size - Get the data size of an image in a FIT image
+ * @handle: The FIT image handle
+ * @name: The name of the image
+ * @size: The size of the image data
+ *
+ * @configuration is the same as for fit_open_image(). Use this to find out
+ * how much space fit_load_image() needs.
+ *
+ * Return: 0 for success, negative error code otherwise
+ */
+int fit_get_image_size(struct fit_handle *handle, void *configuration,
+		       const char *name, unsigned long *size)
+{
+	struct device_node *image;
+	struct fit_image_data d;
+	const char *unit = name;
+	int ret;
+
+	ret = fit_get_image(handle, configuration, &unit, &image);
+	if (ret)
+		return ret;
+
+	ret = fit_get_image_data(handle, image, &d);
+	if (ret)
 		return ret;
 
-	*outdata = data;
-	*outsize = data_len;
+	*size = d.size;
 
 	return 0;
 }
 
+/**
+ * fit_load_image - Load an image in a FIT image to a given address
+ * @handle: The FIT image handle
+ * @name: The name of the image to load
+ * @dest: Where to put the image data
+ * @size: Size of the buffer at @dest
+ *
+ * Like fit_open_image(), but the image data is copied (or read from the
+ * FIT file for images with external data) directly to @dest and verified
+ * on the way. On failure the contents of @dest are undefined.
+ *
+ * Return: 0 for success, negative error code otherwise
+ */
+int fit_load_image(struct fit_handle *handle, void *configuration,
+		   const char *name, void *dest, unsigned long size)
+{
+	struct device_node *image;
+	struct fit_image_data d;
+	int ret;
+
+	ret = fit_open_image_node(handle, configuration, name, &image, &d);
+	if (ret)
+		return ret;
+
+	if (d.size > size)
+		return -ENOSPC;
+
+	return fit_load_data(handle, configuration, image, &d, dest);
+}
+
 static int fit_config_verify_signature(struct fit_handle *handle, struct device_node *conf_node)
 {
 	struct device_node *sig_node;
@@ -788,6 +1044,8 @@ struct fit_handle *fit_open_buf(const void *buf, size_t size, bool verbose,
 	handle = xzalloc(sizeof(struct fit_handle));
 
 	handle->verbose = verbose;
+	handle->fd = -1;
+	INIT_LIST_HEAD(&handle->buffers);
 	handle->fit = buf;
 	handle->size = size;
 	handle->verify = verify;
@@ -810,28 +1068,76 @@ struct fit_handle *fit_open_buf(const void *buf, size_t size, bool verbose,
  * This opens a FIT image found in @filename. The returned handle is used as
  * context for the other FIT functions.
  *
+ * Only the device tree part of the FIT image is read here. Images with
+ * external data are read from the file when they are opened or loaded.
+ * Files that can be memory mapped are used in place without copying.
+ *
  * Return: A handle to a FIT image or a ERR_PTR
  */
 struct fit_handle *fit_open(const char *filename, bool verbose,
 			    enum bootm_verify verify)
 {
 	struct fit_handle *handle;
+	struct fdt_header header;
+	struct stat s;
+	size_t size;
+	void *map;
 	int ret;
 
 	handle = xzalloc(sizeof(struct fit_handle));
 
 	handle->verbose = verbose;
 	handle->verify = verify;
+	INIT_LIST_HEAD(&handle->buffers);
 
-	ret = read_file_2(filename, &handle->size, &handle->fit_alloc,
-			  FILESIZE_MAX);
-	if (ret) {
-		pr_err("unable to read %s: %s\n", filename, strerror(-ret));
-		return ERR_PTR(ret);
+	handle->fd = open(filename, O_RDONLY);
+	if (handle->fd < 0) {
+		ret = -errno;
+		goto err_read;
 	}
 
-	handle->fit = handle->fit_alloc;
+	ret = read_full(handle->fd, &header, sizeof(header));
+	if (ret >= 0 && ret < sizeof(header))
+		ret = -EINVAL;
+	if (ret < 0)
+		goto err_read;
+
+	size = fdt32_to_cpu(header.totalsize);
+	if (fdt32_to_cpu(header.magic) != FDT_MAGIC || size < sizeof(header)) {
+		ret = -EINVAL;
+		goto err_read;
+	}
+
+	/*
+	 * Files which can be mapped (i.e. single extent ramfs files) are used
+	 * in place, including their external data, saving a copy of the
+	 * whole image.
+	 */
+	map = memmap(handle->fd, PROT_READ);
+	if (map != MAP_FAILED && !fstat(handle->fd, &s) && s.st_size >= size) {
+		handle->fit = map;
+		handle->size = s.st_size;
+		goto open;
+	}
+
+	handle->fit_alloc = malloc(size);
+	if (!handle->fit_alloc) {
+		ret = -ENOMEM;
+		goto err_read;
+	}
+
+	memcpy(handle->fit_alloc, &header, sizeof(header));
 
+	ret = read_full(handle->fd, handle->fit_alloc + sizeof(header),
+			size - sizeof(header));
+	if (ret >= 0 && ret < size - sizeof(header))
+		ret = -EINVAL;
+	if (ret < 0)
+		goto err_read;
+
+	handle->fit = handle->fit_alloc;
+	handle->size = size;
+open:
 	ret = fit_do_open(handle);
 	if (ret) {
 		fit_close(handle);
@@ -839,13 +1145,29 @@ struct fit_handle *fit_open(const char *filename, bool verbose,
 	}
 
 	return handle;
+
+err_read:
+	pr_err("unable to read %s: %s\n", filename, strerror(-ret));
+	fit_close(handle);
+
+	return ERR_PTR(ret);
 }
 
 void fit_close(struct fit_handle *handle)
 {
+	struct fit_image_buf *buf, *tmp;
+
 	if (handle->root)
 		of_delete_node(handle->root);
 
+	list_for_each_entry_safe(buf, tmp, &handle->buffers, list) {
+		free(buf->data);
+		free(buf);
+	}
+
+	if (handle->fd >= 0)
+		close(handle->fd);
+
 	free(handle->fit_alloc);
 	free(handle);
 }
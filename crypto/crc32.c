@@ -135,30 +135,78 @@ static const ulong crc_table[256] = {
 
 
 /* ========================================================================= */
-#define DO1(buf) crc = crc_table[((int)crc ^ (*buf++)) & 0xff] ^ (crc >> 8);
-#define DO2(buf)  DO1(buf); DO1(buf);
-#define DO4(buf)  DO2(buf); DO2(buf);
-#define DO8(buf)  DO4(buf); DO4(buf);
+/*
+ * Slice-by-8: crc_table_sliced[k][n] is the CRC of byte n followed by k zero
+ * bytes, so eight input bytes can be folded into the CRC with eight
+ * independent table lookups instead of eight dependent ones. The tables
+ * are derived from crc_table on first use.
+ */
+static uint32_t crc_table_sliced[8][256];
+static int crc_table_sliced_valid;
 
-/* ========================================================================= */
-STATIC uint32_t crc32(uint32_t crc, const void *_buf, unsigned int len)
+static void make_crc_table_sliced(void)
 {
-    const unsigned char *buf = _buf;
+  uint32_t c;
+  int n, k;
 
 #ifdef CONFIG_DYNAMIC_CRC_TABLE
-	if (!crc_table)
-		make_crc_table();
+  if (!crc_table)
+    make_crc_table();
 #endif
-    crc = crc ^ 0xffffffffL;
-    while (len >= 8)
+
+  for (n = 0; n < 256; n++)
+  {
+    c = crc_table[n];
+    crc_table_sliced[0][n] = c;
+    for (k = 1; k < 8; k++)
     {
-      DO8(buf);
-      len -= 8;
+      c = crc_table[c & 0xff] ^ (c >> 8);
+      crc_table_sliced[k][n] = c;
     }
-    if (len) do {
-      DO1(buf);
-    } while (--len);
-    return crc ^ 0xffffffffL;
+  }
+
+  crc_table_sliced_valid = 1;
+}
+
+/* CRC-32 (little endian, reflected) without pre- and post-conditioning */
+static inline uint32_t crc32_le(uint32_t crc, const unsigned char *buf, unsigned int len)
+{
+  const uint32_t (*t)[256] = crc_table_sliced;
+  uint32_t one, two;
+
+#if defined(__BAREBOX__) && defined(CONFIG_CRC32_ARM64)
+  if (crc32_arm64_available())
+    return crc32_le_arm64(crc, buf, len);
+#endif
+
+  if (!crc_table_sliced_valid)
+    make_crc_table_sliced();
+
+  while (len >= 8)
+  {
+    /* byte wise loads keep this independent of endianess and alignment */
+    one = crc ^ (buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t)buf[3] << 24);
+    two = buf[4] | buf[5] << 8 | buf[6] << 16 | (uint32_t)buf[7] << 24;
+
+    crc = t[7][one & 0xff] ^ t[6][(one >> 8) & 0xff] ^
+          t[5][(one >> 16) & 0xff] ^ t[4][one >> 24] ^
+          t[3][two & 0xff] ^ t[2][(two >> 8) & 0xff] ^
+          t[1][(two >> 16) & 0xff] ^ t[0][two >> 24];
+
+    buf += 8;
+    len -= 8;
+  }
+
+  while (len--)
+    crc = t[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+
+  return crc;
+}
+
+/* ========================================================================= */
+STATIC uint32_t crc32(uint32_t crc, const void *_buf, unsigned int len)
+{
+    return crc32_le(crc ^ 0xffffffffL, _buf, len) ^ 0xffffffffL;
 }
 #ifdef __BAREBOX__
 EXPORT_SYMBOL(crc32);
@@ -169,22 +217,7 @@ EXPORT_SYMBOL(crc32);
  */
 STATIC uint32_t crc32_no_comp(uint32_t crc, const void *_buf, unsigned int len)
 {
-   const unsigned char *buf = _buf;
-
-#ifdef CONFIG_DYNAMIC_CRC_TABLE
-	if (!crc_table)
-		make_crc_table();
-#endif
-    while (len >= 8)
-    {
-      DO8(buf);
-      len -= 8;
-    }
-    if (len) do {
-      DO1(buf);
-    } while (--len);
-
-    return crc;
+    return crc32_le(crc, _buf, len);
 }
 
 STATIC uint32_t crc32_be(uint32_t crc, const void *_buf, unsigned int len)
@@ -199,6 +232,9 @@ STATIC uint32_t crc32_be(uint32_t crc, const void *_buf, unsigned int len)
 	return crc;
 }
 
+/* big enough for the block layer to do multi block reads */
+#define FILE_CRC_BUF_SIZE	(64 * 1024)
+
 STATIC int file_crc(char *filename, ulong start, ulong size, ulong *crc,
 		    ulong *total)
 {
@@ -226,10 +262,10 @@ STATIC int file_crc(char *filename, ulong start, ulong size, ulong *crc,
 		}
 	}
 
-	buf = xmalloc(4096);
+	buf = xmalloc(FILE_CRC_BUF_SIZE);
 
 	while (size) {
-		now = min((ulong)4096, size);
+		now = min((ulong)FILE_CRC_BUF_SIZE, size);
 		now = read(fd, buf, now);
 		if (now < 0) {
 			ret = now;
@@ -24,6 +24,8 @@
 #include <linux/err.h>
 #include <crypto.h>
 #include <crypto/internal.h>
+#include <clock.h>
+#include <linux/math64.h>
 
 static LIST_HEAD(digests);
 
@@ -159,6 +161,85 @@ void digest_algo_prints(const char *prefix)
 	}
 }
 
+/**
+ * digest_algo_bench - measure the throughput of the registered digests
+ * @name:	only benchmark drivers for this algorithm, all if NULL
+ * @size:	number of bytes to hash per driver
+ *
+ * Unlike digest_alloc() this runs every registered driver, not only the
+ * one with the highest priority, so that the generic and the optimized
+ * implementations of an algorithm can be compared against each other.
+ * Algorithms which need a key are skipped.
+ */
+int digest_algo_bench(const char *name, unsigned long size)
+{
+	struct digest_algo *algo;
+	struct digest d = {};
+	unsigned char *hash;
+	void *buf;
+	int ret = 0;
+
+	buf = malloc(size);
+	if (!buf)
+		return -ENOMEM;
+
+	memset(buf, 0x5a, size);
+
+	printf("%-15s\t%-20s\t%-8s\t%s\n", "name", "driver", "priority",
+	       "throughput");
+	printf("--------------------------------------------------------------\n");
+
+	list_for_each_entry(algo, &digests, list) {
+		uint64_t start, ns;
+
+		if (name && strcmp(algo->base.name, name))
+			continue;
+
+		if (algo->base.flags & DIGEST_ALGO_NEED_KEY)
+			continue;
+
+		d.algo = algo;
+		d.ctx = xzalloc(algo->ctx_length);
+		ret = algo->alloc(&d);
+		if (ret) {
+			free(d.ctx);
+			break;
+		}
+
+		hash = xzalloc(algo->length);
+
+		start = get_time_ns();
+
+		ret = digest_init(&d);
+		if (!ret)
+			ret = digest_update(&d, buf, size);
+		if (!ret)
+			ret = digest_final(&d, hash);
+
+		ns = get_time_ns() - start;
+
+		algo->free(&d);
+		free(d.ctx);
+		free(hash);
+
+		if (ret)
+			break;
+
+		printf("%-15s\t%-20s\t%-8d\t", algo->base.name,
+		       algo->base.driver_name, algo->base.priority);
+		if (ns)
+			printf("%s/s\n", size_human_readable(
+				div64_u64((uint64_t)size * SECOND, ns)));
+		else
+			printf("-\n");
+	}
+
+	free(buf);
+
+	return ret;
+}
+EXPORT_SYMBOL(digest_algo_bench);
+
 struct digest *digest_alloc(const char *name)
 {
 	struct digest *d;
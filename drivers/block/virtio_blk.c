@@ -8,32 +8,46 @@
 #include <driver.h>
 #include <block.h>
 #include <disks.h>
+#include <dma.h>
 #include <linux/virtio_types.h>
 #include <linux/virtio.h>
 #include <linux/virtio_ring.h>
 #include <uapi/linux/virtio_blk.h>
 
+/* maximum number of requests in flight */
+#define VIRTIO_BLK_MAX_REQS	32
+
+/* per request header and status, they must stay valid until completion */
+struct virtio_blk_req {
+	struct virtio_blk_outhdr out_hdr;
+	u8 status;
+};
+
 struct virtio_blk_priv {
 	struct virtqueue *vq;
 	struct virtio_device *vdev;
 	struct block_device blk;
+	struct virtio_blk_req *reqs;
+	blkcnt_t max_req_blocks;
 };
 
-static int virtio_blk_do_req(struct virtio_blk_priv *priv, void *buffer,
-			     sector_t sector, blkcnt_t blkcnt, u32 type)
+/*
+ * Queue a single request without waiting for it
+ */
+static int virtio_blk_queue_req(struct virtio_blk_priv *priv,
+				struct virtio_blk_req *req, void *buffer,
+				sector_t sector, blkcnt_t blkcnt, u32 type)
 {
 	unsigned int num_out = 0, num_in = 0;
 	struct virtio_sg *sgs[3];
-	u8 status;
-	int ret;
-
-	struct virtio_blk_outhdr out_hdr = {
-		.type = cpu_to_virtio32(priv->vdev, type),
-		.sector = cpu_to_virtio64(priv->vdev, sector),
-	};
-	struct virtio_sg hdr_sg = { &out_hdr, sizeof(out_hdr) };
+	struct virtio_sg hdr_sg = { &req->out_hdr, sizeof(req->out_hdr) };
 	struct virtio_sg data_sg = { buffer, blkcnt * 512 };
-	struct virtio_sg status_sg = { &status, sizeof(status) };
+	struct virtio_sg status_sg = { &req->status, sizeof(req->status) };
+
+	req->out_hdr.type = cpu_to_virtio32(priv->vdev, type);
+	req->out_hdr.ioprio = 0;
+	req->out_hdr.sector = cpu_to_virtio64(priv->vdev, sector);
+	req->status = VIRTIO_BLK_S_IOERR;
 
 	sgs[num_out++] = &hdr_sg;
 
@@ -48,16 +62,52 @@ static int virtio_blk_do_req(struct virtio_blk_priv *priv, void *buffer,
 
 	sgs[num_out + num_in++] = &status_sg;
 
-	ret = virtqueue_add(priv->vq, sgs, num_out, num_in);
-	if (ret)
-		return ret;
+	return virtqueue_add(priv->vq, sgs, num_out, num_in);
+}
 
-	virtqueue_kick(priv->vq);
+/*
+ * Split a transfer into requests of at most max_req_blocks and post as
+ * many of them as the ring can take before kicking the device once. The
+ * completions are then reaped in one go. Unless the device limits the
+ * request size, a transfer is posted as a single request.
+ */
+static int virtio_blk_do_req(struct virtio_blk_priv *priv, void *buffer,
+			     sector_t sector, blkcnt_t blkcnt, u32 type)
+{
+	int i, num, ret = 0;
 
-	while (!virtqueue_get_buf(priv->vq, NULL))
-		;
+	while (blkcnt) {
+		for (num = 0; num < VIRTIO_BLK_MAX_REQS && blkcnt; num++) {
+			blkcnt_t now = min(blkcnt, priv->max_req_blocks);
 
-	return status == VIRTIO_BLK_S_OK ? 0 : -EIO;
+			if (virtio_blk_queue_req(priv, &priv->reqs[num], buffer,
+						 sector, now, type))
+				break;
+
+			buffer += now * 512;
+			sector += now;
+			blkcnt -= now;
+		}
+
+		/* not even a single request fits into an idle ring */
+		if (!num)
+			return -ENOSPC;
+
+		virtqueue_kick(priv->vq);
+
+		for (i = 0; i < num; i++)
+			while (!virtqueue_get_buf(priv->vq, NULL))
+				;
+
+		for (i = 0; i < num; i++)
+			if (priv->reqs[i].status != VIRTIO_BLK_S_OK)
+				ret = -EIO;
+
+		if (ret)
+			return ret;
+	}
+
+	return 0;
 }
 
 static int virtio_blk_read(struct block_device *blk, void *buffer,
@@ -85,6 +135,7 @@ static int virtio_blk_probe(struct virtio_device *vdev)
 {
 	struct virtio_blk_priv *priv;
 	u64 cap;
+	u32 size_max;
 	int devnum;
 	int ret;
 
@@ -92,7 +143,19 @@ static int virtio_blk_probe(struct virtio_device *vdev)
 
 	ret = virtio_find_vqs(vdev, 1, &priv->vq);
 	if (ret)
-		return ret;
+		goto err_free;
+
+	priv->reqs = dma_alloc(sizeof(*priv->reqs) * VIRTIO_BLK_MAX_REQS);
+	if (!priv->reqs) {
+		ret = -ENOMEM;
+		goto err_del_vqs;
+	}
+
+	/* the length of a descriptor is 32 bit */
+	priv->max_req_blocks = U32_MAX / 512;
+	if (!virtio_cread_feature(vdev, VIRTIO_BLK_F_SIZE_MAX,
+				  struct virtio_blk_config, size_max, &size_max))
+		priv->max_req_blocks = max_t(blkcnt_t, size_max / 512, 1);
 
 	priv->vdev = vdev;
 	vdev->priv = priv;
@@ -107,11 +170,21 @@ static int virtio_blk_probe(struct virtio_device *vdev)
 
 	ret = blockdevice_register(&priv->blk);
 	if (ret)
-		return ret;
+		goto err_free_name;
 
 	parse_partition_table(&priv->blk);
 
 	return 0;
+
+err_free_name:
+	free(priv->blk.cdev.name);
+	dma_free(priv->reqs);
+err_del_vqs:
+	vdev->config->del_vqs(vdev);
+err_free:
+	free(priv);
+
+	return ret;
 }
 
 static void virtio_blk_remove(struct virtio_device *vdev)
@@ -122,9 +195,14 @@ static void virtio_blk_remove(struct virtio_device *vdev)
 	blockdevice_unregister(&priv->blk);
 	vdev->config->del_vqs(vdev);
 
+	dma_free(priv->reqs);
 	free(priv);
 }
 
+static const unsigned int features[] = {
+	VIRTIO_BLK_F_SIZE_MAX,
+};
+
 static const struct virtio_device_id id_table[] = {
         { VIRTIO_ID_BLOCK, VIRTIO_DEV_ANY_ID },
         { 0 },
@@ -135,5 +213,9 @@ static struct virtio_driver virtio_blk = {
         .id_table	= id_table,
         .probe		= virtio_blk_probe,
 	.remove		= virtio_blk_remove,
+	.feature_table			= features,
+	.feature_table_size		= ARRAY_SIZE(features),
+	.feature_table_legacy		= features,
+	.feature_table_size_legacy	= ARRAY_SIZE(features),
 };
 device_virtio_driver(virtio_blk);
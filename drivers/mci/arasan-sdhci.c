@@ -173,6 +173,7 @@ static int arasan_sdhci_send_cmd(struct mci_host *mci, struct mci_cmd *cmd,
 {
 	struct arasan_sdhci_host *host = to_arasan_sdhci_host(mci);
 	u32 mask, command, xfer;
+	dma_addr_t dma = SDHCI_NO_DMA;
 	int ret;
 
 	/* Wait for idle before next command */
@@ -190,22 +191,22 @@ static int arasan_sdhci_send_cmd(struct mci_host *mci, struct mci_cmd *cmd,
 
 	sdhci_write32(&host->sdhci, SDHCI_INT_STATUS, ~0);
 
+	/* Use ADMA2 when available, PIO otherwise */
+	sdhci_setup_data_dma(&host->sdhci, data,
+			     host->sdhci.flags & SDHCI_USE_ADMA ? &dma : NULL);
+
 	mask = SDHCI_INT_CMD_COMPLETE;
-	if (data && data->flags == MMC_DATA_READ)
+	if (data && data->flags == MMC_DATA_READ && dma == SDHCI_NO_DMA)
 		mask |= SDHCI_INT_DATA_AVAIL;
 	if (cmd->resp_type & MMC_RSP_BUSY)
 		mask |= SDHCI_INT_XFER_COMPLETE;
 
-	sdhci_set_cmd_xfer_mode(&host->sdhci,
-				cmd, data, false, &command, &xfer);
+	sdhci_set_cmd_xfer_mode(&host->sdhci, cmd, data,
+				dma != SDHCI_NO_DMA, &command, &xfer);
 
 	sdhci_write8(&host->sdhci, SDHCI_TIMEOUT_CONTROL, TIMEOUT_VAL);
-	if (data) {
+	if (data)
 		sdhci_write16(&host->sdhci, SDHCI_TRANSFER_MODE, xfer);
-		sdhci_write16(&host->sdhci, SDHCI_BLOCK_SIZE,
-			      SDHCI_DMA_BOUNDARY_512K | SDHCI_TRANSFER_BLOCK_SIZE(data->blocksize));
-		sdhci_write16(&host->sdhci, SDHCI_BLOCK_COUNT, data->blocks);
-	}
 	sdhci_write32(&host->sdhci, SDHCI_ARGUMENT, cmd->cmdarg);
 	sdhci_write16(&host->sdhci, SDHCI_COMMAND, command);
 
@@ -219,7 +220,7 @@ static int arasan_sdhci_send_cmd(struct mci_host *mci, struct mci_cmd *cmd,
 	sdhci_write32(&host->sdhci, SDHCI_INT_STATUS, mask);
 
 	if (data)
-		ret = sdhci_transfer_data_pio(&host->sdhci, data);
+		ret = sdhci_transfer_data(&host->sdhci, data, dma);
 
 error:
 	if (ret) {
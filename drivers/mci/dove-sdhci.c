@@ -61,7 +61,7 @@ static int dove_sdhci_mci_send_cmd(struct mci_host *mci, struct mci_cmd *cmd,
 	u32 command, xfer;
 	u64 start;
 	int ret;
-	unsigned int num_bytes = 0;
+	dma_addr_t dma = SDHCI_NO_DMA;
 	struct dove_sdhci *host = priv_from_mci_host(mci);
 
 	sdhci_write32(&host->sdhci, SDHCI_INT_STATUS, ~0);
@@ -85,27 +85,13 @@ static int dove_sdhci_mci_send_cmd(struct mci_host *mci, struct mci_cmd *cmd,
 
 	/* setup transfer data */
 	if (data) {
-		num_bytes = data->blocks * data->blocksize;
-		if (data->flags & MMC_DATA_READ)
-			sdhci_write32(&host->sdhci, SDHCI_DMA_ADDRESS, (u32)data->dest);
-		else
-			sdhci_write32(&host->sdhci, SDHCI_DMA_ADDRESS, (u32)data->src);
-		sdhci_write16(&host->sdhci, SDHCI_BLOCK_SIZE, SDHCI_DMA_BOUNDARY_512K |
-				SDHCI_TRANSFER_BLOCK_SIZE(data->blocksize));
-		sdhci_write16(&host->sdhci, SDHCI_BLOCK_COUNT, data->blocks);
 		sdhci_write8(&host->sdhci, SDHCI_TIMEOUT_CONTROL, 0xe);
-
-
-		if (data->flags & MMC_DATA_WRITE)
-			dma_sync_single_for_device((unsigned long)data->src,
-						    num_bytes, DMA_TO_DEVICE);
-		else
-			dma_sync_single_for_device((unsigned long)data->dest,
-						    num_bytes, DMA_FROM_DEVICE);
+		sdhci_setup_data_dma(&host->sdhci, data, &dma);
 	}
 
 	/* setup transfer mode */
-	sdhci_set_cmd_xfer_mode(&host->sdhci, cmd, data, true, &command, &xfer);
+	sdhci_set_cmd_xfer_mode(&host->sdhci, cmd, data, dma != SDHCI_NO_DMA,
+				&command, &xfer);
 
 	sdhci_write16(&host->sdhci, SDHCI_TRANSFER_MODE, xfer);
 	sdhci_write32(&host->sdhci, SDHCI_ARGUMENT, cmd->cmdarg);
@@ -124,25 +110,15 @@ static int dove_sdhci_mci_send_cmd(struct mci_host *mci, struct mci_cmd *cmd,
 
 	sdhci_read_response(&host->sdhci, cmd);
 
-	if (data) {
-		if (data->flags & MMC_DATA_WRITE)
-			dma_sync_single_for_cpu((unsigned long)data->src,
-						num_bytes, DMA_TO_DEVICE);
-		else
-			dma_sync_single_for_cpu((unsigned long)data->dest,
-					 num_bytes, DMA_FROM_DEVICE);
-
-		ret = dove_sdhci_wait_for_done(host, SDHCI_INT_XFER_COMPLETE);
-		if (ret) {
-			dev_err(host->mci.hw_dev, "error while transfering data for command %d\n",
-				cmd->cmdidx);
-			dev_err(host->mci.hw_dev, "state = %04x %04x, interrupt = %04x %04x\n",
-				sdhci_read16(&host->sdhci, SDHCI_PRESENT_STATE),
-				sdhci_read16(&host->sdhci, SDHCI_PRESENT_STATE1),
-				sdhci_read16(&host->sdhci, SDHCI_INT_NORMAL_STATUS),
-				sdhci_read16(&host->sdhci, SDHCI_INT_ERROR_STATUS));
-			goto cmd_error;
-		}
+	ret = sdhci_transfer_data(&host->sdhci, data, dma);
+	if (ret) {
+		dev_err(host->mci.hw_dev, "error while transfering data for command %d\n",
+			cmd->cmdidx);
+		dev_err(host->mci.hw_dev, "state = %04x %04x, interrupt = %04x %04x\n",
+			sdhci_read16(&host->sdhci, SDHCI_PRESENT_STATE),
+			sdhci_read16(&host->sdhci, SDHCI_PRESENT_STATE1),
+			sdhci_read16(&host->sdhci, SDHCI_INT_NORMAL_STATUS),
+			sdhci_read16(&host->sdhci, SDHCI_INT_ERROR_STATUS));
 	}
 
 cmd_error:
@@ -278,7 +254,7 @@ static int dove_sdhci_probe(struct device_d *dev)
 
 	host = xzalloc(sizeof(*host));
 	host->sdhci.base = dev_request_mem_region(dev, 0);
-	host->mci.max_req_size = 0x8000;
+	host->sdhci.mci = &host->mci;
 	host->mci.hw_dev = dev;
 	host->mci.send_cmd = dove_sdhci_mci_send_cmd;
 	host->mci.set_ios = dove_sdhci_mci_set_ios;
@@ -288,9 +264,22 @@ static int dove_sdhci_probe(struct device_d *dev)
 
 	dove_sdhci_set_mci_caps(host);
 
+	ret = sdhci_setup_host(&host->sdhci);
+	if (ret)
+		goto err_free;
+
+	/* Without ADMA2 keep the request size limit used for SDMA so far */
+	if (!(host->sdhci.flags & SDHCI_USE_ADMA))
+		host->mci.max_req_size = 0x8000;
+
 	ret = mci_register(&host->mci);
 	if (ret)
-		free(host);
+		goto err_free;
+
+	return 0;
+
+err_free:
+	free(host);
 	return ret;
 }
 
@@ -122,7 +122,8 @@ static int dwmci_prepare_data_dma(struct dwmci_host *host,
 
 	blk_cnt = data->blocks;
 
-	if (blk_cnt > DW_MMC_NUM_IDMACS)
+	/* each descriptor covers 8 blocks */
+	if (blk_cnt > DW_MMC_NUM_IDMACS * 8)
 		return -EINVAL;
 
 	dwmci_wait_reset(host, DWMCI_CTRL_FIFO_RESET);
@@ -149,7 +150,7 @@ static int dwmci_prepare_data_dma(struct dwmci_host *host,
 
 		dev_dbg(host->mci.hw_dev, "desc@ 0x%p 0x%08x 0x%08x 0x%08x 0x%08x\n",
 				desc, flags, cnt, desc->addr, desc->next_addr);
-		if (blk_cnt < 8)
+		if (blk_cnt <= 8)
 			break;
 
 		blk_cnt -= 8;
@@ -597,7 +598,9 @@ static int dw_mmc_probe(struct device_d *dev)
 	host->mci.voltages = MMC_VDD_32_33 | MMC_VDD_33_34;
 	host->mci.host_caps = MMC_CAP_4_BIT_DATA | MMC_CAP_8_BIT_DATA;
 	host->mci.host_caps |= MMC_CAP_MMC_HIGHSPEED | MMC_CAP_MMC_HIGHSPEED_52MHZ |
-			       MMC_CAP_SD_HIGHSPEED;
+			       MMC_CAP_SD_HIGHSPEED | MMC_CAP_CMD23;
+	/* each IDMAC descriptor covers one page */
+	host->mci.max_req_size = DW_MMC_NUM_IDMACS * PAGE_SIZE;
 
 	if (pdata) {
 		host->ciu_div = pdata->ciu_div;
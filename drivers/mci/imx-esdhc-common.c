@@ -38,6 +38,36 @@ static void esdhc_op_write16_be(struct sdhci *sdhci, int reg, u16 val)
 	out_be16(host->sdhci.base + reg, val);
 }
 
+/*
+ * Translate between the vendor specific DMA error bit and the standard
+ * SDHCI_INT_ADMA_ERROR, so that the SDHCI core sees ADMA errors.
+ */
+static u32 esdhc_op_read32_le(struct sdhci *sdhci, int reg)
+{
+	struct fsl_esdhc_host *host = sdhci_to_esdhc(sdhci);
+	u32 val = readl(host->sdhci.base + reg);
+
+	if (reg == SDHCI_INT_STATUS && (val & ESDHC_INT_DMA_ERROR)) {
+		val &= ~ESDHC_INT_DMA_ERROR;
+		val |= SDHCI_INT_ADMA_ERROR;
+	}
+
+	return val;
+}
+
+static void esdhc_op_write32_le(struct sdhci *sdhci, int reg, u32 val)
+{
+	struct fsl_esdhc_host *host = sdhci_to_esdhc(sdhci);
+
+	if ((reg == SDHCI_INT_STATUS || reg == SDHCI_INT_ENABLE ||
+	     reg == SDHCI_SIGNAL_ENABLE) && (val & SDHCI_INT_ADMA_ERROR)) {
+		val &= ~SDHCI_INT_ADMA_ERROR;
+		val |= ESDHC_INT_DMA_ERROR;
+	}
+
+	writel(val, host->sdhci.base + reg);
+}
+
 void esdhc_populate_sdhci(struct fsl_esdhc_host *host)
 {
 	if (host->socdata->flags & ESDHC_FLAG_BIGENDIAN) {
@@ -45,6 +75,9 @@ void esdhc_populate_sdhci(struct fsl_esdhc_host *host)
 		host->sdhci.write16 = esdhc_op_write16_be;
 		host->sdhci.read32 = esdhc_op_read32_be;
 		host->sdhci.write32 = esdhc_op_write32_be;
+	} else if (!IN_PBL) {
+		host->sdhci.read32 = esdhc_op_read32_le;
+		host->sdhci.write32 = esdhc_op_write32_le;
 	}
 }
 
@@ -103,6 +103,37 @@ static void set_sysctl(struct mci_host *mci, u32 clock)
 		   10 * MSECOND);
 }
 
+/* The eSDHC has the DMA select bits at a different place in PROCTL */
+static void esdhc_set_dma_mode(struct sdhci *sdhci, u8 mode)
+{
+	struct fsl_esdhc_host *host = sdhci_to_esdhc(sdhci);
+	u32 dmasel;
+
+	if (mode == SDHCI_CTRL_ADMA32)
+		dmasel = PROCTL_DMASEL_ADMA2;
+	else
+		dmasel = PROCTL_DMASEL_SDMA;
+
+	esdhc_clrsetbits32(host, SDHCI_HOST_CONTROL__POWER_CONTROL__BLOCK_GAP_CONTROL,
+			   PROCTL_DMASEL, FIELD_PREP(PROCTL_DMASEL, dmasel));
+}
+
+/*
+ * The uSDHC reports ADMA2 support in the bit the SDHCI spec defines for ADMA1,
+ * move it to where the core looks for it.
+ */
+static void esdhc_read_caps(struct fsl_esdhc_host *host)
+{
+	struct sdhci *sdhci = &host->sdhci;
+
+	sdhci_read_caps(sdhci);
+
+	if (esdhc_is_usdhc(host) && (sdhci->caps & SDHCI_CAN_DO_ADMA1)) {
+		sdhci->caps &= ~SDHCI_CAN_DO_ADMA1;
+		sdhci->caps |= SDHCI_CAN_DO_ADMA2;
+	}
+}
+
 static void esdhc_set_ios(struct mci_host *mci, struct mci_ios *ios)
 {
 	struct fsl_esdhc_host *host = to_fsl_esdhc(mci);
@@ -212,7 +243,8 @@ static int esdhc_init(struct mci_host *mci, struct device_d *dev)
 			SDHCI_INT_XFER_COMPLETE | SDHCI_INT_CARD_INT |
 			SDHCI_INT_TIMEOUT | SDHCI_INT_CRC | SDHCI_INT_END_BIT |
 			SDHCI_INT_INDEX | SDHCI_INT_DATA_TIMEOUT |
-			SDHCI_INT_DATA_CRC | SDHCI_INT_DATA_END_BIT | SDHCI_INT_DMA);
+			SDHCI_INT_DATA_CRC | SDHCI_INT_DATA_END_BIT | SDHCI_INT_DMA |
+			SDHCI_INT_ADMA_ERROR);
 
 	/* Put the PROCTL reg back to the default */
 	sdhci_write32(&host->sdhci, SDHCI_HOST_CONTROL__POWER_CONTROL__BLOCK_GAP_CONTROL,
@@ -280,11 +312,20 @@ static int fsl_esdhc_probe(struct device_d *dev)
 	host->mci.card_present = esdhc_card_present;
 	host->mci.hw_dev = dev;
 	host->sdhci.mci = &host->mci;
+	host->sdhci.set_dma_mode = esdhc_set_dma_mode;
+	/* DMA is limited to 32 bit, see dma_set_mask() above */
+	host->sdhci.quirks2 |= SDHCI_QUIRK2_BROKEN_64_BIT_DMA;
+
+	esdhc_read_caps(host);
 
 	ret = sdhci_setup_host(&host->sdhci);
 	if (ret)
 		goto err_clk_disable;
 
+	/* these need STOP_TRANSMISSION to finish a multi block transfer */
+	if (host->socdata->flags & ESDHC_FLAG_MULTIBLK_NO_INT)
+		mci->host_caps &= ~MMC_CAP_CMD23;
+
 	rate = clk_get_rate(host->clk);
 	host->mci.f_min = rate >> 12;
 	if (host->mci.f_min < 200000)
@@ -22,10 +22,16 @@
 
 #define CMD_ERR		(SDHCI_INT_INDEX | SDHCI_INT_END_BIT | SDHCI_INT_CRC)
 #define DATA_ERR	(SDHCI_INT_DATA_END_BIT | SDHCI_INT_DATA_CRC | SDHCI_INT_DATA_TIMEOUT)
+/* the eSDHC reports ADMA errors here instead of SDHCI_INT_ADMA_ERROR */
+#define ESDHC_INT_DMA_ERROR	BIT(28)
 
 #define PROCTL_INIT		0x00000020
 #define PROCTL_DTW_4		0x00000002
 #define PROCTL_DTW_8		0x00000004
+#define PROCTL_DMASEL		GENMASK(9, 8)
+#define  PROCTL_DMASEL_SDMA	0
+#define  PROCTL_DMASEL_ADMA1	1
+#define  PROCTL_DMASEL_ADMA2	2
 
 #define WML_WRITE	0x00010000
 #define WML_RD_WML_MASK	0xff
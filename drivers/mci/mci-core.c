@@ -22,6 +22,7 @@
 #include <linux/err.h>
 #include <linux/sizes.h>
 #include <dma.h>
+#include <clock.h>
 
 #define MAX_BUFFER_NUMBER 0xffffffff
 
@@ -119,6 +120,27 @@ static int mci_set_blocklen(struct mci *mci, unsigned len)
 
 static void *sector_buf;
 
+/**
+ * Announce the length of the following multi block transfer (CMD23)
+ * @param mci MCI instance
+ * @param blocks Block count of the transfer
+ * @param reliable Request a reliable write
+ * @return Transaction status (0 on success)
+ *
+ * A pre-defined transfer ends by itself, so no STOP_TRANSMISSION is needed
+ * afterwards.
+ */
+static int mci_set_block_count(struct mci *mci, unsigned blocks, bool reliable)
+{
+	struct mci_cmd cmd;
+
+	mci_setup_cmd(&cmd, MMC_CMD_SET_BLOCK_COUNT,
+		      blocks | (reliable ? MMC_CMD23_ARG_REL_WR : 0),
+		      MMC_RSP_R1);
+
+	return mci_send_cmd(mci, &cmd, NULL);
+}
+
 /**
  * Write one or several blocks of data to the card
  * @param mci_dev MCI instance
@@ -134,13 +156,21 @@ static int mci_block_write(struct mci *mci, const void *src, int blocknum,
 	struct mci_data data;
 	const void *buf;
 	unsigned mmccmd;
+	bool reliable = mci->reliable_write;
 	int ret;
 
-	if (blocks > 1)
+	/* reliable writes are always pre-defined multi block writes */
+	if (blocks > 1 || reliable)
 		mmccmd = MMC_CMD_WRITE_MULTIPLE_BLOCK;
 	else
 		mmccmd = MMC_CMD_WRITE_SINGLE_BLOCK;
 
+	if (mci->cmd23 && mmccmd == MMC_CMD_WRITE_MULTIPLE_BLOCK) {
+		ret = mci_set_block_count(mci, blocks, reliable);
+		if (ret)
+			return ret;
+	}
+
 	if ((unsigned long)src & 0x3) {
 		memcpy(sector_buf, src, SECTOR_SIZE);
 		buf = sector_buf;
@@ -160,10 +190,10 @@ static int mci_block_write(struct mci *mci, const void *src, int blocknum,
 
 	ret = mci_send_cmd(mci, &cmd, &data);
 
-	if (ret || blocks > 1) {
+	if (ret || (blocks > 1 && !mci->cmd23)) {
 		mci_setup_cmd(&cmd, MMC_CMD_STOP_TRANSMISSION, 0, MMC_RSP_R1b);
 		mci_send_cmd(mci, &cmd, NULL);
-        }
+	}
 
 	return ret;
 }
@@ -188,6 +218,12 @@ static int mci_read_block(struct mci *mci, void *dst, int blocknum,
 	else
 		mmccmd = MMC_CMD_READ_SINGLE_BLOCK;
 
+	if (mci->cmd23 && blocks > 1) {
+		ret = mci_set_block_count(mci, blocks, false);
+		if (ret)
+			return ret;
+	}
+
 	mci_setup_cmd(&cmd,
 		mmccmd,
 		mci->high_capacity != 0 ? blocknum : blocknum * mci->read_bl_len,
@@ -200,7 +236,7 @@ static int mci_read_block(struct mci *mci, void *dst, int blocknum,
 
 	ret = mci_send_cmd(mci, &cmd, &data);
 
-	if (ret || blocks > 1) {
+	if (ret || (blocks > 1 && !mci->cmd23)) {
 		mci_setup_cmd(&cmd, MMC_CMD_STOP_TRANSMISSION, 0, MMC_RSP_R1b);
 		mci_send_cmd(mci, &cmd, NULL);
 	}
@@ -505,7 +541,7 @@ static __maybe_unused void mmc_extract_gpp_partitions(struct mci *mci)
  */
 static int mmc_change_freq(struct mci *mci)
 {
-	char cardtype;
+	u8 cardtype;
 	int err;
 
 	mci->ext_csd = xmalloc(512);
@@ -552,6 +588,15 @@ static int mmc_change_freq(struct mci *mci)
 	else
 		mci->card_caps |= MMC_CAP_MMC_HIGHSPEED;
 
+	if (cardtype & EXT_CSD_CARD_TYPE_SDR_1_8V)
+		mci->card_caps |= MMC_CAP_MMC_HS200_1_8V;
+
+	if (cardtype & EXT_CSD_CARD_TYPE_HS400_1_8V) {
+		mci->card_caps |= MMC_CAP_MMC_HS400_1_8V;
+		if (mci->ext_csd[EXT_CSD_STROBE_SUPPORT])
+			mci->card_caps |= MMC_CAP_MMC_HS400_ES;
+	}
+
 	if (IS_ENABLED(CONFIG_MCI_MMC_BOOT_PARTITIONS) &&
 			mci->ext_csd[EXT_CSD_REV] >= 3 && mci->ext_csd[EXT_CSD_BOOT_SIZE_MULT]) {
 		int idx;
@@ -730,6 +775,7 @@ static void mci_set_ios(struct mci *mci)
 		.bus_width = host->bus_width,
 		.clock = host->clock,
 		.timing = host->timing,
+		.enhanced_strobe = host->enhanced_strobe,
 	};
 
 	host->set_ios(host, &ios);
@@ -1063,6 +1109,184 @@ static int mci_startup_sd(struct mci *mci)
 	return 0;
 }
 
+/**
+ * Check the card really entered the requested timing
+ * @param mci MCI instance
+ * @param timing Expected EXT_CSD_TIMING_* value
+ * @return 0 on success, negative value else
+ *
+ * Reading the EXT_CSD also proves the data lines work in the new mode.
+ */
+static int mmc_verify_timing(struct mci *mci, unsigned timing)
+{
+	int err;
+
+	err = mci_send_ext_csd(mci, mci->ext_csd);
+	if (err)
+		return err;
+
+	if ((mci->ext_csd[EXT_CSD_HS_TIMING] & 0xf) != timing)
+		return -EIO;
+
+	return 0;
+}
+
+static int mmc_select_hs200(struct mci *mci)
+{
+	struct mci_host *host = mci->host;
+	int err;
+
+	err = mci_switch(mci, EXT_CSD_HS_TIMING, EXT_CSD_TIMING_HS200);
+	if (err)
+		return err;
+
+	host->timing = MMC_TIMING_MMC_HS200;
+	mci_set_clock(mci, MMC_HS200_MAX_DTR);
+
+	err = host->execute_tuning(host, MMC_CMD_SEND_TUNING_BLOCK_HS200);
+	if (err)
+		dev_dbg(&mci->dev, "HS200 tuning failed: %d\n", err);
+
+	return err;
+}
+
+/*
+ * HS400 can only be entered from high speed mode, so after tuning in HS200
+ * we have to go back to HS before switching to DDR. The host keeps the
+ * sampling point found during tuning.
+ */
+static int mmc_select_hs400(struct mci *mci)
+{
+	struct mci_host *host = mci->host;
+	int err;
+
+	err = mmc_select_hs200(mci);
+	if (err)
+		return err;
+
+	host->timing = MMC_TIMING_MMC_HS;
+	mci_set_clock(mci, mci->tran_speed);
+
+	err = mci_switch(mci, EXT_CSD_HS_TIMING, EXT_CSD_TIMING_HS);
+	if (err)
+		return err;
+
+	err = mci_switch(mci, EXT_CSD_BUS_WIDTH, EXT_CSD_DDR_BUS_WIDTH_8);
+	if (err)
+		return err;
+
+	err = mci_switch(mci, EXT_CSD_HS_TIMING, EXT_CSD_TIMING_HS400);
+	if (err)
+		return err;
+
+	host->timing = MMC_TIMING_MMC_HS400;
+	mci_set_clock(mci, MMC_HS200_MAX_DTR);
+
+	return 0;
+}
+
+/*
+ * With enhanced strobe the card provides a strobe for the data and the
+ * command response, so no tuning is needed and we can go straight from
+ * high speed mode to HS400.
+ */
+static int mmc_select_hs400es(struct mci *mci)
+{
+	struct mci_host *host = mci->host;
+	int err;
+
+	err = mci_switch(mci, EXT_CSD_BUS_WIDTH,
+			 EXT_CSD_DDR_BUS_WIDTH_8 | EXT_CSD_BUS_WIDTH_STROBE);
+	if (err)
+		return err;
+
+	err = mci_switch(mci, EXT_CSD_HS_TIMING, EXT_CSD_TIMING_HS400);
+	if (err)
+		return err;
+
+	host->timing = MMC_TIMING_MMC_HS400;
+	host->enhanced_strobe = true;
+	mci_set_clock(mci, MMC_HS200_MAX_DTR);
+
+	return 0;
+}
+
+/*
+ * Bring a card which failed to enter HS200/HS400 back into high speed
+ * mode. The switch commands are sent at identification speed, which every
+ * timing mode can cope with without tuning.
+ */
+static int mmc_select_hs(struct mci *mci, unsigned ext_csd_bus_width)
+{
+	struct mci_host *host = mci->host;
+	int err;
+
+	host->timing = MMC_TIMING_MMC_HS;
+	host->enhanced_strobe = false;
+	mci_set_clock(mci, 400000);
+
+	err = mci_switch(mci, EXT_CSD_HS_TIMING, EXT_CSD_TIMING_HS);
+	if (err)
+		return err;
+
+	err = mci_switch(mci, EXT_CSD_BUS_WIDTH, ext_csd_bus_width);
+	if (err)
+		return err;
+
+	mci_set_clock(mci, mci->tran_speed);
+
+	return mmc_verify_timing(mci, EXT_CSD_TIMING_HS);
+}
+
+/**
+ * Switch an eMMC into the fastest bus mode both sides support
+ * @param mci MCI instance
+ * @param ext_csd_bus_width The EXT_CSD_BUS_WIDTH_* value currently in use
+ * @return 0 on success, negative value else
+ *
+ * HS200 and HS400 use 1.8V I/O, so the host only announces them (usually
+ * from the device tree) when the signalling voltage is fixed to 1.8V.
+ * Both except HS400 with enhanced strobe also need a tuning capable host.
+ * If switching fails, the card is put back into high speed mode.
+ */
+static int mmc_select_timing(struct mci *mci, unsigned ext_csd_bus_width)
+{
+	struct mci_host *host = mci->host;
+	unsigned caps = mci_caps(mci);
+	bool bus_8bit = host->bus_width == MMC_BUS_WIDTH_8;
+	const char *mode;
+	unsigned timing;
+	int err;
+
+	if (bus_8bit && (caps & MMC_CAP_MMC_HS400_ES)) {
+		mode = "HS400ES";
+		timing = EXT_CSD_TIMING_HS400;
+		err = mmc_select_hs400es(mci);
+	} else if (!host->execute_tuning) {
+		return 0;
+	} else if (bus_8bit && (caps & MMC_CAP_MMC_HS400_1_8V)) {
+		mode = "HS400";
+		timing = EXT_CSD_TIMING_HS400;
+		err = mmc_select_hs400(mci);
+	} else if (caps & MMC_CAP_MMC_HS200_1_8V) {
+		mode = "HS200";
+		timing = EXT_CSD_TIMING_HS200;
+		err = mmc_select_hs200(mci);
+	} else {
+		return 0;
+	}
+
+	if (!err)
+		err = mmc_verify_timing(mci, timing);
+	if (!err)
+		return 0;
+
+	dev_warn(&mci->dev, "Switching to %s failed: %d, falling back to high speed\n",
+		 mode, err);
+
+	return mmc_select_hs(mci, ext_csd_bus_width);
+}
+
 static int mci_startup_mmc(struct mci *mci)
 {
 	struct mci_host *host = mci->host;
@@ -1124,7 +1348,36 @@ static int mci_startup_mmc(struct mci *mci)
 			break;
 	}
 
-	return err;
+	if (err)
+		return err;
+
+	return mmc_select_timing(mci, ext_csd_bits[idx]);
+}
+
+/**
+ * Check for pre-defined multi block transfers and reliable writes
+ * @param mci MCI instance
+ *
+ * CMD23 is mandatory for MMC since version 3.1 and optional for SD, where
+ * the SCR tells. Hosts which can't cope with transfers not ended by
+ * STOP_TRANSMISSION don't set MMC_CAP_CMD23.
+ */
+static void mci_detect_cmd23(struct mci *mci)
+{
+	if (!(mci->host->host_caps & MMC_CAP_CMD23))
+		return;
+
+	if (IS_SD(mci))
+		mci->cmd23 = mci->scr[0] & SD_SCR_CMD23_SUPPORT;
+	else
+		mci->cmd23 = mci->version >= MMC_VERSION_3;
+
+	if (mci->cmd23 && !IS_SD(mci) && mci->version >= MMC_VERSION_4 &&
+	    mci->ext_csd[EXT_CSD_REV] >= 5)
+		mci->rel_wr_sectors = mci->ext_csd[EXT_CSD_REL_WR_SEC_C];
+
+	dev_dbg(&mci->dev, "CMD23 %sused, reliable write sectors: %u\n",
+		mci->cmd23 ? "" : "not ", mci->rel_wr_sectors);
 }
 
 /**
@@ -1252,6 +1505,8 @@ static int mci_startup(struct mci *mci)
 	if (err)
 		return err;
 
+	mci_detect_cmd23(mci);
+
 	/* we setup the blocklength only one times for all accesses to this media  */
 	err = mci_set_blocklen(mci, mci->read_bl_len);
 
@@ -1334,6 +1589,53 @@ static int mci_blk_part_switch(struct mci_part *part)
 
 /* ------------------ attach to the blocklayer --------------------------- */
 
+/**
+ * Maximum number of blocks for a single data command
+ * @param mci MCI instance
+ * @param bl_len Block length in use
+ *
+ * Limited by the host and, for pre-defined transfers, by the 16 bit block
+ * count of CMD23.
+ */
+static blkcnt_t mci_max_req_blocks(struct mci *mci, unsigned bl_len)
+{
+	blkcnt_t max = UINT_MAX;
+
+	if (mci->host->max_req_size)
+		max = mci->host->max_req_size / bl_len;
+
+	if (mci->cmd23)
+		max = min_t(blkcnt_t, max, MMC_CMD23_MAX_BLOCKS);
+
+	return max;
+}
+
+/**
+ * Limit a write to what a legacy reliable write can handle
+ * @param mci MCI instance
+ * @param block First block of the write
+ * @param blocks Number of blocks to write
+ *
+ * Unless WR_REL_PARAM announces enhanced reliable write, the card only
+ * guarantees atomicity for single blocks and for aligned writes of
+ * exactly REL_WR_SEC_C blocks.
+ */
+static blkcnt_t mci_reliable_write_blocks(struct mci *mci, sector_t block,
+					  blkcnt_t blocks)
+{
+	unsigned rel = mci->rel_wr_sectors;
+	u32 rem;
+
+	if (mci->ext_csd[EXT_CSD_WR_REL_PARAM] & EXT_CSD_WR_REL_PARAM_EN)
+		return blocks;
+
+	div_u64_rem(block, rel, &rem);
+	if (rem || blocks < rel)
+		return 1;
+
+	return rel;
+}
+
 /**
  * Write a chunk of sectors to media
  * @param blk All info about the block device we need
@@ -1351,12 +1653,9 @@ static int __maybe_unused mci_sd_write(struct block_device *blk,
 	struct mci *mci = part->mci;
 	struct mci_host *host = mci->host;
 	int rc;
-	blkcnt_t max_req_block = num_blocks;
+	blkcnt_t max_req_block = mci_max_req_blocks(mci, mci->write_bl_len);
 	blkcnt_t write_block;
 
-	if (mci->host->max_req_size)
-		max_req_block = mci->host->max_req_size / mci->write_bl_len;
-
 	mci_blk_part_switch(part);
 
 	if (!host->disable_wp &&
@@ -1382,6 +1681,8 @@ static int __maybe_unused mci_sd_write(struct block_device *blk,
 
 	while (num_blocks) {
 		write_block = min(num_blocks, max_req_block);
+		if (mci->reliable_write)
+			write_block = mci_reliable_write_blocks(mci, block, write_block);
 		rc = mci_block_write(mci, buffer, block, write_block);
 		if (rc != 0) {
 			dev_dbg(&mci->dev, "Writing block %llu failed with %d\n", block, rc);
@@ -1410,13 +1711,11 @@ static int mci_sd_read(struct block_device *blk, void *buffer, sector_t block,
 {
 	struct mci_part *part = container_of(blk, struct mci_part, blk);
 	struct mci *mci = part->mci;
-	blkcnt_t max_req_block = num_blocks;
+	blkcnt_t max_req_block = mci_max_req_blocks(mci, mci->read_bl_len);
 	blkcnt_t read_block;
+	u64 start, bytes;
 	int rc;
 
-	if (mci->host->max_req_size)
-		max_req_block = mci->host->max_req_size / mci->read_bl_len;
-
 	mci_blk_part_switch(part);
 
 	dev_dbg(&mci->dev, "%s: Read %llu block(s), starting at %llu\n",
@@ -1433,6 +1732,9 @@ static int mci_sd_read(struct block_device *blk, void *buffer, sector_t block,
 		return -EINVAL;
 	}
 
+	bytes = num_blocks * SECTOR_SIZE;
+	start = get_time_ns();
+
 	while (num_blocks) {
 		read_block = min(num_blocks, max_req_block);
 		rc = mci_read_block(mci, buffer, block, read_block);
@@ -1445,6 +1747,14 @@ static int mci_sd_read(struct block_device *blk, void *buffer, sector_t block,
 		buffer += read_block * mci->read_bl_len;
 	}
 
+	/* small reads are dominated by command overhead, don't count them */
+	if (bytes >= SZ_64K) {
+		u64 ns = get_time_ns() - start;
+
+		if (ns)
+			mci->read_speed = div64_u64(bytes * (NSEC_PER_SEC / SZ_1K), ns);
+	}
+
 	return 0;
 }
 
@@ -1550,6 +1860,18 @@ static const char *mci_timing_tostr(unsigned timing)
 		return "MMC HS";
 	case MMC_TIMING_SD_HS:
 		return "SD HS";
+	case MMC_TIMING_UHS_SDR50:
+		return "UHS SDR50";
+	case MMC_TIMING_UHS_SDR104:
+		return "UHS SDR104";
+	case MMC_TIMING_UHS_DDR50:
+		return "UHS DDR50";
+	case MMC_TIMING_MMC_HS200:
+		return "MMC HS200";
+	case MMC_TIMING_MMC_DDR52:
+		return "MMC DDR52";
+	case MMC_TIMING_MMC_HS400:
+		return "MMC HS400";
 	default:
 		return "unknown"; /* shouldn't happen */
 	}
@@ -1557,12 +1879,15 @@ static const char *mci_timing_tostr(unsigned timing)
 
 static void mci_print_caps(unsigned caps)
 {
-	printf("  capabilities: %s%s%s%s%s\n",
+	printf("  capabilities: %s%s%s%s%s%s%s%s\n",
 		caps & MMC_CAP_4_BIT_DATA ? "4bit " : "",
 		caps & MMC_CAP_8_BIT_DATA ? "8bit " : "",
 		caps & MMC_CAP_SD_HIGHSPEED ? "sd-hs " : "",
 		caps & MMC_CAP_MMC_HIGHSPEED ? "mmc-hs " : "",
-		caps & MMC_CAP_MMC_HIGHSPEED_52MHZ ? "mmc-52MHz " : "");
+		caps & MMC_CAP_MMC_HIGHSPEED_52MHZ ? "mmc-52MHz " : "",
+		caps & MMC_CAP_MMC_HS200_1_8V ? "mmc-hs200 " : "",
+		caps & MMC_CAP_MMC_HS400_1_8V ? "mmc-hs400 " : "",
+		caps & MMC_CAP_MMC_HS400_ES ? "mmc-hs400es " : "");
 }
 
 /**
@@ -1591,7 +1916,8 @@ static void mci_info(struct device_d *dev)
 		bw = 1;
 
 	printf("  current buswidth: %d\n", bw);
-	printf("  current timing: %s\n", mci_timing_tostr(host->timing));
+	printf("  current timing: %s%s\n", mci_timing_tostr(host->timing),
+		host->enhanced_strobe ? " (enhanced strobe)" : "");
 	mci_print_caps(host->host_caps);
 
 	printf("Card information:\n");
@@ -1804,6 +2130,15 @@ static int mci_card_probe(struct mci *mci)
 	dev_dbg(&mci->dev, "Card is up and running now, registering as a disk\n");
 	mci->ready_for_use = 1;	/* TODO now or later? */
 
+	mci->timing_str = basprintf("%s%s", mci_timing_tostr(host->timing),
+				    host->enhanced_strobe ? " ES" : "");
+	dev_add_param_string_ro(&mci->dev, "timing", &mci->timing_str, NULL);
+	dev_add_param_uint32_ro(&mci->dev, "read_speed", &mci->read_speed, "%u");
+
+	if (mci->rel_wr_sectors)
+		dev_add_param_bool(&mci->dev, "reliable_write", NULL, NULL,
+				   &mci->reliable_write, NULL);
+
 	for (i = 0; i < mci->nr_parts; i++) {
 		struct mci_part *part = &mci->part[i];
 
@@ -2015,6 +2350,13 @@ void mci_of_parse_node(struct mci_host *host,
 	host->non_removable = of_property_read_bool(np, "non-removable");
 	host->no_sd = of_property_read_bool(np, "no-sd");
 	host->disable_wp = of_property_read_bool(np, "disable-wp");
+
+	if (of_property_read_bool(np, "mmc-hs200-1_8v"))
+		host->host_caps |= MMC_CAP_MMC_HS200_1_8V;
+	if (of_property_read_bool(np, "mmc-hs400-1_8v"))
+		host->host_caps |= MMC_CAP_MMC_HS200_1_8V | MMC_CAP_MMC_HS400_1_8V;
+	if (of_property_read_bool(np, "mmc-hs400-enhanced-strobe"))
+		host->host_caps |= MMC_CAP_MMC_HS400_ES;
 }
 
 void mci_of_parse(struct mci_host *host)
@@ -601,6 +601,8 @@ static int omap_mmc_probe(struct device_d *dev)
 
 	hsmmc->mci.f_min = 400000;
 	hsmmc->mci.f_max = 52000000;
+	/* 16 bit block counter */
+	hsmmc->mci.max_req_size = 0xffff * 512;
 
 	pdata = (struct omap_hsmmc_platform_data *)dev->platform_data;
 	if (pdata) {
@@ -18,6 +18,7 @@
 #define DWCMSHC_VER_TYPE		0x504
 #define DWCMSHC_HOST_CTRL3		0x508
 #define DWCMSHC_EMMC_CONTROL		0x52c
+#define DWCMSHC_CARD_IS_EMMC		BIT(0)
 #define DWCMSHC_EMMC_ATCTRL		0x540
 
 /* Rockchip specific Registers */
@@ -50,7 +51,8 @@
 						SDHCI_INT_DATA_AVAIL | \
 						SDHCI_INT_DATA_TIMEOUT | \
 						SDHCI_INT_DATA_CRC | \
-						SDHCI_INT_DATA_END_BIT
+						SDHCI_INT_DATA_END_BIT | \
+						SDHCI_INT_ADMA_ERROR
 
 #define SDHCI_DWCMSHC_INT_CMD_MASK		SDHCI_INT_CMD_COMPLETE | \
 						SDHCI_INT_TIMEOUT | \
@@ -71,6 +73,7 @@ struct rk_sdhci_host {
 	struct mci_host		mci;
 	struct sdhci		sdhci;
 	struct clk_bulk_data	clks[CLK_MAX];
+	u32			txclk_tapnum;
 };
 
 
@@ -128,7 +131,8 @@ static int rk_sdhci_init(struct mci_host *mci, struct device_d *dev)
 	return 0;
 }
 
-static void rk_sdhci_set_clock(struct rk_sdhci_host *host, unsigned int clock)
+static void rk_sdhci_set_clock(struct rk_sdhci_host *host, unsigned int clock,
+			       enum mci_timing timing)
 {
 	u32 txclk_tapnum = DLL_TXCLK_TAPNUM_DEFAULT, extra;
 	int err;
@@ -182,6 +186,9 @@ static void rk_sdhci_set_clock(struct rk_sdhci_host *host, unsigned int clock)
 		0x3 << 19;  /* post-change delay */
 	sdhci_write32(&host->sdhci, DWCMSHC_EMMC_ATCTRL, extra);
 
+	if (timing == MMC_TIMING_MMC_HS200 || timing == MMC_TIMING_MMC_HS400)
+		txclk_tapnum = host->txclk_tapnum;
+
 	extra = DWCMSHC_EMMC_DLL_DLYENA |
 		DLL_TXCLK_TAPNUM_FROM_SW |
 		txclk_tapnum;
@@ -193,6 +200,40 @@ static void rk_sdhci_set_clock(struct rk_sdhci_host *host, unsigned int clock)
 	sdhci_write32(&host->sdhci, DWCMSHC_EMMC_DLL_STRBIN, extra);
 }
 
+static void rk_sdhci_set_uhs_signaling(struct rk_sdhci_host *host,
+				       struct mci_ios *ios)
+{
+	u32 emmc_ctrl;
+	u16 ctrl2;
+
+	emmc_ctrl = sdhci_read32(&host->sdhci, DWCMSHC_EMMC_CONTROL);
+	emmc_ctrl &= ~(DWCMSHC_CARD_IS_EMMC | DWCMSHC_ENHANCED_STROBE);
+
+	ctrl2 = sdhci_read16(&host->sdhci, SDHCI_HOST_CONTROL2);
+	ctrl2 &= ~(SDHCI_CTRL_UHS_MASK | SDHCI_CTRL_VDD_180);
+
+	switch (ios->timing) {
+	case MMC_TIMING_MMC_HS200:
+		ctrl2 |= SDHCI_CTRL_UHS_SDR104 | SDHCI_CTRL_VDD_180;
+		break;
+	case MMC_TIMING_MMC_HS400:
+		/* Data strobe is only sampled with CARD_IS_EMMC set */
+		ctrl2 |= DWCMSHC_CTRL_HS400 | SDHCI_CTRL_VDD_180;
+		emmc_ctrl |= DWCMSHC_CARD_IS_EMMC;
+		if (ios->enhanced_strobe)
+			emmc_ctrl |= DWCMSHC_ENHANCED_STROBE;
+		break;
+	case MMC_TIMING_MMC_HS:
+		ctrl2 |= SDHCI_CTRL_UHS_SDR25;
+		break;
+	default:
+		break;
+	}
+
+	sdhci_write16(&host->sdhci, SDHCI_HOST_CONTROL2, ctrl2);
+	sdhci_write32(&host->sdhci, DWCMSHC_EMMC_CONTROL, emmc_ctrl);
+}
+
 static void rk_sdhci_set_ios(struct mci_host *mci, struct mci_ios *ios)
 {
 	struct rk_sdhci_host *host = to_rk_sdhci_host(mci);
@@ -201,8 +242,10 @@ static void rk_sdhci_set_ios(struct mci_host *mci, struct mci_ios *ios)
 	/* stop clock */
 	sdhci_write16(&host->sdhci, SDHCI_CLOCK_CONTROL, 0);
 
+	rk_sdhci_set_uhs_signaling(host, ios);
+
 	if (ios->clock)
-		rk_sdhci_set_clock(host, ios->clock);
+		rk_sdhci_set_clock(host, ios->clock, ios->timing);
 
 	sdhci_set_bus_width(&host->sdhci, ios->bus_width);
 
@@ -307,6 +350,13 @@ error:
 	return ret;
 }
 
+static int rk_sdhci_execute_tuning(struct mci_host *mci, u32 opcode)
+{
+	struct rk_sdhci_host *host = to_rk_sdhci_host(mci);
+
+	return sdhci_execute_tuning(&host->sdhci, opcode);
+}
+
 static int rk_sdhci_probe(struct device_d *dev)
 {
 	struct rk_sdhci_host *host;
@@ -328,8 +378,13 @@ static int rk_sdhci_probe(struct device_d *dev)
 	mci->set_ios = rk_sdhci_set_ios;
 	mci->init = rk_sdhci_init;
 	mci->card_present = rk_sdhci_card_present;
+	mci->execute_tuning = rk_sdhci_execute_tuning;
 	mci->hw_dev = dev;
 
+	host->txclk_tapnum = DLL_TXCLK_TAPNUM_DEFAULT;
+	of_property_read_u32(dev->device_node, "rockchip,txclk-tapnum",
+			     &host->txclk_tapnum);
+
 	host->clks[CLK_CORE].id = "core";
 	host->clks[CLK_BUS].id = "bus";
 	host->clks[CLK_AXI].id = "axi";
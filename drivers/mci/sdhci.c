@@ -133,6 +133,91 @@ void sdhci_setup_data_pio(struct sdhci *sdhci, struct mci_data *data)
 		      SDHCI_TRANSFER_BLOCK_SIZE(data->blocksize) | data->blocks << 16);
 }
 
+static void sdhci_config_dma(struct sdhci *sdhci, u8 mode)
+{
+	u8 ctrl;
+
+	if (sdhci->set_dma_mode) {
+		sdhci->set_dma_mode(sdhci, mode);
+		return;
+	}
+
+	ctrl = sdhci_read8(sdhci, SDHCI_HOST_CONTROL);
+	if ((ctrl & SDHCI_CTRL_DMA_MASK) == mode)
+		return;
+
+	ctrl &= ~SDHCI_CTRL_DMA_MASK;
+	ctrl |= mode;
+	sdhci_write8(sdhci, SDHCI_HOST_CONTROL, ctrl);
+}
+
+static void sdhci_adma_write_desc(struct sdhci *sdhci, void **desc,
+				  dma_addr_t addr, unsigned int len, u16 cmd)
+{
+	if (sdhci->flags & SDHCI_USE_64_BIT_DMA) {
+		struct sdhci_adma2_64_desc *d = *desc;
+
+		d->cmd = cpu_to_le16(cmd);
+		d->len = cpu_to_le16(len); /* 64KiB is encoded as 0 */
+		d->addr_lo = cpu_to_le32(lower_32_bits(addr));
+		d->addr_hi = cpu_to_le32(upper_32_bits(addr));
+	} else {
+		struct sdhci_adma2_32_desc *d = *desc;
+
+		d->cmd = cpu_to_le16(cmd);
+		d->len = cpu_to_le16(len);
+		d->addr = cpu_to_le32(addr);
+	}
+
+	*desc += sdhci->adma_desc_sz;
+}
+
+/*
+ * Fill the ADMA2 descriptor table for a single mapped buffer. Descriptors
+ * end on 64KiB address boundaries, which keeps them within the 16 bit
+ * length field and satisfies controllers which can't cross 128MiB
+ * boundaries within one descriptor.
+ */
+static void sdhci_adma_table_setup(struct sdhci *sdhci, dma_addr_t addr,
+				   unsigned int nbytes)
+{
+	void *desc = sdhci->adma_table;
+
+	while (nbytes) {
+		unsigned int len = SDHCI_ADMA2_MAX_LEN -
+				   (addr & (SDHCI_ADMA2_MAX_LEN - 1));
+		u16 cmd = SDHCI_ADMA2_ACT_TRAN | SDHCI_ADMA2_VALID;
+
+		len = min(len, nbytes);
+		if (len == nbytes)
+			cmd |= SDHCI_ADMA2_END;
+
+		sdhci_adma_write_desc(sdhci, &desc, addr, len, cmd);
+
+		addr += len;
+		nbytes -= len;
+	}
+
+	sdhci_write32(sdhci, SDHCI_ADMA_ADDRESS, lower_32_bits(sdhci->adma_addr));
+	if (sdhci->flags & SDHCI_USE_64_BIT_DMA)
+		sdhci_write32(sdhci, SDHCI_ADMA_ADDRESS_HI,
+			      upper_32_bits(sdhci->adma_addr));
+}
+
+static bool sdhci_can_adma(struct sdhci *sdhci, dma_addr_t dma, unsigned int nbytes)
+{
+	if (!(sdhci->flags & SDHCI_USE_ADMA))
+		return false;
+
+	if ((dma | nbytes) & (SDHCI_ADMA2_ALIGN - 1))
+		return false;
+
+	if (!(sdhci->flags & SDHCI_USE_64_BIT_DMA) && upper_32_bits(dma + nbytes - 1))
+		return false;
+
+	return true;
+}
+
 void sdhci_setup_data_dma(struct sdhci *sdhci, struct mci_data *data,
 			  dma_addr_t *dma)
 {
@@ -150,10 +235,10 @@ void sdhci_setup_data_dma(struct sdhci *sdhci, struct mci_data *data,
 	nbytes = data->blocks * data->blocksize;
 
 	if (data->flags & MMC_DATA_READ)
-		*dma = dma_map_single(dev, (void *)data->src, nbytes,
+		*dma = dma_map_single(dev, data->dest, nbytes,
 				      DMA_FROM_DEVICE);
 	else
-		*dma = dma_map_single(dev, data->dest, nbytes,
+		*dma = dma_map_single(dev, (void *)data->src, nbytes,
 				      DMA_TO_DEVICE);
 
 	if (dma_mapping_error(dev, *dma)) {
@@ -161,13 +246,22 @@ void sdhci_setup_data_dma(struct sdhci *sdhci, struct mci_data *data,
 		return;
 	}
 
-	sdhci_write32(sdhci, SDHCI_DMA_ADDRESS, *dma);
+	if (sdhci_can_adma(sdhci, *dma, nbytes)) {
+		sdhci_adma_table_setup(sdhci, *dma, nbytes);
+		sdhci_config_dma(sdhci, sdhci->flags & SDHCI_USE_64_BIT_DMA ?
+				 SDHCI_CTRL_ADMA64 : SDHCI_CTRL_ADMA32);
+	} else {
+		sdhci_write32(sdhci, SDHCI_DMA_ADDRESS, *dma);
+		if (sdhci->flags & SDHCI_USE_ADMA)
+			sdhci_config_dma(sdhci, SDHCI_CTRL_SDMA);
+	}
 }
 
 int sdhci_transfer_data_dma(struct sdhci *sdhci, struct mci_data *data,
 			    dma_addr_t dma)
 {
 	struct device_d *dev = sdhci->mci->hw_dev;
+	uint64_t start = get_time_ns();
 	int nbytes;
 	u32 irqstat;
 	int ret;
@@ -195,6 +289,13 @@ int sdhci_transfer_data_dma(struct sdhci *sdhci, struct mci_data *data,
 			goto out;
 		}
 
+		if (irqstat & SDHCI_INT_ADMA_ERROR) {
+			dev_err(dev, "ADMA error: 0x%02x\n",
+				sdhci_read8(sdhci, SDHCI_ADMA_ERROR));
+			ret = -EIO;
+			goto out;
+		}
+
 		if (irqstat & SDHCI_INT_DMA) {
 			u32 addr = sdhci_read32(sdhci, SDHCI_DMA_ADDRESS);
 
@@ -204,10 +305,16 @@ int sdhci_transfer_data_dma(struct sdhci *sdhci, struct mci_data *data,
 			 */
 			sdhci_write32(sdhci, SDHCI_INT_STATUS, SDHCI_INT_DMA);
 			sdhci_write32(sdhci, SDHCI_DMA_ADDRESS, addr);
+			start = get_time_ns();
 		}
 
 		if (irqstat & SDHCI_INT_XFER_COMPLETE)
 			break;
+
+		if (is_timeout(start, 10 * SECOND)) {
+			ret = -ETIMEDOUT;
+			goto out;
+		}
 	} while (1);
 
 	ret = 0;
@@ -217,7 +324,7 @@ out:
 	else
 		dma_unmap_single(dev, dma, nbytes, DMA_TO_DEVICE);
 
-	return 0;
+	return ret;
 }
 
 int sdhci_transfer_data_pio(struct sdhci *sdhci, struct mci_data *data)
@@ -285,6 +392,96 @@ int sdhci_reset(struct sdhci *sdhci, u8 mask)
 					100 * USEC_PER_MSEC);
 }
 
+#define SDHCI_MAX_TUNING_LOOP	40
+
+static int sdhci_send_tuning(struct sdhci *sdhci, u32 opcode)
+{
+	struct mci_cmd cmd = {
+		.cmdidx = opcode,
+		.resp_type = MMC_RSP_R1,
+	};
+	struct mci_data data = {
+		.flags = MMC_DATA_READ,
+		.blocks = 1,
+		.blocksize = 64,
+	};
+	u32 command, xfer, stat;
+	int ret;
+
+	/* The HS200 tuning block is 128 bytes in 8 bit mode */
+	if (opcode == MMC_CMD_SEND_TUNING_BLOCK_HS200 &&
+	    sdhci->mci->bus_width == MMC_BUS_WIDTH_8)
+		data.blocksize = 128;
+
+	sdhci_write32(sdhci, SDHCI_INT_STATUS, ~0);
+	sdhci_setup_data_pio(sdhci, &data);
+	sdhci_set_cmd_xfer_mode(sdhci, &cmd, &data, false, &command, &xfer);
+
+	sdhci_write16(sdhci, SDHCI_TRANSFER_MODE, xfer);
+	sdhci_write32(sdhci, SDHCI_ARGUMENT, 0);
+	sdhci_write16(sdhci, SDHCI_COMMAND, command);
+
+	/*
+	 * The tuning block is consumed by the controller, all we get is a
+	 * buffer read ready event, so that must be enabled in SDHCI_INT_ENABLE.
+	 */
+	ret = sdhci_read32_poll_timeout(sdhci, SDHCI_INT_STATUS, stat,
+					stat & SDHCI_INT_DATA_AVAIL,
+					150 * USEC_PER_MSEC);
+
+	sdhci_write32(sdhci, SDHCI_INT_STATUS, ~0);
+
+	return ret;
+}
+
+/**
+ * sdhci_execute_tuning - run the standard SDHCI v3 tuning procedure
+ * @sdhci: the host
+ * @opcode: MMC_CMD_SEND_TUNING_BLOCK_HS200 for eMMC
+ *
+ * Controllers with a non-standard tuning procedure have to implement their
+ * own mci_host::execute_tuning instead. On failure the controller is put
+ * back to the fixed sampling clock.
+ */
+int sdhci_execute_tuning(struct sdhci *sdhci, u32 opcode)
+{
+	struct device_d *dev = sdhci->mci->hw_dev;
+	u16 ctrl;
+	int i, ret;
+
+	ctrl = sdhci_read16(sdhci, SDHCI_HOST_CONTROL2);
+	ctrl |= SDHCI_CTRL_EXEC_TUNING;
+	sdhci_write16(sdhci, SDHCI_HOST_CONTROL2, ctrl);
+
+	for (i = 0; i < SDHCI_MAX_TUNING_LOOP; i++) {
+		ret = sdhci_send_tuning(sdhci, opcode);
+		if (ret) {
+			dev_dbg(dev, "tuning block timed out\n");
+			break;
+		}
+
+		ctrl = sdhci_read16(sdhci, SDHCI_HOST_CONTROL2);
+		if (!(ctrl & SDHCI_CTRL_EXEC_TUNING)) {
+			if (ctrl & SDHCI_CTRL_TUNED_CLK) {
+				dev_dbg(dev, "tuning done after %d blocks\n", i + 1);
+				return 0;
+			}
+			break;
+		}
+	}
+
+	dev_warn(dev, "tuning failed, using fixed sampling clock\n");
+
+	ctrl = sdhci_read16(sdhci, SDHCI_HOST_CONTROL2);
+	ctrl &= ~(SDHCI_CTRL_EXEC_TUNING | SDHCI_CTRL_TUNED_CLK);
+	sdhci_write16(sdhci, SDHCI_HOST_CONTROL2, ctrl);
+
+	sdhci_reset(sdhci, SDHCI_RESET_CMD);
+	sdhci_reset(sdhci, SDHCI_RESET_DATA);
+
+	return -EIO;
+}
+
 static u16 sdhci_get_preset_value(struct sdhci *host)
 {
 	u16 preset = 0;
@@ -499,6 +696,36 @@ void __sdhci_read_caps(struct sdhci *host, const u16 *ver,
 	}
 }
 
+static void sdhci_setup_adma(struct sdhci *host)
+{
+	size_t size;
+
+	if (IS_ENABLED(CONFIG_ARCH_DMA_ADDR_T_64BIT) &&
+	    (host->caps & SDHCI_CAN_64BIT) &&
+	    !(host->quirks2 & SDHCI_QUIRK2_BROKEN_64_BIT_DMA)) {
+		host->flags |= SDHCI_USE_64_BIT_DMA;
+		host->adma_desc_sz = sizeof(struct sdhci_adma2_64_desc);
+	} else {
+		host->adma_desc_sz = sizeof(struct sdhci_adma2_32_desc);
+	}
+
+	size = SDHCI_ADMA2_DESC_CNT * host->adma_desc_sz;
+
+	host->adma_table = dma_alloc_coherent(size, &host->adma_addr);
+	if (!host->adma_table) {
+		host->flags &= ~SDHCI_USE_64_BIT_DMA;
+		return;
+	}
+
+	if (!(host->flags & SDHCI_USE_64_BIT_DMA) && upper_32_bits(host->adma_addr)) {
+		dma_free_coherent(host->adma_table, host->adma_addr, size);
+		host->adma_table = NULL;
+		return;
+	}
+
+	host->flags |= SDHCI_USE_ADMA;
+}
+
 int sdhci_setup_host(struct sdhci *host)
 {
 	struct mci_host *mci = host->mci;
@@ -541,7 +768,16 @@ int sdhci_setup_host(struct sdhci *host)
 	if (host->caps & SDHCI_CAN_DO_HISPD)
 		mci->host_caps |= MMC_CAP_MMC_HIGHSPEED | MMC_CAP_SD_HIGHSPEED;
 
+	mci->host_caps |= MMC_CAP_CMD23;
+
 	host->sdma_boundary = SDHCI_DMA_BOUNDARY_512K;
 
+	if (!IN_PBL && (host->caps & SDHCI_CAN_DO_ADMA2) &&
+	    !(host->quirks & SDHCI_QUIRK_BROKEN_ADMA))
+		sdhci_setup_adma(host);
+
+	if (!mci->max_req_size)
+		mci->max_req_size = SDHCI_MAX_BLOCK_COUNT * SECTOR_SIZE;
+
 	return 0;
 }
@@ -4,7 +4,9 @@
 
 #include <pbl.h>
 #include <dma.h>
+#include <disks.h>
 #include <linux/iopoll.h>
+#include <linux/sizes.h>
 
 #define SDHCI_DMA_ADDRESS					0x00
 #define SDHCI_BLOCK_SIZE__BLOCK_COUNT				0x04
@@ -97,6 +99,7 @@
 #define  SDHCI_RESET_DATA			BIT(2)
 #define SDHCI_INT_STATUS					0x30
 #define SDHCI_INT_NORMAL_STATUS					0x30
+#define  SDHCI_INT_ADMA_ERROR			BIT(25)
 #define  SDHCI_INT_DATA_END_BIT			BIT(22)
 #define  SDHCI_INT_DATA_CRC			BIT(21)
 #define  SDHCI_INT_DATA_TIMEOUT			BIT(20)
@@ -117,6 +120,16 @@
 #define SDHCI_INT_ERROR_ENABLE					0x36
 #define SDHCI_SIGNAL_ENABLE					0x38
 #define SDHCI_ACMD12_ERR__HOST_CONTROL2				0x3C
+#define SDHCI_HOST_CONTROL2					0x3E
+#define  SDHCI_CTRL_UHS_MASK			GENMASK(2, 0)
+#define  SDHCI_CTRL_UHS_SDR12			0x0
+#define  SDHCI_CTRL_UHS_SDR25			0x1
+#define  SDHCI_CTRL_UHS_SDR50			0x2
+#define  SDHCI_CTRL_UHS_SDR104			0x3
+#define  SDHCI_CTRL_UHS_DDR50			0x4
+#define  SDHCI_CTRL_VDD_180			BIT(3)
+#define  SDHCI_CTRL_EXEC_TUNING			BIT(6)
+#define  SDHCI_CTRL_TUNED_CLK			BIT(7)
 #define SDHCI_CAPABILITIES					0x40
 #define  SDHCI_TIMEOUT_CLK_MASK			GENMASK(5, 0)
 #define  SDHCI_TIMEOUT_CLK_UNIT			0x00000080
@@ -150,6 +163,10 @@
 #define  SDHCI_CAN_DO_ADMA3			0x08000000
 #define  SDHCI_SUPPORT_HS400			0x80000000 /* Non-standard */
 
+#define SDHCI_ADMA_ERROR	0x54
+#define SDHCI_ADMA_ADDRESS	0x58
+#define SDHCI_ADMA_ADDRESS_HI	0x5c
+
 #define SDHCI_PRESET_FOR_SDR12	0x66
 #define SDHCI_PRESET_FOR_SDR25	0x68
 #define SDHCI_PRESET_FOR_SDR50	0x6A
@@ -178,6 +195,40 @@
 #define SDHCI_MAX_DIV_SPEC_200	256
 #define SDHCI_MAX_DIV_SPEC_300	2046
 
+#define SDHCI_MAX_BLOCK_COUNT	0xffff
+
+/* ADMA2 descriptor attributes */
+#define SDHCI_ADMA2_VALID	BIT(0)
+#define SDHCI_ADMA2_END		BIT(1)
+#define SDHCI_ADMA2_INT		BIT(2)
+#define SDHCI_ADMA2_ACT_NOP	(0 << 4)
+#define SDHCI_ADMA2_ACT_TRAN	(2 << 4)
+#define SDHCI_ADMA2_ACT_LINK	(3 << 4)
+
+/*
+ * A descriptor describes at most 64KiB (encoded as length 0). Buffers are
+ * split on 64KiB address boundaries, so a transfer of n bytes needs at most
+ * DIV_ROUND_UP(n, 64KiB) + 1 descriptors.
+ */
+#define SDHCI_ADMA2_MAX_LEN	SZ_64K
+#define SDHCI_ADMA2_ALIGN	4
+#define SDHCI_ADMA2_DESC_CNT	(DIV_ROUND_UP(SDHCI_MAX_BLOCK_COUNT * SECTOR_SIZE, \
+					      SDHCI_ADMA2_MAX_LEN) + 1)
+
+struct sdhci_adma2_32_desc {
+	__le16	cmd;
+	__le16	len;
+	__le32	addr;
+} __packed __aligned(4);
+
+/* 64-bit descriptors as used in SDHCI v3 64-bit mode (96 bits) */
+struct sdhci_adma2_64_desc {
+	__le16	cmd;
+	__le16	len;
+	__le32	addr_lo;
+	__le32	addr_hi;
+} __packed __aligned(4);
+
 struct sdhci {
 	u32 (*read32)(struct sdhci *host, int reg);
 	u16 (*read16)(struct sdhci *host, int reg);
@@ -197,14 +248,29 @@ struct sdhci {
 	bool preset_enabled; /* Preset is enabled */
 
 	unsigned int quirks;
+#define SDHCI_QUIRK_BROKEN_ADMA			BIT(6)
 #define SDHCI_QUIRK_MISSING_CAPS		BIT(27)
 	unsigned int quirks2;
+#define SDHCI_QUIRK2_BROKEN_64_BIT_DMA		BIT(9)
 #define SDHCI_QUIRK2_CLOCK_DIV_ZERO_BROKEN	BIT(15)
+	unsigned int flags;
+#define SDHCI_USE_ADMA				BIT(1)
+#define SDHCI_USE_64_BIT_DMA			BIT(12)
 	u32 caps;	/* CAPABILITY_0 */
 	u32 caps1;	/* CAPABILITY_1 */
 	bool read_caps;	/* Capability flags have been read */
 	u32 sdma_boundary;
 
+	void *adma_table;		/* ADMA2 descriptor table */
+	dma_addr_t adma_addr;		/* Mapped ADMA2 descriptor table */
+	unsigned int adma_desc_sz;	/* Size of one ADMA2 descriptor */
+
+	/*
+	 * Select the DMA engine (SDHCI_CTRL_SDMA/ADMA32/ADMA64) for hosts
+	 * which don't have the standard bits in SDHCI_HOST_CONTROL.
+	 */
+	void (*set_dma_mode)(struct sdhci *host, u8 mode);
+
 	struct mci_host	*mci;
 };
 
@@ -268,6 +334,7 @@ int sdhci_transfer_data_pio(struct sdhci *sdhci, struct mci_data *data);
 int sdhci_transfer_data_dma(struct sdhci *sdhci, struct mci_data *data,
 			    dma_addr_t dma);
 int sdhci_reset(struct sdhci *sdhci, u8 mask);
+int sdhci_execute_tuning(struct sdhci *sdhci, u32 opcode);
 u16 sdhci_calc_clk(struct sdhci *host, unsigned int clock,
 		   unsigned int *actual_clock, unsigned int input_clock);
 void sdhci_set_clock(struct sdhci *host, unsigned int clock, unsigned int input_clock);
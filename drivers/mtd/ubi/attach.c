@@ -1380,13 +1380,18 @@ static int scan_all(struct ubi_device *ubi, struct ubi_attach_info *ai,
 	if (!ai->vidb)
 		goto out_ech;
 
+	ubi_io_hdrs_init(ubi);
+
 	for (pnum = start; pnum < ubi->peb_count; pnum++) {
 		dbg_gen("process PEB %d", pnum);
+		ubi_io_prefetch_hdrs(ubi, pnum, ubi->peb_count);
 		err = scan_peb(ubi, ai, pnum, false);
 		if (err < 0)
 			goto out_vidh;
 	}
 
+	ubi_io_hdrs_free(ubi);
+
 	ubi_msg(ubi, "scanning is finished");
 
 	/* Calculate mean erase counter */
@@ -1430,6 +1435,7 @@ static int scan_all(struct ubi_device *ubi, struct ubi_attach_info *ai,
 	return 0;
 
 out_vidh:
+	ubi_io_hdrs_free(ubi);
 	ubi_free_vid_buf(ai->vidb);
 out_ech:
 	kfree(ai->ech);
@@ -1485,13 +1491,17 @@ static int scan_fast(struct ubi_device *ubi, struct ubi_attach_info **ai)
 	if (!scan_ai->vidb)
 		goto out_ech;
 
+	ubi_io_hdrs_init(ubi);
+
 	for (pnum = 0; pnum < UBI_FM_MAX_START; pnum++) {
 		dbg_gen("process PEB %d", pnum);
+		ubi_io_prefetch_hdrs(ubi, pnum, UBI_FM_MAX_START);
 		err = scan_peb(ubi, scan_ai, pnum, true);
 		if (err < 0)
 			goto out_vidh;
 	}
 
+	ubi_io_hdrs_free(ubi);
 	ubi_free_vid_buf(scan_ai->vidb);
 	kfree(scan_ai->ech);
 
@@ -1513,6 +1523,7 @@ static int scan_fast(struct ubi_device *ubi, struct ubi_attach_info **ai)
 	return err;
 
 out_vidh:
+	ubi_io_hdrs_free(ubi);
 	ubi_free_vid_buf(scan_ai->vidb);
 out_ech:
 	kfree(scan_ai->ech);
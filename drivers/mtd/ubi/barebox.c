@@ -2,7 +2,10 @@
 #include <common.h>
 #include <fcntl.h>
 #include <fs.h>
+#include <globalvar.h>
+#include <init.h>
 #include <ioctl.h>
+#include <magicvar.h>
 #include "ubi-barebox.h"
 #include "ubi.h"
 
@@ -537,6 +540,86 @@ int ubi_detach(int ubi_num)
 	return ubi_detach_mtd_dev(ubi_num, 1);
 }
 
+/**
+ * ubi_write_fastmap - write a new fastmap to an UBI device
+ * @ubi_num: The UBI device number
+ *
+ * Writes a fastmap reflecting the current state of the UBI device, replacing
+ * the existing one, if any. This allows to convert images without fastmap
+ * and to persist the erase counters of the current session without detaching.
+ *
+ * @return: 0 for success, negative error code otherwise
+ */
+int ubi_write_fastmap(int ubi_num)
+{
+	struct ubi_device *ubi;
+	int ret;
+
+	if (!IS_ENABLED(CONFIG_MTD_UBI_FASTMAP))
+		return -ENOSYS;
+
+	if (ubi_num < 0 || ubi_num >= UBI_MAX_DEVICES)
+		return -EINVAL;
+
+	ubi = ubi_get_device(ubi_num);
+	if (!ubi)
+		return -ENOENT;
+
+	if (ubi->ro_mode)
+		ret = -EROFS;
+	else if (ubi->fm_disabled)
+		ret = -EOPNOTSUPP;
+	else
+		ret = ubi_update_fastmap(ubi);
+
+	ubi_put_device(ubi);
+
+	return ret;
+}
+
+static int ubi_fastmap_on_shutdown;
+
+/*
+ * Devices attached by scanning do not have a fastmap until the next volume
+ * change. When enabled with global.ubi.fastmap_on_shutdown, write one before
+ * starting the OS so that the next attach, be it by barebox or by Linux, can
+ * use it.
+ */
+static void ubi_fastmap_shutdown(void)
+{
+	struct ubi_device *ubi;
+	int i, ret;
+
+	if (!IS_ENABLED(CONFIG_MTD_UBI_FASTMAP) || !ubi_fastmap_on_shutdown)
+		return;
+
+	for (i = 0; i < UBI_MAX_DEVICES; i++) {
+		ubi = ubi_devices[i];
+		if (!ubi || ubi->fm || ubi->fm_disabled || ubi->ro_mode)
+			continue;
+
+		ubi_msg(ubi, "writing fastmap");
+
+		ret = ubi_update_fastmap(ubi);
+		if (ret)
+			ubi_err(ubi, "Unable to write a new fastmap: %d", ret);
+	}
+}
+predevshutdown_exitcall(ubi_fastmap_shutdown);
+
+static int ubi_fastmap_globalvar_init(void)
+{
+	if (IS_ENABLED(CONFIG_MTD_UBI_FASTMAP))
+		globalvar_add_simple_bool("ubi.fastmap_on_shutdown",
+					  &ubi_fastmap_on_shutdown);
+
+	return 0;
+}
+device_initcall(ubi_fastmap_globalvar_init);
+
+BAREBOX_MAGICVAR(global.ubi.fastmap_on_shutdown,
+		 "If true, write a fastmap to attached UBI devices without one before starting the OS");
+
 /**
  * ubi_num_get_by_mtd - find the ubi number to the given mtd
  * @mtd: the mtd device
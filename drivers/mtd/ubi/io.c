@@ -74,9 +74,13 @@
  */
 
 #include <linux/err.h>
+#include <linux/sizes.h>
 #include <mtd/mtd-peb.h>
 #include "ubi.h"
 
+/* Maximum amount of header data prefetched at once while attaching */
+#define UBI_HDRS_PREFETCH_SIZE	SZ_128K
+
 static int self_check_not_bad(const struct ubi_device *ubi, int pnum);
 static int self_check_peb_ec_hdr(const struct ubi_device *ubi, int pnum);
 static int self_check_ec_hdr(const struct ubi_device *ubi, int pnum,
@@ -112,12 +116,36 @@ int ubi_io_read(const struct ubi_device *ubi, void *buf, int pnum, int offset,
 {
 	int ret;
 
+	if (ubi->hdrs_buf && offset + len <= ubi->leb_start) {
+		int i = pnum - ubi->hdrs_pnum;
+
+		if (i >= 0 && i < ubi->hdrs_count &&
+		    (ubi->hdrs_valid & BIT(i))) {
+			memcpy(buf, ubi->hdrs_buf + i * ubi->leb_start + offset,
+			       len);
+			return 0;
+		}
+	}
+
 	ret = mtd_peb_read(ubi->mtd, buf, pnum, offset, len);
 	if (mtd_is_bitflip(ret))
 		return UBI_IO_BITFLIPS;
 	return ret;
 }
 
+/**
+ * hdrs_invalidate - drop prefetched headers of a physical eraseblock.
+ * @ubi: UBI device description object
+ * @pnum: physical eraseblock number which is about to be changed
+ */
+static void hdrs_invalidate(struct ubi_device *ubi, int pnum)
+{
+	int i = pnum - ubi->hdrs_pnum;
+
+	if (i >= 0 && i < ubi->hdrs_count)
+		ubi->hdrs_valid &= ~BIT(i);
+}
+
 /**
  * ubi_io_write - write data to a physical eraseblock.
  * @ubi: UBI device description object
@@ -165,6 +193,8 @@ int ubi_io_write(struct ubi_device *ubi, const void *buf, int pnum, int offset,
 			return err;
 	}
 
+	hdrs_invalidate(ubi, pnum);
+
 	return mtd_peb_write(ubi->mtd, buf, pnum, offset, len);
 }
 
@@ -299,6 +329,8 @@ int ubi_io_sync_erase(struct ubi_device *ubi, int pnum, int torture)
 		return -EROFS;
 	}
 
+	hdrs_invalidate(ubi, pnum);
+
 	if (ubi->nor_flash) {
 		err = nor_erase_prepare(ubi, pnum);
 		if (err)
@@ -835,6 +867,73 @@ int ubi_io_write_vid_hdr(struct ubi_device *ubi, int pnum,
 	return err;
 }
 
+/**
+ * ubi_io_hdrs_init - start prefetching headers.
+ * @ubi: UBI device description object
+ *
+ * While attaching, the EC and VID headers of every physical eraseblock have
+ * to be read. Instead of issuing two small reads per PEB in between parsing
+ * them, ubi_io_prefetch_hdrs() reads the whole header area of a batch of
+ * consecutive PEBs back to back with a single read per PEB, and
+ * ubi_io_read() serves header reads from this batch. Allocation failures are
+ * not fatal, headers are then read on demand as usual.
+ */
+void ubi_io_hdrs_init(struct ubi_device *ubi)
+{
+	ubi->hdrs_max = clamp_t(int, UBI_HDRS_PREFETCH_SIZE / ubi->leb_start,
+				1, BITS_PER_LONG);
+	ubi->hdrs_buf = kmalloc(ubi->hdrs_max * ubi->leb_start, GFP_KERNEL);
+	ubi->hdrs_pnum = 0;
+	ubi->hdrs_count = 0;
+	ubi->hdrs_valid = 0;
+}
+
+/**
+ * ubi_io_hdrs_free - stop prefetching headers.
+ * @ubi: UBI device description object
+ */
+void ubi_io_hdrs_free(struct ubi_device *ubi)
+{
+	kfree(ubi->hdrs_buf);
+	ubi->hdrs_buf = NULL;
+	ubi->hdrs_count = 0;
+	ubi->hdrs_valid = 0;
+}
+
+/**
+ * ubi_io_prefetch_hdrs - prefetch the headers of a batch of PEBs.
+ * @ubi: UBI device description object
+ * @pnum: physical eraseblock number which is about to be scanned
+ * @end: first physical eraseblock number not to be prefetched
+ *
+ * This function does nothing if the headers of @pnum are already in the
+ * current batch. Otherwise the header areas of up to @ubi->hdrs_max PEBs
+ * starting at @pnum are read. PEBs which are bad or could not be read
+ * without error or bit-flips are left out, their headers are later read
+ * individually so that errors are reported exactly as without prefetching.
+ */
+void ubi_io_prefetch_hdrs(struct ubi_device *ubi, int pnum, int end)
+{
+	int i;
+
+	if (!ubi->hdrs_buf)
+		return;
+
+	if (pnum >= ubi->hdrs_pnum && pnum < ubi->hdrs_pnum + ubi->hdrs_count)
+		return;
+
+	ubi->hdrs_pnum = pnum;
+	ubi->hdrs_count = min(ubi->hdrs_max, end - pnum);
+	ubi->hdrs_valid = 0;
+
+	for (i = 0; i < ubi->hdrs_count; i++) {
+		void *buf = ubi->hdrs_buf + i * ubi->leb_start;
+
+		if (!mtd_peb_read(ubi->mtd, buf, pnum + i, 0, ubi->leb_start))
+			ubi->hdrs_valid |= BIT(i);
+	}
+}
+
 /**
  * self_check_not_bad - ensure that a physical eraseblock is not bad.
  * @ubi: UBI device description object
@@ -512,6 +512,13 @@ struct ubi_debug_info {
  * @buf_mutex: protects @peb_buf
  * @ckvol_mutex: serializes static volume checking when opening
  *
+ * @hdrs_buf: headers (the first @leb_start bytes) of PEBs prefetched while
+ *            attaching, %NULL if no prefetching is done
+ * @hdrs_pnum: first PEB in @hdrs_buf
+ * @hdrs_count: number of PEBs in @hdrs_buf
+ * @hdrs_max: maximum number of PEBs @hdrs_buf can hold
+ * @hdrs_valid: bitmap of PEBs in @hdrs_buf which were read without error
+ *
  * @dbg: debugging information for this UBI device
  */
 struct ubi_device {
@@ -597,6 +604,12 @@ struct ubi_device {
 
 	void *peb_buf;
 
+	void *hdrs_buf;
+	int hdrs_pnum;
+	int hdrs_count;
+	int hdrs_max;
+	unsigned long hdrs_valid;
+
 	struct ubi_debug_info dbg;
 };
 
@@ -876,6 +889,9 @@ int ubi_io_read_vid_hdr(struct ubi_device *ubi, int pnum,
 			struct ubi_vid_io_buf *vidb, int verbose);
 int ubi_io_write_vid_hdr(struct ubi_device *ubi, int pnum,
 			 struct ubi_vid_io_buf *vidb);
+void ubi_io_hdrs_init(struct ubi_device *ubi);
+void ubi_io_hdrs_free(struct ubi_device *ubi);
+void ubi_io_prefetch_hdrs(struct ubi_device *ubi, int pnum, int end);
 
 /* build.c */
 int ubi_detach_mtd_dev(int ubi_num, int anyway);
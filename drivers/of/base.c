@@ -313,6 +313,70 @@ struct device_node *of_find_node_by_alias(struct device_node *root, const char *
 }
 EXPORT_SYMBOL_GPL(of_find_node_by_alias);
 
+/*
+ * Direct mapped cache of phandle lookups. Entries are only hints: a hit is
+ * verified against the node's current phandle and the tree searched in, so
+ * entries need not be updated when phandles change or nodes move between
+ * trees. They only have to be dropped when the node is freed.
+ */
+#define OF_PHANDLE_CACHE_SIZE	512
+
+static struct device_node *phandle_cache[OF_PHANDLE_CACHE_SIZE];
+
+static inline unsigned int of_phandle_cache_hash(phandle phandle)
+{
+	return phandle & (OF_PHANDLE_CACHE_SIZE - 1);
+}
+
+static void of_phandle_cache_invalidate(struct device_node *node)
+{
+	unsigned int hash = of_phandle_cache_hash(node->phandle);
+
+	if (phandle_cache[hash] == node)
+		phandle_cache[hash] = NULL;
+}
+
+static void of_phandle_cache_populate(struct device_node *root)
+{
+	struct device_node *node;
+
+	memset(phandle_cache, 0, sizeof(phandle_cache));
+
+	of_tree_for_each_node_from(node, root)
+		if (node->phandle)
+			phandle_cache[of_phandle_cache_hash(node->phandle)] = node;
+}
+
+/* Is @node part of the nodes of_tree_for_each_node_from() iterates over? */
+static bool of_node_in_tree(struct device_node *node, struct device_node *root)
+{
+	if (!root)
+		root = root_node;
+	else if (node == root)
+		return false;
+
+	for (; node; node = node->parent)
+		if (node == root)
+			return true;
+
+	return false;
+}
+
+/*
+ * of_node_set_phandle - change the phandle of a node
+ * @node:    The node to change
+ * @phandle: The new phandle
+ *
+ * This only updates node->phandle, the "phandle" property has to be
+ * updated by the caller.
+ */
+void of_node_set_phandle(struct device_node *node, phandle phandle)
+{
+	of_phandle_cache_invalidate(node);
+	node->phandle = phandle;
+}
+EXPORT_SYMBOL(of_node_set_phandle);
+
 /*
  * of_find_node_by_phandle_from - Find a node given a phandle from given
  * root node.
@@ -324,10 +388,20 @@ struct device_node *of_find_node_by_phandle_from(phandle phandle,
 		struct device_node *root)
 {
 	struct device_node *node;
+	unsigned int hash = of_phandle_cache_hash(phandle);
 
-	of_tree_for_each_node_from(node, root)
-		if (node->phandle == phandle)
+	node = phandle_cache[hash];
+	if (phandle && node && node->phandle == phandle &&
+	    of_node_in_tree(node, root))
+		return node;
+
+	of_tree_for_each_node_from(node, root) {
+		if (node->phandle == phandle) {
+			if (phandle)
+				phandle_cache[hash] = node;
 			return node;
+		}
+	}
 
 	return NULL;
 }
@@ -1689,6 +1763,8 @@ int of_set_root_node(struct device_node *node)
 
 	root_node = node;
 
+	of_phandle_cache_populate(root_node);
+
 	of_chosen = of_find_node_by_path("/chosen");
 	of_property_read_string(root_node, "model", &of_model);
 
@@ -2512,6 +2588,8 @@ void of_delete_node(struct device_node *node)
 		list_del(&node->list);
 	}
 
+	of_phandle_cache_invalidate(node);
+
 	free(node->name);
 	free(node->full_name);
 	free(node);
@@ -66,7 +66,7 @@ static int of_overlay_apply(struct device_node *target,
 			continue;
 
 		if (of_prop_cmp(prop->name, "phandle") == 0)
-			target->phandle = be32_to_cpup(prop->value);
+			of_node_set_phandle(target, be32_to_cpup(prop->value));
 
 		err = of_set_property(target, prop->name, prop->value,
 				      prop->length, true);
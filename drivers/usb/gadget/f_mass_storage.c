@@ -223,6 +223,8 @@
 #include <linux/pagemap.h>
 #include <disks.h>
 #include <scsi.h>
+#include <block.h>
+#include <fs.h>
 
 #include <linux/err.h>
 #include <usb/mass_storage.h>
@@ -305,9 +307,18 @@ struct fsg_common {
 	unsigned int		short_packet_received:1;
 	unsigned int		bad_lun_okay:1;
 	unsigned int		running:1;
+	unsigned int		ra_pending:1;
 
 	struct completion	thread_wakeup_needed;
 
+	/* Read ahead for sequential reads, done while waiting for a command */
+	void			*ra_buf;
+	unsigned int		ra_lun;
+	loff_t			ra_offset;	/* offset of the data in ra_buf */
+	unsigned int		ra_len;		/* valid bytes in ra_buf */
+	unsigned int		last_read_lun;
+	loff_t			last_read_end;
+
 	/* Callback functions. */
 	const struct fsg_operations	*ops;
 	/* Gadget's private data. */
@@ -411,6 +422,51 @@ static void set_bulk_out_req_length(struct fsg_common *common,
 static struct f_ums_opts ums[14]; // FIXME
 static int ums_count;
 
+/*
+ * LUNs on block devices are accessed through the block layer directly
+ * instead of going through the file system layer for each request. Large
+ * aligned transfers then go straight between the device and our buffers.
+ */
+static ssize_t ums_read(struct f_ums_opts *opts, void *buf, size_t count,
+			loff_t offset)
+{
+	loff_t size = (loff_t)opts->num_sectors << SECTOR_SHIFT;
+	int ret;
+
+	if (!opts->blk || (count | offset) & (SECTOR_SIZE - 1))
+		return pread(opts->fd, buf, count, offset);
+
+	if (offset >= size)
+		return 0;
+
+	count = min_t(loff_t, count, size - offset);
+
+	ret = block_read(opts->blk, buf, opts->blk_start + (offset >> SECTOR_SHIFT),
+			 count >> SECTOR_SHIFT);
+
+	return ret ? ret : count;
+}
+
+static ssize_t ums_write(struct f_ums_opts *opts, void *buf, size_t count,
+			 loff_t offset)
+{
+	loff_t size = (loff_t)opts->num_sectors << SECTOR_SHIFT;
+	int ret;
+
+	if (!opts->blk || (count | offset) & (SECTOR_SIZE - 1))
+		return pwrite(opts->fd, buf, count, offset);
+
+	if (offset >= size)
+		return -ENOSPC;
+
+	count = min_t(loff_t, count, size - offset);
+
+	ret = block_write(opts->blk, buf, opts->blk_start + (offset >> SECTOR_SHIFT),
+			  count >> SECTOR_SHIFT);
+
+	return ret ? ret : count;
+}
+
 static int fsg_set_halt(struct fsg_dev *fsg, struct usb_ep *ep)
 {
 	const char	*name;
@@ -658,6 +714,72 @@ static int sleep_thread(struct fsg_common *common)
 
 /*-------------------------------------------------------------------------*/
 
+/*
+ * Read data for a READ command, using the read ahead buffer if it holds
+ * the data at @offset.
+ */
+static ssize_t fsg_read(struct fsg_common *common, struct fsg_buffhd *bh,
+			unsigned int amount, loff_t offset)
+{
+	unsigned int now = 0;
+	ssize_t nread;
+
+	if (common->ra_len && common->ra_lun == common->lun &&
+	    common->ra_offset == offset) {
+		now = min(amount, common->ra_len);
+
+		if (now == common->ra_len) {
+			swap(bh->buf, common->ra_buf);
+			bh->inreq->buf = bh->outreq->buf = bh->buf;
+		} else {
+			memcpy(bh->buf, common->ra_buf, now);
+		}
+
+		common->ra_len = 0;
+
+		if (now == amount)
+			return now;
+	}
+
+	nread = ums_read(&ums[common->lun], bh->buf + now, amount - now,
+			 offset + now);
+	if (nread < 0)
+		return now ? now : nread;
+
+	return now + nread;
+}
+
+/*
+ * Read the data following the last READ command while the host is busy
+ * processing it and sending the next command.
+ */
+static void fsg_readahead(struct fsg_common *common)
+{
+	struct fsg_lun *curlun = &common->luns[common->ra_lun];
+	unsigned int amount;
+	ssize_t nread;
+
+	if (!common->ra_pending)
+		return;
+
+	common->ra_pending = 0;
+	common->ra_len = 0;
+
+	if (common->last_read_end >= curlun->file_length)
+		return;
+
+	amount = min_t(loff_t, FSG_BUFLEN,
+		       curlun->file_length - common->last_read_end);
+
+	nread = ums_read(&ums[common->ra_lun], common->ra_buf, amount,
+			 common->last_read_end);
+	if (nread != amount)
+		return;
+
+	common->ra_offset = common->last_read_end;
+	common->ra_len = amount;
+}
+
 static int do_read(struct fsg_common *common)
 {
 	struct fsg_lun		*curlun = &common->luns[common->lun];
@@ -696,6 +818,15 @@ static int do_read(struct fsg_common *common)
 	if (unlikely(amount_left == 0))
 		return -EIO;		/* No default reply */
 
+	/* Read ahead after the second of two consecutive reads */
+	if (common->ra_buf && common->last_read_lun == common->lun &&
+	    common->last_read_end == file_offset) {
+		common->ra_pending = 1;
+		common->ra_lun = common->lun;
+	}
+	common->last_read_lun = common->lun;
+	common->last_read_end = file_offset + amount_left;
+
 	for (;;) {
 		/* Wait for the next buffer to become available */
 		bh = common->next_buffhd_to_fill;
@@ -732,7 +863,7 @@ static int do_read(struct fsg_common *common)
 		}
 
 		/* Perform the read */
-		nread = pread(ums[common->lun].fd, bh->buf, amount, file_offset);
+		nread = fsg_read(common, bh, amount, file_offset);
 
 		VLDBG(curlun, "file read %u @ %llu -> %zd\n", amount,
 				(unsigned long long) file_offset,
@@ -795,6 +926,11 @@ static int do_write(struct fsg_common *common)
 		return -EINVAL;
 	}
 
+	/* The read ahead data may be overwritten */
+	common->ra_pending = 0;
+	common->ra_len = 0;
+	common->last_read_end = -1;
+
 	/* Get the starting Logical Block Address and check that it's
 	 * not too big */
 	if (common->cmnd[0] == SCSI_WRITE6)
@@ -898,7 +1034,7 @@ static int do_write(struct fsg_common *common)
 			amount = bh->outreq->actual;
 
 			/* Perform the write */
-			nwritten = pwrite(ums[common->lun].fd, bh->buf, amount, file_offset);
+			nwritten = ums_write(&ums[common->lun], bh->buf, amount, file_offset);
 
 			VLDBG(curlun, "file write %u @ %llu -> %zd\n", amount,
 					(unsigned long long) file_offset,
@@ -947,6 +1083,13 @@ static int do_write(struct fsg_common *common)
 
 static int do_synchronize_cache(struct fsg_common *common)
 {
+	struct fsg_lun	*curlun = &common->luns[common->lun];
+	int		rc;
+
+	/* Write back data still held in the block layer's cache */
+	rc = flush(ums[common->lun].fd);
+	if (rc)
+		curlun->sense_data = SS_WRITE_ERROR;
 	return 0;
 }
 
@@ -1006,7 +1149,7 @@ static int do_verify(struct fsg_common *common)
 		}
 
 		/* Perform the read */
-		nread = pread(ums[common->lun].fd, bh->buf, amount, file_offset);
+		nread = ums_read(&ums[common->lun], bh->buf, amount, file_offset);
 
 		VLDBG(curlun, "file read %u @ %llu -> %zd\n", amount,
 				(unsigned long long) file_offset,
@@ -2082,6 +2225,8 @@ static int get_next_command(struct fsg_common *common)
 	 * can reuse it for the next filling.  No need to advance
 	 * next_buffhd_to_fill. */
 
+	fsg_readahead(common);
+
 	/* Wait for the CBW to arrive */
 	while (bh->state != BUF_STATE_FULL) {
 		rc = sleep_thread(common);
@@ -2392,6 +2537,9 @@ static void fsg_main_thread(void *fsg_)
 		dma_free(bh->buf);
 	} while (++bh, --i);
 
+	dma_free(common->ra_buf);
+	common->ra_buf = NULL;
+
 	ums_count = 0;
 	ums_files = NULL;
 }
@@ -2419,6 +2567,8 @@ static int fsg_common_init(struct fsg_common *common,
 	struct usb_gadget *gadget = cdev->gadget;
 	struct file_list_entry *fentry;
 	struct fsg_buffhd *bh;
+	struct block_device *blk;
+	struct cdev *bcdev;
 	int nluns, i, fd = -1, rc;
 
 	ums_count = 0;
@@ -2465,6 +2615,15 @@ static int fsg_common_init(struct fsg_common *common,
 		ums[ums_count].fd = fd;
 		ums[ums_count].num_sectors = st.st_size / SECTOR_SIZE;
 
+		bcdev = cdev_by_name(devpath_to_name(fentry->filename));
+		blk = cdev_get_block_device(bcdev);
+		if (blk && blk->blockbits == SECTOR_SHIFT) {
+			ums[ums_count].blk = blk;
+			ums[ums_count].blk_start = bcdev->offset >> SECTOR_SHIFT;
+		} else {
+			ums[ums_count].blk = NULL;
+		}
+
 		strlcpy(ums[ums_count].name, fentry->name, sizeof(ums[ums_count].name));
 
 		DBG(common, "LUN %d, %s sector_count %#x\n",
@@ -2520,6 +2679,12 @@ buffhds_first_it:
 	} while (--i);
 	bh->next = common->buffhds;
 
+	/* Read ahead is optional, go without it if there is no memory */
+	common->ra_buf = dma_alloc(FSG_BUFLEN);
+	common->ra_pending = 0;
+	common->ra_len = 0;
+	common->last_read_end = -1;
+
 	snprintf(common->inquiry_string, sizeof common->inquiry_string,
 		 "%-8s%-16s%04x",
 		 "Linux   ",
@@ -146,10 +146,10 @@ struct fsg_lun {
 #define DELAYED_STATUS	(EP0_BUFSIZE + 999)	/* An impossibly large value */
 
 /* Number of buffers we will use.  2 is enough for double-buffering */
-#define FSG_NUM_BUFFERS	2
+#define FSG_NUM_BUFFERS	CONFIG_USB_GADGET_MASS_STORAGE_NUM_BUFFERS
 
 /* Default size of buffer length. */
-#define FSG_BUFLEN	((u32)131072)
+#define FSG_BUFLEN	((u32)CONFIG_USB_GADGET_MASS_STORAGE_BUFLEN * 1024)
 
 /* Maximal number of LUNs supported in mass storage function */
 #define FSG_MAX_LUNS	8
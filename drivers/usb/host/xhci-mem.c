@@ -602,7 +602,7 @@ int xhci_mem_init(struct xhci_ctrl *ctrl, struct xhci_hccr *hccr,
 	/* set up the scratchpad buffer array and scratchpad buffers */
 	xhci_scratchpad_alloc(ctrl);
 
-	ctrl->bounce_buffer = xmemalign(SZ_64K, SZ_64K);
+	ctrl->bounce_buffer = xmemalign(TRB_MAX_BUFF_SIZE, XHCI_MAX_BULK_LEN);
 
 	/* initializing the virtual devices to NULL */
 	for (i = 0; i < MAX_HC_SLOTS; ++i)
@@ -550,6 +550,14 @@ static void record_transfer_result(struct usb_device *udev,
 /**
  * Queues up the BULK Request
  *
+ * The transfer is queued as a single TD, chained from one TRB per 64KiB
+ * block of the bounce buffer, and handed to the hardware with a single
+ * doorbell write. The TD completes either at its last TRB or, for IN
+ * transfers, at the first TRB that sees a short packet; the number of
+ * bytes transferred is derived from the TRB the first completion event
+ * points to. A short packet before the last TRB is followed by a second
+ * event for the last TRB, which is reaped before returning.
+ *
  * @param udev		pointer to the USB device structure
  * @param pipe		contains the DIR_IN or OUT , devnum
  * @param length	length of the buffer
@@ -559,9 +567,9 @@ static void record_transfer_result(struct usb_device *udev,
 int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 			int length, void *buffer)
 {
-	int num_trbs = 0;
+	int num_trbs;
 	struct xhci_generic_trb *start_trb;
-	bool first_trb = false;
+	struct xhci_generic_trb *trbs[XHCI_MAX_BULK_TRBS];
 	int start_cycle;
 	u32 field = 0;
 	u32 length_field = 0;
@@ -576,8 +584,8 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 	int running_total, trb_buff_len;
 	unsigned int total_packet_count;
 	int maxpacketsize;
-	u64 addr;
-	int ret;
+	u64 addr, event_trb;
+	int ret, i, comp;
 	u32 trb_fields[4];
 	enum dma_data_direction direction;
 	void *bounce = ctrl->bounce_buffer;
@@ -585,13 +593,10 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 
 	/*
 	 * XHCI has the restriction that a single TRB may not cross a 64KiB
-	 * boundary. The U-Boot code we derived this from is somewhat prepared
-	 * for this, but it doesn't work, at least not for the case when a short
-	 * packet is received. For now just limit the maximum buffer length to
-	 * 64KiB and use a 64KiB aligned bounce buffer to make sure we do not
-	 * cross a boundary.
+	 * boundary. The bounce buffer is 64KiB aligned, so every TRB but
+	 * the last one covers exactly one full 64KiB block of it.
 	 */
-	if (length > SZ_64K)
+	if (length > XHCI_MAX_BULK_LEN)
 		return -EINVAL;
 
 	if (usb_pipein(pipe)) {
@@ -615,39 +620,16 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 	ep_ctx = xhci_get_ep_ctx(ctrl, virt_dev->out_ctx, ep_index);
 
 	ring = virt_dev->eps[ep_index].ring;
-	/*
-	 * How much data is (potentially) left before the 64KB boundary?
-	 * XHCI Spec puts restriction( TABLE 49 and 6.4.1 section of XHCI Spec)
-	 * that the buffer should not span 64KB boundary. if so
-	 * we send request in more than 1 TRB by chaining them.
-	 */
-	running_total = TRB_MAX_BUFF_SIZE -
-			(lower_32_bits(addr) & (TRB_MAX_BUFF_SIZE - 1));
-	trb_buff_len = running_total;
-	running_total &= TRB_MAX_BUFF_SIZE - 1;
-
-	/*
-	 * If there's some data on this 64KB chunk, or we have to send a
-	 * zero-length transfer, we need at least one TRB
-	 */
-	if (running_total != 0 || length == 0)
-		num_trbs++;
 
-	/* How many more 64KB chunks to transfer, how many more TRBs? */
-	while (running_total < length) {
-		num_trbs++;
-		running_total += TRB_MAX_BUFF_SIZE;
-	}
+	/* Even a zero-length transfer needs one TRB */
+	num_trbs = max(DIV_ROUND_UP(length, TRB_MAX_BUFF_SIZE), 1);
 
-	/*
-	 * XXX: Calling routine prepare_ring() called in place of
-	 * prepare_trasfer() as there in 'Linux' since we are not
-	 * maintaining multiple TDs/transfer at the same time.
-	 */
 	ret = prepare_ring(ctrl, ring,
 			   le32_to_cpu(ep_ctx->ep_info) & EP_STATE_MASK);
-	if (ret < 0)
+	if (ret < 0) {
+		dma_unmap_single(ctrl->dev, map, length, direction);
 		return ret;
+	}
 
 	/*
 	 * Don't give the first TRB to the hardware (by toggling the cycle bit)
@@ -662,18 +644,14 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 
 	total_packet_count = DIV_ROUND_UP(length, maxpacketsize);
 
-	if (trb_buff_len > length)
-		trb_buff_len = length;
+	for (i = 0; i < num_trbs; i++) {
+		u32 remainder = 0;
 
-	first_trb = true;
+		trb_buff_len = min(length - running_total, TRB_MAX_BUFF_SIZE);
 
-	/* Queue the first TRB, even if it's zero-length */
-	do {
-		u32 remainder = 0;
 		field = 0;
 		/* Don't change the cycle bit of the first TRB until later */
-		if (first_trb) {
-			first_trb = false;
+		if (i == 0) {
 			if (start_cycle == 0)
 				field |= TRB_CYCLE;
 		} else {
@@ -684,7 +662,7 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		 * Chain all the TRBs together; clear the chain bit in the last
 		 * TRB to indicate it's the last TRB in the chain.
 		 */
-		if (num_trbs > 1)
+		if (i < num_trbs - 1)
 			field |= TRB_CHAIN;
 		else
 			field |= TRB_IOC;
@@ -701,7 +679,7 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 							   trb_buff_len,
 							   total_packet_count,
 							   maxpacketsize,
-							   num_trbs - 1);
+							   num_trbs - i - 1);
 
 		length_field = ((trb_buff_len & TRB_LEN_MASK) |
 				remainder |
@@ -713,16 +691,11 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		trb_fields[2] = length_field;
 		trb_fields[3] = field | (TRB_NORMAL << TRB_TYPE_SHIFT);
 
-		queue_trb(ctrl, ring, (num_trbs > 1), trb_fields);
-
-		--num_trbs;
+		trbs[i] = queue_trb(ctrl, ring, i < num_trbs - 1, trb_fields);
 
 		running_total += trb_buff_len;
-
-		/* Calculate length for next transfer */
 		addr += trb_buff_len;
-		trb_buff_len = min((length - running_total), TRB_MAX_BUFF_SIZE);
-	} while (running_total < length);
+	}
 
 	giveback_first_trb(udev, ep_index, start_cycle, start_trb);
 
@@ -730,6 +703,7 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 	if (!event) {
 		dev_dbg(&udev->dev, "XHCI bulk transfer timed out, aborting...\n");
 		abort_td(udev, ep_index);
+		dma_unmap_single(ctrl->dev, map, length, direction);
 		udev->status = USB_ST_NAK_REC;  /* closest thing to a timeout */
 		udev->act_len = 0;
 		return -ETIMEDOUT;
@@ -744,13 +718,42 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		dev_err(&udev->dev, "Unexpected ep_index %d, expected %d\n",
 			TRB_TO_EP_INDEX(field), ep_index);
 
-	record_transfer_result(udev, event, length);
+	/*
+	 * A short packet completes the TD early. All TRBs before the one
+	 * the event points to have been transferred completely, so account
+	 * for them and let record_transfer_result() handle the residue of
+	 * the completing TRB.
+	 */
+	event_trb = le64_to_cpu(event->trans_event.buffer);
+	for (i = 0; i < num_trbs - 1; i++)
+		if ((uintptr_t)trbs[i] == event_trb)
+			break;
+
+	comp = GET_COMP_CODE(le32_to_cpu(event->trans_event.transfer_len));
+	running_total = i * TRB_MAX_BUFF_SIZE;
+	record_transfer_result(udev, event,
+			       min(length - running_total, TRB_MAX_BUFF_SIZE));
+	udev->act_len += running_total;
 	xhci_acknowledge_event(ctrl);
 
+	/*
+	 * After a short packet in a TRB other than the last one the xHC
+	 * continues at the last TRB of the TD and, as it has TRB_IOC set,
+	 * generates a second event for it. Consume that one as well, it
+	 * would otherwise be taken as the completion of the next transfer.
+	 */
+	if (i < num_trbs - 1 && comp == COMP_SHORT_TX) {
+		event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
+		if (event)
+			xhci_acknowledge_event(ctrl);
+		else
+			dev_dbg(&udev->dev, "XHCI missing TD completion event\n");
+	}
+
 	dma_unmap_single(ctrl->dev, map, length, direction);
 
 	if (usb_pipein(pipe))
-		memcpy(buffer, bounce, length);
+		memcpy(buffer, bounce, udev->act_len);
 
 	return (udev->status != USB_ST_NOT_PROC) ? 0 : -1;
 }
@@ -1326,20 +1326,6 @@ static int xhci_update_hub_device(struct usb_device *udev)
 	return xhci_configure_endpoints(udev, false);
 }
 
-static __maybe_unused int xhci_get_max_xfer_size(size_t *size)
-{
-	/*
-	 * xHCD allocates one segment which includes 64 TRBs for each endpoint
-	 * and the last TRB in this segment is configured as a link TRB to form
-	 * a TRB ring. Each TRB can transfer up to 64K bytes, however data
-	 * buffers referenced by transfer TRBs shall not span 64KB boundaries.
-	 * Hence the maximum number of TRBs we can use in one transfer is 62.
-	 */
-	*size = (TRBS_PER_SEGMENT - 2) * TRB_MAX_BUFF_SIZE;
-
-	return 0;
-}
-
 int xhci_register(struct xhci_ctrl *ctrl)
 {
 	struct usb_host *host;
@@ -1364,6 +1350,7 @@ int xhci_register(struct xhci_ctrl *ctrl)
 	host->submit_bulk_msg = xhci_submit_bulk_msg;
 	host->alloc_device = xhci_alloc_device;
 	host->update_hub_device = xhci_update_hub_device;
+	host->max_xfer_size = XHCI_MAX_BULK_LEN;
 
 	ret = xhci_reset(ctrl);
 	if (ret)
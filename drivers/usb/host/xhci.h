@@ -20,6 +20,7 @@
 #include <io.h>
 #include <io-64-nonatomic-lo-hi.h>
 #include <linux/list.h>
+#include <linux/sizes.h>
 
 #define MAX_EP_CTX_NUM		31
 #define XHCI_ALIGNMENT		64
@@ -998,6 +999,14 @@ typedef enum {
 /* TRB buffer pointers can't cross 64KB boundaries */
 #define TRB_MAX_BUFF_SHIFT	16
 #define TRB_MAX_BUFF_SIZE	(1 << TRB_MAX_BUFF_SHIFT)
+/*
+ * Maximum length of a single bulk transfer. Bulk transfers go through a
+ * bounce buffer of this size which is aligned to TRB_MAX_BUFF_SIZE, so
+ * a transfer is queued as one TD of at most XHCI_MAX_BULK_TRBS chained
+ * TRBs, each covering one 64KiB block of the bounce buffer.
+ */
+#define XHCI_MAX_BULK_LEN	SZ_1M
+#define XHCI_MAX_BULK_TRBS	(XHCI_MAX_BULK_LEN / TRB_MAX_BUFF_SIZE)
 
 struct xhci_segment {
 	union xhci_trb		*trbs;
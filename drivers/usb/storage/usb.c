@@ -227,7 +227,7 @@ static int read_capacity_10(struct us_blk_dev *usb_blkdev)
 }
 
 static int usb_stor_io_16(struct us_blk_dev *usb_blkdev, u8 opcode,
-			  sector_t start, u8 *data, u16 blocks)
+			  sector_t start, u8 *data, u32 blocks)
 {
 	u8 cmd[16];
 
@@ -258,8 +258,23 @@ static int usb_stor_io_10(struct us_blk_dev *usb_blkdev, u8 opcode,
  * Disk driver interface
  ***********************************************************************/
 
+/*
+ * Sectors per READ/WRITE command for hosts that don't tell us how much
+ * they can transfer at once
+ */
 #define US_MAX_IO_BLK 32
 
+static unsigned int usb_stor_max_blocks(struct us_data *us)
+{
+	size_t size = us->pusb_dev->host->max_xfer_size;
+
+	if (!size)
+		return US_MAX_IO_BLK;
+
+	/* READ(10)/WRITE(10) carry a 16 bit transfer length */
+	return min_t(size_t, size / SECTOR_SIZE, 0xffff);
+}
+
 /* Read / write a chunk of sectors on media */
 static int usb_stor_blk_io(struct block_device *disk_dev,
 			   sector_t sector_start, blkcnt_t sector_count, void *buffer,
@@ -272,12 +287,11 @@ static int usb_stor_blk_io(struct block_device *disk_dev,
 	struct device_d *dev = &us->pusb_dev->dev;
 	int result;
 
-	/* ensure unit ready */
-	dev_dbg(dev, "Testing for unit ready\n");
-	if (usb_stor_test_unit_ready(pblk_dev, 0)) {
-		dev_dbg(dev, "Device NOT ready\n");
-		return -EIO;
-	}
+	/*
+	 * No TEST UNIT READY here: the unit was found ready when it was
+	 * added, and a failing command is retried with REQUEST SENSE in
+	 * between by usb_stor_transport() anyway.
+	 */
 
 	/* read / write the requested data */
 	dev_dbg(dev, "%s %llu block(s), starting from %llu\n",
@@ -285,7 +299,7 @@ static int usb_stor_blk_io(struct block_device *disk_dev,
 		sector_count, sector_start);
 
 	while (sector_count > 0) {
-		u16 n = min_t(blkcnt_t, sector_count, US_MAX_IO_BLK);
+		u32 n = min_t(blkcnt_t, sector_count, pblk_dev->max_blocks);
 
 		if (disk_dev->num_blocks > 0xffffffff) {
 			result = usb_stor_io_16(pblk_dev,
@@ -400,6 +414,7 @@ static int usb_stor_add_blkdev(struct us_data *us, unsigned char lun)
 	pblk_dev->blk.ops = &usb_mass_storage_ops;
 	pblk_dev->us = us;
 	pblk_dev->lun = lun;
+	pblk_dev->max_blocks = usb_stor_max_blocks(us);
 
 	/* read some info and get the unit ready */
 	result = usb_stor_init_blkdev(pblk_dev);
@@ -65,6 +65,7 @@ struct us_blk_dev {
 	struct us_data		*us;		/* LUN's enclosing dev */
 	struct block_device	blk;		/* the blockdevice for the dev */
 	unsigned char 		lun;		/* the LUN of this blk dev */
+	unsigned int		max_blocks;	/* max. sectors per READ/WRITE */
 	struct list_head	list;		/* siblings */
 };
 
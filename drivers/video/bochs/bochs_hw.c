@@ -10,6 +10,7 @@
 #include <driver.h>
 #include <linux/pci.h>
 #include <fb.h>
+#include <linux/sizes.h>
 #include "../edid.h"
 #include "bochs_hw.h"
 
@@ -92,9 +93,9 @@ static void bochs_fb_enable(struct fb_info *fb)
 	bochs_dispi_write(bochs, VBE_DISPI_INDEX_YRES,		fb->yres);
 	bochs_dispi_write(bochs, VBE_DISPI_INDEX_BANK,		0);
 	bochs_dispi_write(bochs, VBE_DISPI_INDEX_VIRT_WIDTH,	fb->xres);
-	bochs_dispi_write(bochs, VBE_DISPI_INDEX_VIRT_HEIGHT,	fb->yres);
+	bochs_dispi_write(bochs, VBE_DISPI_INDEX_VIRT_HEIGHT,	fb->yres_virtual);
 	bochs_dispi_write(bochs, VBE_DISPI_INDEX_X_OFFSET,	0);
-	bochs_dispi_write(bochs, VBE_DISPI_INDEX_Y_OFFSET,	0);
+	bochs_dispi_write(bochs, VBE_DISPI_INDEX_Y_OFFSET,	fb->yoffset);
 
 	bochs_dispi_write(bochs, VBE_DISPI_INDEX_ENABLE,
 			  VBE_DISPI_ENABLED | VBE_DISPI_LFB_ENABLED );
@@ -109,9 +110,34 @@ static void bochs_fb_disable(struct fb_info *fb)
 			 ~VBE_DISPI_ENABLED);
 }
 
+static int bochs_fb_activate_var(struct fb_info *fb)
+{
+	struct bochs *bochs = fb->priv;
+	unsigned long vram, line_length;
+
+	/* Allow panning over a second screen when the video memory has room */
+	vram = bochs_dispi_read(bochs, VBE_DISPI_INDEX_VIDEO_MEMORY_64K) * SZ_64K;
+	line_length = fb->xres * (fb->bits_per_pixel >> 3);
+
+	fb->yres_virtual = min_t(unsigned long, 2 * fb->yres, vram / line_length);
+
+	return 0;
+}
+
+static int bochs_fb_pan_display(struct fb_info *fb)
+{
+	struct bochs *bochs = fb->priv;
+
+	bochs_dispi_write(bochs, VBE_DISPI_INDEX_Y_OFFSET, fb->yoffset);
+
+	return 0;
+}
+
 static struct fb_ops bochs_fb_ops = {
 	.fb_enable = bochs_fb_enable,
 	.fb_disable = bochs_fb_disable,
+	.fb_activate_var = bochs_fb_activate_var,
+	.fb_pan_display = bochs_fb_pan_display,
 };
 
 static int bochs_hw_load_edid(struct bochs *bochs)
@@ -58,6 +58,39 @@ void fb_flush(struct fb_info *info)
 		info->fbops->fb_flush(info);
 }
 
+/**
+ * fb_pan_display - show the framebuffer starting at another line
+ * @info:	the framebuffer
+ * @yoffset:	first line to show, at most yres_virtual - yres
+ *
+ * Only supported by drivers which implement fb_pan_display and set up a
+ * yres_virtual larger than yres in their fb_activate_var.
+ */
+int fb_pan_display(struct fb_info *info, u32 yoffset)
+{
+	int ret;
+
+	if (!info->fbops->fb_pan_display)
+		return -ENOSYS;
+
+	if (yoffset + info->yres > info->yres_virtual)
+		return -EINVAL;
+
+	if (yoffset == info->yoffset)
+		return 0;
+
+	info->yoffset = yoffset;
+
+	if (!info->enabled)
+		return 0;
+
+	ret = info->fbops->fb_pan_display(info);
+	if (ret)
+		info->yoffset = 0;
+
+	return ret;
+}
+
 static void fb_release_shadowfb(struct fb_info *info)
 {
 	free(info->screen_base_shadow);
@@ -74,11 +107,11 @@ static int fb_alloc_shadowfb(struct fb_info *info)
 
 	if (info->shadowfb) {
 		info->screen_base_shadow = memalign(PAGE_SIZE,
-				info->line_length * info->yres);
+				info->line_length * info->yres_virtual);
 		if (!info->screen_base_shadow)
 			return -ENOMEM;
 		memcpy(info->screen_base_shadow, info->screen_base,
-				info->line_length * info->yres);
+				info->line_length * info->yres_virtual);
 	} else {
 		fb_release_shadowfb(info);
 	}
@@ -173,6 +206,8 @@ static int fb_setup_mode(struct fb_info *info)
 
 	info->xres = info->mode->xres;
 	info->yres = info->mode->yres;
+	info->yres_virtual = 0;
+	info->yoffset = 0;
 	info->line_length = 0;
 
 	if (info->fbops->fb_activate_var) {
@@ -185,8 +220,10 @@ static int fb_setup_mode(struct fb_info *info)
 
 	if (!info->line_length)
 		info->line_length = info->xres * (info->bits_per_pixel >> 3);
+	if (info->yres_virtual < info->yres || !info->fbops->fb_pan_display)
+		info->yres_virtual = info->yres;
 	if (!info->screen_size)
-		info->screen_size = info->line_length * info->yres;
+		info->screen_size = info->line_length * info->yres_virtual;
 
 	dev->resource[0].start = (resource_size_t)info->screen_base;
 	info->cdev.size = info->line_length * info->yres;
@@ -296,6 +333,8 @@ int register_framebuffer(struct fb_info *info)
 
 	if (!info->line_length)
 		info->line_length = info->xres * (info->bits_per_pixel >> 3);
+	if (!info->yres_virtual)
+		info->yres_virtual = info->yres;
 
 	info->cdev.ops = &fb_ops;
 	info->cdev.name = basprintf("fb%d", id);
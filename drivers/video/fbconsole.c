@@ -4,6 +4,8 @@
 #include <malloc.h>
 #include <getopt.h>
 #include <fb.h>
+#include <clock.h>
+#include <poller.h>
 #include <gui/image_renderer.h>
 #include <gui/graphic_utils.h>
 #include <linux/font.h>
@@ -45,8 +47,29 @@ struct fbc_priv {
 
 	int active;
 	int in_console;
+
+	/* damaged area of the render buffer in pixels, empty if x2 <= x1 */
+	int dirty_x1, dirty_y1, dirty_x2, dirty_y2;
+
+	/* first line of the console in the (virtual) framebuffer */
+	unsigned int yoffset;
+	/* scroll by panning the display instead of moving the text */
+	bool pan;
+	bool pan_pending;
+
+	/* the text was moved, the whole screen needs updating */
+	bool scrolled;
+	uint64_t last_flush;
+	struct poller_async flush_poller;
 };
 
+/*
+ * Updating the whole screen after the text was moved up is expensive with
+ * uncached framebuffer memory. Do it at most this often and collect the
+ * output in between.
+ */
+#define FBC_SCROLL_FLUSH_INTERVAL	(20 * MSECOND)
+
 static int fbc_getc(struct console_device *cdev)
 {
 	return 0;
@@ -57,12 +80,99 @@ static int fbc_tstc(struct console_device *cdev)
 	return 0;
 }
 
+static void fbc_damage(struct fbc_priv *priv, int x, int y, int width,
+		       int height)
+{
+	if (priv->dirty_x2 <= priv->dirty_x1) {
+		priv->dirty_x1 = x;
+		priv->dirty_y1 = y;
+		priv->dirty_x2 = x + width;
+		priv->dirty_y2 = y + height;
+		return;
+	}
+
+	priv->dirty_x1 = min(priv->dirty_x1, x);
+	priv->dirty_y1 = min(priv->dirty_y1, y);
+	priv->dirty_x2 = max(priv->dirty_x2, x + width);
+	priv->dirty_y2 = max(priv->dirty_y2, y + height);
+}
+
+static void fbc_damage_char(struct fbc_priv *priv, int x, int y)
+{
+	fbc_damage(priv, x * priv->font->width,
+		   priv->yoffset + y * priv->font->height,
+		   priv->font->width, priv->font->height);
+}
+
+/*
+ * Copy the damaged area from the shadow buffer to the framebuffer and
+ * update the panning offset.
+ */
+static void fbc_flush(struct fbc_priv *priv)
+{
+	if (priv->dirty_x2 > priv->dirty_x1) {
+		gu_screen_blit_area(priv->sc, priv->dirty_x1, priv->dirty_y1,
+				    priv->dirty_x2 - priv->dirty_x1,
+				    priv->dirty_y2 - priv->dirty_y1);
+		priv->dirty_x1 = priv->dirty_x2 = 0;
+	}
+
+	if (priv->pan_pending) {
+		fb_pan_display(priv->fb, priv->yoffset);
+		priv->pan_pending = false;
+	}
+
+	fb_flush(priv->fb);
+
+	priv->scrolled = false;
+	priv->last_flush = get_time_ns();
+}
+
+static void fbc_flush_async(void *ctx)
+{
+	struct fbc_priv *priv = ctx;
+
+	if (priv->in_console) {
+		poller_call_async(&priv->flush_poller, FBC_SCROLL_FLUSH_INTERVAL,
+				  fbc_flush_async, priv);
+		return;
+	}
+
+	priv->in_console = 1;
+	fbc_flush(priv);
+	priv->in_console = 0;
+}
+
+static void fbc_update(struct fbc_priv *priv)
+{
+	if (IS_ENABLED(CONFIG_POLLER) && priv->scrolled &&
+	    !is_timeout_non_interruptible(priv->last_flush,
+					  FBC_SCROLL_FLUSH_INTERVAL)) {
+		if (!poller_async_active(&priv->flush_poller))
+			poller_call_async(&priv->flush_poller,
+					  FBC_SCROLL_FLUSH_INTERVAL,
+					  fbc_flush_async, priv);
+		return;
+	}
+
+	if (IS_ENABLED(CONFIG_POLLER))
+		poller_async_cancel(&priv->flush_poller);
+
+	fbc_flush(priv);
+}
+
 static void cls(struct fbc_priv *priv)
 {
 	void *buf = gui_screen_render_buffer(priv->sc);
 
+	if (priv->yoffset) {
+		priv->yoffset = 0;
+		priv->pan_pending = true;
+	}
+
 	memset(buf, 0, priv->fb->line_length * priv->fb->yres);
-	gu_screen_blit(priv->sc);
+	fbc_damage(priv, 0, 0, priv->fb->xres, priv->fb->yres);
+	priv->scrolled = true;
 }
 
 struct rgb {
@@ -122,7 +232,8 @@ static void drawchar(struct fbc_priv *priv, int x, int y, int c)
 		uint8_t t = inbuf[i];
 		int j;
 
-		adr = buf + line_length * (y * priv->font->height + i) + x * priv->font->width * bpp;
+		adr = buf + line_length * (priv->yoffset + y * priv->font->height + i) +
+			x * priv->font->width * bpp;
 
 		for (j = 0; j < priv->font->width; j++) {
 			if (t & 0x80)
@@ -134,6 +245,8 @@ static void drawchar(struct fbc_priv *priv, int x, int y, int c)
 			t <<= 1;
 		}
 	}
+
+	fbc_damage_char(priv, x, y);
 }
 
 static void video_invertchar(struct fbc_priv *priv, int x, int y)
@@ -142,10 +255,47 @@ static void video_invertchar(struct fbc_priv *priv, int x, int y)
 
 	buf = gui_screen_render_buffer(priv->sc);
 
-	gu_invert_area(priv->fb, buf, x * priv->font->width, y * priv->font->height,
-			priv->font->width, priv->font->height);
-	gu_screen_blit_area(priv->sc, x * priv->font->width, y * priv->font->height,
+	gu_invert_area(priv->fb, buf, x * priv->font->width,
+			priv->yoffset + y * priv->font->height,
 			priv->font->width, priv->font->height);
+	fbc_damage_char(priv, x, y);
+}
+
+/*
+ * Scroll up by one line. When the driver supports panning, the visible
+ * window is moved down in the virtual framebuffer instead of moving the
+ * text, only when the end of the virtual framebuffer is reached the text
+ * is moved back to its start.
+ */
+static void fbc_scroll(struct fbc_priv *priv)
+{
+	struct fb_info *fb = priv->fb;
+	void *buf = gui_screen_render_buffer(priv->sc);
+	u32 line_length = fb->line_length;
+	unsigned int line_height = priv->font->height;
+	unsigned int last;
+
+	if (priv->pan && priv->yoffset + line_height + fb->yres <= fb->yres_virtual) {
+		priv->yoffset += line_height;
+		priv->pan_pending = true;
+	} else {
+		memmove(buf, buf + line_length * (priv->yoffset + line_height),
+			line_length * line_height * priv->rows);
+
+		if (priv->yoffset) {
+			priv->yoffset = 0;
+			priv->pan_pending = true;
+		}
+
+		fbc_damage(priv, 0, 0, fb->xres, line_height * priv->rows);
+		priv->scrolled = true;
+	}
+
+	/* clear the new last line and anything below it */
+	last = priv->yoffset + line_height * priv->rows;
+	memset(buf + line_length * last, 0,
+	       line_length * (priv->yoffset + fb->yres - last));
+	fbc_damage(priv, 0, last, fb->xres, priv->yoffset + fb->yres - last);
 }
 
 static void show_cursor(struct fbc_priv *priv, int x, int y)
@@ -185,10 +335,6 @@ static void printchar(struct fbc_priv *priv, int c)
 	default:
 		drawchar(priv, priv->x, priv->y, c);
 
-		gu_screen_blit_area(priv->sc, priv->x * priv->font->width,
-				priv->y * priv->font->height,
-				priv->font->width, priv->font->height);
-
 		priv->x++;
 		if (priv->x > priv->cols) {
 			priv->y++;
@@ -197,16 +343,7 @@ static void printchar(struct fbc_priv *priv, int c)
 	}
 
 	if (priv->y > priv->rows) {
-		void *buf;
-		u32 line_length = priv->fb->line_length;
-		int line_height = line_length * priv->font->height;
-
-		buf = gui_screen_render_buffer(priv->sc);
-
-		memcpy(buf, buf + line_height, line_height * priv->rows);
-		memset(buf + line_height * priv->rows, 0, line_height);
-
-		gu_screen_blit(priv->sc);
+		fbc_scroll(priv);
 		priv->y = priv->rows;
 	}
 
@@ -332,16 +469,8 @@ static void fbc_parse_csi(struct fbc_priv *priv)
 	}
 }
 
-static void fbc_putc(struct console_device *cdev, char c)
+static void __fbc_putc(struct fbc_priv *priv, char c)
 {
-	struct fbc_priv *priv = container_of(cdev,
-					struct fbc_priv, cdev);
-	struct fb_info *fb = priv->fb;
-
-	if (priv->in_console)
-		return;
-	priv->in_console = 1;
-
 	switch (priv->state) {
 	case LIT:
 		switch (c) {
@@ -366,7 +495,7 @@ static void fbc_putc(struct console_device *cdev, char c)
 		if (priv->csipos == 255) {
 			priv->csipos = 0;
 			priv->state = LIT;
-			return;
+			break;
 		}
 
 		switch (c) {
@@ -394,9 +523,65 @@ static void fbc_putc(struct console_device *cdev, char c)
 		break;
 
 	}
+}
+
+static void fbc_putc(struct console_device *cdev, char c)
+{
+	struct fbc_priv *priv = container_of(cdev,
+					struct fbc_priv, cdev);
+
+	if (priv->in_console)
+		return;
+	priv->in_console = 1;
+
+	__fbc_putc(priv, c);
+	fbc_update(priv);
+
 	priv->in_console = 0;
+}
 
-	fb_flush(fb);
+/*
+ * Draw the whole string before updating the framebuffer, so that the
+ * damaged areas of multiple characters and lines are copied at once.
+ */
+static int fbc_puts(struct console_device *cdev, const char *s, size_t nbytes)
+{
+	struct fbc_priv *priv = container_of(cdev,
+					struct fbc_priv, cdev);
+	size_t i;
+
+	if (priv->in_console)
+		return 0;
+	priv->in_console = 1;
+
+	for (i = 0; i < nbytes; i++) {
+		if (s[i] == '\n')
+			__fbc_putc(priv, '\r');
+
+		__fbc_putc(priv, s[i]);
+	}
+
+	fbc_update(priv);
+
+	priv->in_console = 0;
+
+	return nbytes;
+}
+
+static void fbc_console_flush(struct console_device *cdev)
+{
+	struct fbc_priv *priv = container_of(cdev,
+					struct fbc_priv, cdev);
+
+	if (!priv->active || priv->in_console)
+		return;
+
+	if (IS_ENABLED(CONFIG_POLLER))
+		poller_async_cancel(&priv->flush_poller);
+
+	priv->in_console = 1;
+	fbc_flush(priv);
+	priv->in_console = 0;
 }
 
 static int setup_font(struct fbc_priv *priv)
@@ -436,6 +621,13 @@ static int fbc_open(struct console_device *cdev)
 
 	priv->state = LIT;
 
+	/* panning needs at least one spare line in the virtual framebuffer */
+	priv->yoffset = 0;
+	priv->pan = fb->fbops->fb_pan_display &&
+		    fb->yres_virtual >= fb->yres + priv->font->height;
+	if (priv->pan)
+		fb_pan_display(fb, 0);
+
 	dev_info(priv->cdev.dev, "framebuffer console %dx%d activated\n",
 		priv->cols + 1, priv->rows + 1);
 
@@ -450,6 +642,13 @@ static int fbc_close(struct console_device *cdev)
 					struct fbc_priv, cdev);
 
 	if (priv->active) {
+		if (IS_ENABLED(CONFIG_POLLER))
+			poller_async_cancel(&priv->flush_poller);
+
+		fbc_flush(priv);
+		if (priv->pan)
+			fb_pan_display(priv->fb, 0);
+
 		fb_close(priv->sc);
 		priv->active = false;
 
@@ -467,6 +666,7 @@ static int set_font(struct param_d *p, void *vpriv)
 	if (cdev->f_active & (CONSOLE_STDOUT | CONSOLE_STDERR)) {
 		cls(priv);
 		setup_font(priv);
+		fbc_flush(priv);
 	}
 
 	return 0;
@@ -490,6 +690,8 @@ int register_fbconsole(struct fb_info *fb)
 	cdev->dev = &fb->dev;
 	cdev->tstc = fbc_tstc;
 	cdev->putc = fbc_putc;
+	cdev->puts = fbc_puts;
+	cdev->flush = fbc_console_flush;
 	cdev->getc = fbc_getc;
 	cdev->devname = "fbconsole";
 	cdev->devid = DEVICE_ID_DYNAMIC;
@@ -503,6 +705,9 @@ int register_fbconsole(struct fb_info *fb)
 		return ret;
 	}
 
+	if (IS_ENABLED(CONFIG_POLLER))
+		poller_async_register(&priv->flush_poller, "fbconsole");
+
 	priv->par_font_val = 0;
 	priv->par_font = add_param_font(&cdev->class_dev,
 			set_font, NULL,
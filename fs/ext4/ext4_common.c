@@ -267,6 +267,134 @@ long int read_allocated_block(struct ext2fs_node *node, int fileblock)
 	return blknr;
 }
 
+/*
+ * Resolve the extent containing @fileblock and store it in the inode's
+ * extent cache. Holes are cached as extents with a physical block of 0.
+ */
+static int ext4fs_lookup_extent(struct ext2fs_node *node, uint32_t fileblock)
+{
+	struct ext4fs_extent_cache *cache = &node->ext_cache;
+	struct ext2_inode *inode = &node->inode;
+	struct ext4_extent_header *ext_block;
+	struct ext4_extent *extent;
+	int blksz = EXT2_BLOCK_SIZE(node->data);
+	int log2_blksz = LOG2_EXT2_BLOCK_SIZE(node->data);
+	char *buf;
+	int i;
+
+	buf = zalloc(blksz);
+	if (!buf)
+		return -ENOMEM;
+
+	ext_block = ext4fs_get_extent_block(node->data, buf,
+			(struct ext4_extent_header *)inode->b.blocks.dir_blocks,
+			fileblock, log2_blksz);
+	if (!ext_block) {
+		pr_err("invalid extent block\n");
+		free(buf);
+		return -EINVAL;
+	}
+
+	extent = (struct ext4_extent *)(ext_block + 1);
+
+	/*
+	 * Without a following extent in this leaf we do not know how large
+	 * the hole is, so only cache a single block.
+	 */
+	cache->lblk = fileblock;
+	cache->len = 1;
+	cache->pblk = 0;
+
+	for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
+		uint32_t startblock = le32_to_cpu(extent[i].ee_block);
+		uint32_t len = le16_to_cpu(extent[i].ee_len);
+		uint64_t start;
+
+		if (startblock > fileblock) {
+			/* Sparse file */
+			cache->len = startblock - fileblock;
+			break;
+		}
+
+		if (len > EXT4_EXT_INIT_MAX_LEN) {
+			/* uninitialized extent, reads as zeroes */
+			len -= EXT4_EXT_INIT_MAX_LEN;
+			start = 0;
+		} else {
+			start = le16_to_cpu(extent[i].ee_start_hi);
+			start = (start << 32) +
+				le32_to_cpu(extent[i].ee_start_lo);
+		}
+
+		if (fileblock < startblock + len) {
+			cache->lblk = startblock;
+			cache->len = len;
+			cache->pblk = start;
+			break;
+		}
+	}
+
+	free(buf);
+
+	return 0;
+}
+
+/*
+ * ext4fs_map_blocks - map a range of logical file blocks
+ * @node:	The inode to map the blocks for
+ * @fileblock:	The first logical block
+ * @maxblocks:	The maximum number of blocks the caller is interested in
+ * @count:	Returns the number of blocks starting at @fileblock which are
+ *		physically contiguous, or which are all holes
+ *
+ * Return: The physical block @fileblock is stored in, 0 for holes or a
+ * negative error code.
+ */
+long int ext4fs_map_blocks(struct ext2fs_node *node, uint32_t fileblock,
+			   uint32_t maxblocks, uint32_t *count)
+{
+	struct ext4fs_extent_cache *cache = &node->ext_cache;
+	long int blknr, next;
+	uint32_t n;
+
+	if (le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL) {
+		uint32_t offset;
+		int ret;
+
+		if (!cache->len || fileblock < cache->lblk ||
+		    fileblock - cache->lblk >= cache->len) {
+			ret = ext4fs_lookup_extent(node, fileblock);
+			if (ret)
+				return ret;
+		}
+
+		offset = fileblock - cache->lblk;
+		*count = min(cache->len - offset, maxblocks);
+
+		return cache->pblk ? cache->pblk + offset : 0;
+	}
+
+	/*
+	 * Indirect block maps are cached in the ext2_data, so looking up
+	 * the following blocks one by one is cheap.
+	 */
+	blknr = read_allocated_block(node, fileblock);
+	if (blknr < 0)
+		return blknr;
+
+	for (n = 1; n < maxblocks; n++) {
+		next = read_allocated_block(node, fileblock + n);
+		if (next < 0)
+			return next;
+		if (blknr ? next != blknr + n : next != 0)
+			break;
+	}
+
+	*count = n;
+
+	return blknr;
+}
+
 int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 				struct ext2fs_node **fnode, int *ftype)
 {
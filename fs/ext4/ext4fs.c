@@ -43,67 +43,62 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
 }
 
 /*
- * Taken from openmoko-kernel mailing list: By Andy green
- * Optimized read file API : collects and defers contiguous sector
- * reads into one potentially more efficient larger sequential read action
+ * Read file data extent by extent: Each physically contiguous run of blocks
+ * is resolved once and submitted to the device as a single read.
  */
 loff_t ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		unsigned int len, char *buf)
 {
-	loff_t i;
-	blkcnt_t blockcnt;
 	int log2blocksize = LOG2_EXT2_BLOCK_SIZE(node->data);
 	const int blockshift = log2blocksize + DISK_SECTOR_BITS;
 	const int blocksize = 1 << blockshift;
 	loff_t filesize = ext4_isize(node);
-	ssize_t ret;
 	struct ext_filesystem *fs = node->data->fs;
-
-	/* Adjust len so it we can't read past the end of the file. */
-	if (len + pos > filesize)
-		len = filesize - pos;
+	unsigned int remaining, skip;
+	uint32_t block, lastblock;
+	long int blknr;
+	ssize_t ret;
 
 	if (filesize <= pos)
 		return -EINVAL;
 
-	blockcnt = ((len + pos) + blocksize - 1) >> blockshift;
-
-	for (i = pos >> blockshift; i < blockcnt; i++) {
-		sector_t blknr;
-		loff_t blockoff = pos - (blocksize * i);
-		loff_t blockend = blocksize;
-		loff_t skipfirst = 0;
+	/* Adjust len so it we can't read past the end of the file. */
+	if (len + pos > filesize)
+		len = filesize - pos;
 
-		ret = read_allocated_block(node, i);
-		if (ret < 0)
-			return ret;
+	if (!len)
+		return 0;
 
-		blknr = ret << log2blocksize;
+	block = pos >> blockshift;
+	lastblock = (pos + len - 1) >> blockshift;
+	skip = pos & (blocksize - 1);
+	remaining = len;
 
-		/* Last block.  */
-		if (i == blockcnt - 1) {
-			blockend = (len + pos) - (blocksize * i);
+	while (remaining) {
+		uint32_t count;
+		size_t now;
 
-			/* The last portion is exactly blocksize. */
-			if (!blockend)
-				blockend = blocksize;
-		}
+		blknr = ext4fs_map_blocks(node, block, lastblock - block + 1,
+					  &count);
+		if (blknr < 0)
+			return blknr;
 
-		/* First block. */
-		if (i == pos >> blockshift) {
-			skipfirst = blockoff;
-			blockend -= skipfirst;
-		}
+		now = min_t(size_t, ((size_t)count << blockshift) - skip,
+			    remaining);
 
 		if (blknr) {
-			ret = ext4fs_devread(fs, blknr, skipfirst, blockend, buf);
+			ret = ext4fs_devread(fs, (sector_t)blknr << log2blocksize,
+					     skip, now, buf);
 			if (ret)
 				return ret;
 		} else {
-			memset(buf, 0, blockend);
+			memset(buf, 0, now);
 		}
 
-		buf += blocksize - skipfirst;
+		buf += now;
+		remaining -= now;
+		block += count;
+		skip = 0;
 	}
 
 	return len;
@@ -209,12 +209,20 @@ struct ext2_dirent {
 	__u8 filetype;
 };
 
+/* Last logical to physical mapping resolved for an inode */
+struct ext4fs_extent_cache {
+	uint32_t lblk;		/* first logical block */
+	uint32_t len;		/* number of blocks, 0 if invalid */
+	uint64_t pblk;		/* first physical block, 0 for holes */
+};
+
 struct ext2fs_node {
 	struct inode i;
 	struct ext2_data *data;
 	struct ext2_inode inode;
 	int ino;
 	int inode_read;
+	struct ext4fs_extent_cache ext_cache;
 };
 
 struct ext4fs_indir_block {
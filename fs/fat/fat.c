@@ -25,10 +25,14 @@
 #include <linux/ctype.h>
 #include <xfuncs.h>
 #include <fcntl.h>
+#include <linux/sizes.h>
 #include "ff.h"
 #include "integer.h"
 #include "diskio.h"
 
+/* Files from this size on get a cluster link map table on open */
+#define FAT_LINKMAP_MIN_SIZE	SZ_1M
+
 struct fat_priv {
 	struct cdev *cdev;
 	FATFS fat;
@@ -36,30 +40,32 @@ struct fat_priv {
 
 /* ---------------------------------------------------------------*/
 
-DRESULT disk_read(FATFS *fat, BYTE *buf, DWORD sector, BYTE count)
+DRESULT disk_read(FATFS *fat, BYTE *buf, DWORD sector, UINT count)
 {
 	struct fat_priv *priv = fat->userdata;
-	int ret;
+	size_t size = (size_t)count * fat->ssize;
+	ssize_t ret;
 
 	debug("%s: sector: %ld count: %d\n", __func__, sector, count);
 
-	ret = cdev_read(priv->cdev, buf, count << 9, (loff_t)sector * 512, 0);
-	if (ret != count << 9)
+	ret = cdev_read(priv->cdev, buf, size, (loff_t)sector * fat->ssize, 0);
+	if (ret != size)
 		return ret;
 
 	return 0;
 }
 
-DRESULT disk_write(FATFS *fat, const BYTE *buf, DWORD sector, BYTE count)
+DRESULT disk_write(FATFS *fat, const BYTE *buf, DWORD sector, UINT count)
 {
 	struct fat_priv *priv = fat->userdata;
-	int ret;
+	size_t size = (size_t)count * fat->ssize;
+	ssize_t ret;
 
 	debug("%s: buf: %p sector: %ld count: %d\n",
 			__func__, buf, sector, count);
 
-	ret = cdev_write(priv->cdev, buf, count << 9, (loff_t)sector * 512, 0);
-	if (ret != count << 9)
+	ret = cdev_write(priv->cdev, buf, size, (loff_t)sector * fat->ssize, 0);
+	if (ret != size)
 		return ret;
 
 	return 0;
@@ -198,6 +204,13 @@ static int fat_open(struct device_d *dev, FILE *file, const char *filename)
 		ret = f_lseek(f_file, f_file->fsize);
 	}
 
+	/*
+	 * Map the cluster chain of big files opened read-only, so seeking
+	 * and reading don't have to follow the FAT. This is optional.
+	 */
+	if (!(flags & FA_WRITE) && f_file->fsize >= FAT_LINKMAP_MIN_SIZE)
+		f_linkmap(f_file);
+
 	file->priv = f_file;
 	file->size = f_file->fsize;
 
@@ -292,7 +292,7 @@ int sync (	/* 0: successful, -EIO: failed */
 		if (fs->fs_type == FS_FAT32 && fs->fsi_flag) {
 			fs->winsect = 0;
 			/* Create FSInfo structure */
-			memset(fs->win, 0, 512);
+			memset(fs->win, 0, SS(fs));
 			ST_WORD(fs->win+BS_55AA, 0xAA55);
 			ST_DWORD(fs->win+FSI_LeadSig, 0x41615252);
 			ST_DWORD(fs->win+FSI_StrucSig, 0x61417272);
@@ -1561,6 +1561,9 @@ static int chk_mounted (	/* 0(0): successful, !=0: any error occurred */
 	DWORD first_boot_sect;
 	DWORD bsect, fasize, tsect, sysect, nclst, szbfat;
 	WORD nrsv;
+#if _MAX_SS != 512
+	WORD ss;
+#endif
 	enum filetype type;
 
 	INIT_LIST_HEAD(&fs->dirtylist);
@@ -1569,9 +1572,8 @@ static int chk_mounted (	/* 0(0): successful, !=0: any error occurred */
 	/* Following code attempts to mount a volume. (analyze BPB and initialize the fs object) */
 
 	fs->fs_type = 0;	/* Clear the file system object */
-#if _MAX_SS != 512		/* Get disk sector size (variable sector size cfg only) */
-	if (disk_ioctl(fs, GET_SECTOR_SIZE, &fs->ssize) != RES_OK)
-		return -EIO;
+#if _MAX_SS != 512		/* Boot records are searched in 512 byte sectors */
+	fs->ssize = 512;
 #endif
 	/* Search FAT partition on the drive. Supports only generic partitionings, FDISK and SFD. */
 	type = check_fs(fs, bsect = 0, &first_boot_sect);	/* Check sector 0 if it is a VBR */
@@ -1587,9 +1589,26 @@ static int chk_mounted (	/* 0(0): successful, !=0: any error occurred */
 
 	/* Following code initializes the file system object */
 
+#if _MAX_SS != 512
+	/*
+	 * The media is byte addressable, so use the logical sector size of
+	 * the volume regardless of the physical sector size.
+	 */
+	ss = LD_WORD(fs->win+BPB_BytsPerSec);
+	if (ss < 512 || ss > _MAX_SS || (ss & (ss - 1)) || bsect % (ss / 512))
+		return -EINVAL;
+	if (ss != 512) {
+		bsect /= ss / 512;
+		fs->ssize = ss;
+		/* Reload the whole boot sector */
+		if (disk_read(fs, fs->win, bsect, 1) != RES_OK)
+			return -EIO;
+	}
+#else
 	/* (BPB_BytsPerSec must be equal to the physical sector size) */
 	if (LD_WORD(fs->win+BPB_BytsPerSec) != SS(fs))
 		return -EINVAL;
+#endif
 
 	/* Number of sectors per FAT */
 	fmt = FS_FAT12;
@@ -1821,6 +1840,106 @@ int f_open (
 
 
 
+#if _USE_FASTSEEK
+/*
+ * Get cluster# from the cluster link map table
+ */
+static DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
+	FIL *fp,	/* Pointer to the file object */
+	DWORD ofs	/* File offset to be converted to cluster# */
+)
+{
+	DWORD cl, ncl, *tbl;
+
+	tbl = fp->cltbl;
+	cl = ofs / SS(fp->fs) / fp->fs->csize;	/* Cluster order from top of the file */
+	for (;;) {
+		ncl = *tbl++;			/* Number of cluters in the fragment */
+		if (!ncl)
+			return 0;		/* End of table? (error) */
+		if (cl < ncl)
+			break;			/* In this fragment? */
+		cl -= ncl; tbl++;		/* Next fragment */
+	}
+
+	return cl + *tbl;	/* Return the cluster number */
+}
+
+/*
+ * Create the Cluster Link Map Table
+ *
+ * The table lists the fragments of the cluster chain as pairs of
+ * cluster count and start cluster, terminated by a zero count. With the
+ * table in place, reading and seeking no longer follow the FAT. It is
+ * only valid as long as the cluster chain doesn't change, so it can't
+ * be used on files opened for writing.
+ */
+int f_linkmap (
+	FIL *fp		/* Pointer to the file object */
+)
+{
+	FATFS *fs = fp->fs;
+	DWORD cl, pcl, ncl, nfrag = 0, size = 8, *tbl;
+
+	if (fp->flag & FA__ERROR)
+		return -ERESTARTSYS;
+	if (fp->flag & FA_WRITE)
+		return -EROFS;
+	if (fp->cltbl)
+		return 0;
+
+	cl = fp->sclust;
+	if (!cl)
+		return 0;
+
+	tbl = xmalloc(size * sizeof(DWORD));
+
+	do {
+		/* Get a fragment */
+		pcl = cl; ncl = 0;
+		do {
+			pcl = cl; ncl++;
+			cl = get_fat(fs, cl);
+			if (cl <= 1 || cl == 0xFFFFFFFF) {
+				free(tbl);
+				return cl == 0xFFFFFFFF ? -EIO : -ERESTARTSYS;
+			}
+		} while (cl == pcl + 1);
+
+		if (nfrag * 2 + 3 > size) {
+			size *= 2;
+			tbl = xrealloc(tbl, size * sizeof(DWORD));
+		}
+		tbl[nfrag * 2] = ncl;			/* Store the fragment */
+		tbl[nfrag * 2 + 1] = pcl - ncl + 1;
+		nfrag++;
+	} while (cl < fs->n_fatent);			/* Repeat until end of chain */
+
+	tbl[nfrag * 2] = 0;				/* Terminate table */
+	fp->cltbl = tbl;
+
+	return 0;
+}
+#endif
+
+/*
+ * Get the cluster following a cluster of a file
+ */
+static DWORD next_clust (	/* 0xFFFFFFFF:Disk error, 1:Internal error, Else:Cluster status */
+	FIL *fp,	/* Pointer to the file object */
+	DWORD clst,	/* Cluster# to get the following cluster of */
+	DWORD ofs	/* File offset of the following cluster */
+)
+{
+#if _USE_FASTSEEK
+	if (fp->cltbl) {
+		clst = clmt_clust(fp, ofs);
+		return clst ? clst : 1;
+	}
+#endif
+	return get_fat(fp->fs, clst);
+}
+
 /*
  * Read File
  */
@@ -1853,7 +1972,7 @@ int f_read (
 				if (fp->fptr == 0) {		/* On the top of the file? */
 					clst = fp->sclust;	/* Follow from the origin */
 				} else {			/* Middle or end of the file */
-						clst = get_fat(fp->fs, fp->clust);	/* Follow cluster chain on the FAT */
+					clst = next_clust(fp, fp->clust, fp->fptr);	/* Follow cluster chain */
 				}
 				if (clst < 2)
 					ABORT(fp->fs, -ERESTARTSYS);
@@ -1867,9 +1986,21 @@ int f_read (
 			sect += csect;
 			cc = btr / SS(fp->fs);		/* When remaining bytes >= sector size, */
 			if (cc) {			/* Read maximum contiguous sectors directly */
-				if (csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
+				if (csect + cc > fp->fs->csize) {	/* Clip at cluster boundary */
+					UINT ncs = cc;
+
 					cc = fp->fs->csize - csect;
-				if (disk_read(fp->fs, rbuff, sect, (BYTE)cc) != RES_OK)
+					/* Extend over following clusters as long as they are contiguous */
+					while (cc + fp->fs->csize <= ncs) {
+						clst = next_clust(fp, fp->clust,
+								  fp->fptr + cc * SS(fp->fs));
+						if (clst != fp->clust + 1)
+							break;
+						fp->clust = clst;
+						cc += fp->fs->csize;
+					}
+				}
+				if (disk_read(fp->fs, rbuff, sect, cc) != RES_OK)
 					ABORT(fp->fs, -EIO);
 #if defined FS_FAT_WRITE
 				/* Replace one of the read sectors with cached data if it contains a dirty sector */
@@ -2054,18 +2185,21 @@ int f_close (
 	FIL *fp		/* Pointer to the file object to be closed */
 )
 {
-#ifndef FS_FAT_WRITE
-	fp->fs = 0;	/* Discard file object */
-	return 0;
-#else
+#ifdef FS_FAT_WRITE
 	int res;
 
 	/* Flush cached data */
 	res = f_sync(fp);
-	if (res == 0)
-		fp->fs = NULL;	/* Discard file object */
-	return res;
+	if (res)
+		return res;
 #endif
+#if _USE_FASTSEEK
+	free(fp->cltbl);	/* Discard cluster link map table */
+	fp->cltbl = NULL;
+#endif
+	fp->fs = NULL;	/* Discard file object */
+
+	return 0;
 }
 
 /*
@@ -2088,6 +2222,25 @@ int f_lseek (
 #endif
 		) ofs = fp->fsize;
 
+#if _USE_FASTSEEK
+	if (fp->cltbl) {	/* Fast seek */
+		fp->fptr = ofs;
+		if (ofs) {
+			fp->clust = clmt_clust(fp, ofs - 1);
+			nsect = clust2sect(fp->fs, fp->clust);
+			if (!nsect)
+				ABORT(fp->fs, -ERESTARTSYS);
+			nsect += (ofs - 1) / SS(fp->fs) & (fp->fs->csize - 1);
+			if (fp->fptr % SS(fp->fs) && nsect != fp->dsect) {	/* Refill sector cache if needed */
+				if (disk_read(fp->fs, fp->buf, nsect, 1) != RES_OK)
+					ABORT(fp->fs, -EIO);
+				fp->dsect = nsect;
+			}
+		}
+		return 0;
+	}
+#endif
+
 	ifptr = fp->fptr;
 	fp->fptr = nsect = 0;
 	if (ofs) {
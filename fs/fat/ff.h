@@ -109,7 +109,7 @@ typedef struct {
 	BYTE*	dir_ptr;	/* Ponter to the directory entry in the window */
 #endif
 #if _USE_FASTSEEK
-	DWORD*	cltbl;		/* Pointer to the cluster link map table (null on file open) */
+	DWORD*	cltbl;		/* Cluster link map table: {ncl, scl}..., 0 (null on file open) */
 #endif
 #if _FS_SHARE
 	UINT	lockid;		/* File lock ID (index of file semaphore table) */
@@ -161,6 +161,7 @@ int f_open (FATFS*, FIL*, const TCHAR*, BYTE);		/* Open or create a file */
 int f_read (FIL*, void*, UINT, UINT*);			/* Read data from a file */
 int f_lseek (FIL*, DWORD);				/* Move file pointer of a file object */
 int f_close (FIL*);					/* Close an open file object */
+int f_linkmap (FIL*);					/* Create the cluster link map table of a file */
 int f_opendir (FATFS*, FF_DIR*, const TCHAR*);		/* Open an existing directory */
 int f_readdir (FF_DIR*, FILINFO*);			/* Read a directory item */
 int f_stat (FATFS*, const TCHAR*, FILINFO*);		/* Get file status */
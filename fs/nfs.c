@@ -35,6 +35,7 @@
 #include <byteorder.h>
 #include <globalvar.h>
 #include <parseopt.h>
+#include <magicvar.h>
 
 #define SUNRPC_PORT     111
 
@@ -55,6 +56,7 @@
 #define NFSPROC3_READLINK	5
 #define NFSPROC3_READ		6
 #define NFSPROC3_READDIR	16
+#define NFSPROC3_FSINFO		19
 
 #define NFS3_FHSIZE      64
 #define NFS3_COOKIEVERFSIZE	8
@@ -122,6 +124,17 @@ struct rpc_reply {
 #define NFS_TIMEOUT	(100 * MSECOND)
 #define NFS_MAX_RESEND	100
 
+/*
+ * We can't handle IP fragments, so a READ reply must fit into a single
+ * ethernet frame. The reply carries the RPC header, the status, the
+ * post_op_attr (flag + fattr3), count, eof and the opaque data length.
+ */
+#define NFS_READ_REPLY_OVERHEAD	(sizeof(struct rpc_reply) + 4 + 4 + 84 + 4 + 4 + 4)
+#define NFS_RSIZE_MAX	((1500 - sizeof(struct iphdr) - sizeof(struct udphdr) - \
+			  NFS_READ_REPLY_OVERHEAD) & ~3)
+
+#define NFS_READ_WINDOW_MAX	16
+
 struct nfs_fh {
 	unsigned short size;
 	unsigned char data[NFS3_FHSIZE];
@@ -144,6 +157,19 @@ struct nfs_priv {
 	uint32_t rpc_id;
 	struct nfs_fh rootfh;
 	struct list_head packets;
+	uint32_t rsize;
+	unsigned int window;
+	struct list_head files;
+};
+
+/* A READ request in flight */
+struct nfs_read_slot {
+	uint32_t id;		/* RPC xid, 0 if the slot is unused */
+	uint64_t offset;
+	uint32_t len;
+	uint64_t sent;
+	int tries;
+	struct packet *reply;
 };
 
 struct file_priv {
@@ -151,6 +177,11 @@ struct file_priv {
 	void *buf;
 	struct nfs_priv *npriv;
 	struct nfs_fh fh;
+	struct list_head list;
+	loff_t size;
+	uint64_t next_offset;	/* offset of the next READ to be issued */
+	bool eof;
+	struct nfs_read_slot slots[NFS_READ_WINDOW_MAX];
 };
 
 struct nfs_inode {
@@ -172,6 +203,7 @@ static void nfs_set_fh(struct inode *inode, struct nfs_fh *fh)
 }
 
 static uint64_t nfs_timer_start;
+static int nfs_window = 8;
 
 /*
  * common types used in more than one request:
@@ -458,22 +490,16 @@ static void nfs_free_packet(struct packet *packet)
 }
 
 /*
- * rpc_req - synchronous RPC request
+ * rpc_send - send a RPC request without waiting for the reply
  */
-static struct packet *rpc_req(struct nfs_priv *npriv, int rpc_prog,
-			      int rpc_proc, uint32_t *data, int datalen)
+static int rpc_send(struct nfs_priv *npriv, int rpc_prog, int rpc_proc,
+		    uint32_t rpc_id, uint32_t *data, int datalen)
 {
 	struct rpc_call pkt;
 	unsigned short dport;
-	int ret;
 	unsigned char *payload = net_udp_get_payload(npriv->con);
-	int nfserr;
-	int tries = 0;
-	struct packet *packet;
-
-	npriv->rpc_id++;
 
-	pkt.id = hton32(npriv->rpc_id);
+	pkt.id = hton32(rpc_id);
 	pkt.type = hton32(MSG_CALL);
 	pkt.rpcvers = hton32(2);	/* use RPC version 2 */
 	pkt.prog = hton32(rpc_prog);
@@ -497,11 +523,27 @@ static struct packet *rpc_req(struct nfs_priv *npriv, int rpc_prog,
 
 	npriv->con->udp->uh_dport = hton16(dport);
 
+	return net_udp_send(npriv->con,
+			sizeof(pkt) + datalen * sizeof(uint32_t));
+}
+
+/*
+ * rpc_req - synchronous RPC request
+ */
+static struct packet *rpc_req(struct nfs_priv *npriv, int rpc_prog,
+			      int rpc_proc, uint32_t *data, int datalen)
+{
+	int ret;
+	int nfserr;
+	int tries = 0;
+	struct packet *packet;
+
+	npriv->rpc_id++;
+
 	nfs_timer_start = get_time_ns();
 
 again:
-	ret = net_udp_send(npriv->con,
-			sizeof(pkt) + datalen * sizeof(uint32_t));
+	ret = rpc_send(npriv, rpc_prog, rpc_proc, npriv->rpc_id, data, datalen);
 	if (ret) {
 		if (is_timeout(nfs_timer_start, NFS_TIMEOUT)) {
 			tries++;
@@ -964,16 +1006,65 @@ static void *nfs_readdirattr_req(struct nfs_priv *npriv, struct nfs_dir *dir)
 }
 
 /*
- * nfs_read_req - Read File on NFS Server
+ * nfs_fsinfo_req - Query the maximum READ size supported by the server
  */
-static int nfs_read_req(struct file_priv *priv, uint64_t offset,
-		uint32_t readlen)
+static int nfs_fsinfo_req(struct nfs_priv *npriv)
 {
 	uint32_t data[1024];
-	uint32_t *p, status;
-	int len, ret;
+	uint32_t *p, rtmax;
+	int len;
 	struct packet *nfs_packet;
-	uint32_t rlen, eof;
+
+	/*
+	 * struct FSINFO3args {
+	 * 	nfs_fh3 fsroot;
+	 * };
+	 *
+	 * struct FSINFO3resok {
+	 * 	post_op_attr obj_attributes;
+	 * 	uint32 rtmax;
+	 * 	uint32 rtpref;
+	 * 	uint32 rtmult;
+	 * 	uint32 wtmax;
+	 * 	uint32 wtpref;
+	 * 	uint32 wtmult;
+	 * 	uint32 dtpref;
+	 * 	size3 maxfilesize;
+	 * 	nfstime3 time_delta;
+	 * 	uint32 properties;
+	 * };
+	 */
+	p = &(data[0]);
+	p = rpc_add_credentials(p);
+
+	p = nfs_add_fh3(p, &npriv->rootfh);
+
+	len = p - &(data[0]);
+
+	nfs_packet = rpc_req(npriv, PROG_NFS, NFSPROC3_FSINFO, data, len);
+	if (IS_ERR(nfs_packet))
+		return PTR_ERR(nfs_packet);
+
+	/* skip over status */
+	p = (void *)nfs_packet->data + sizeof(struct rpc_reply) + 4;
+
+	p = nfs_read_post_op_attr(p, NULL);
+
+	rtmax = ntoh32(net_read_uint32(p));
+
+	nfs_free_packet(nfs_packet);
+
+	return rtmax;
+}
+
+/*
+ * nfs_read_send - (Re)send the READ request of a slot
+ */
+static void nfs_read_send(struct file_priv *priv, struct nfs_read_slot *slot)
+{
+	uint32_t data[1024];
+	uint32_t *p;
+	int len;
 
 	/*
 	 * struct READ3args {
@@ -981,7 +1072,128 @@ static int nfs_read_req(struct file_priv *priv, uint64_t offset,
 	 * 	offset3 offset;
 	 * 	count3 count;
 	 * };
-	 *
+	 */
+	p = &(data[0]);
+	p = rpc_add_credentials(p);
+
+	p = nfs_add_fh3(p, &priv->fh);
+	p = nfs_add_uint64(p, slot->offset);
+	p = nfs_add_uint32(p, slot->len);
+
+	len = p - &(data[0]);
+
+	slot->sent = get_time_ns();
+
+	/* A failed send is handled like a lost packet and resent on timeout */
+	rpc_send(priv->npriv, PROG_NFS, NFSPROC3_READ, slot->id, data, len);
+}
+
+static void nfs_read_cancel(struct file_priv *priv)
+{
+	int i;
+
+	for (i = 0; i < NFS_READ_WINDOW_MAX; i++) {
+		struct nfs_read_slot *slot = &priv->slots[i];
+
+		free(slot->reply);
+		slot->reply = NULL;
+		slot->id = 0;
+	}
+}
+
+/*
+ * nfs_read_fill_window - Issue READ requests for all unused slots
+ *
+ * Requests are issued for consecutive chunks of the file without waiting
+ * for the replies, so that up to npriv->window requests are in flight.
+ */
+static void nfs_read_fill_window(struct file_priv *priv)
+{
+	struct nfs_priv *npriv = priv->npriv;
+	int i;
+
+	for (i = 0; i < npriv->window; i++) {
+		struct nfs_read_slot *slot = &priv->slots[i];
+
+		if (slot->id)
+			continue;
+
+		if (priv->eof || priv->next_offset >= priv->size)
+			return;
+
+		if (!++npriv->rpc_id)
+			npriv->rpc_id++;
+
+		slot->id = npriv->rpc_id;
+		slot->offset = priv->next_offset;
+		slot->len = min_t(uint64_t, npriv->rsize,
+				  priv->size - priv->next_offset);
+		slot->tries = 0;
+		slot->reply = NULL;
+
+		priv->next_offset += slot->len;
+
+		nfs_read_send(priv, slot);
+	}
+}
+
+static struct nfs_read_slot *nfs_read_find_slot(struct file_priv *priv,
+						uint64_t offset)
+{
+	int i;
+
+	for (i = 0; i < priv->npriv->window; i++) {
+		struct nfs_read_slot *slot = &priv->slots[i];
+
+		if (slot->id && slot->offset == offset)
+			return slot;
+	}
+
+	return NULL;
+}
+
+/*
+ * nfs_read_claim - Hand over a received packet to a pending READ slot
+ *
+ * READ replies may arrive in any order, so they are matched against the
+ * outstanding requests of all open files by their RPC xid.
+ */
+static bool nfs_read_claim(struct nfs_priv *npriv, struct packet *packet)
+{
+	struct file_priv *priv;
+	uint32_t id;
+	int i;
+
+	if (packet->len < sizeof(struct rpc_reply))
+		return false;
+
+	id = ntoh32(net_read_uint32(packet->data));
+
+	list_for_each_entry(priv, &npriv->files, list) {
+		for (i = 0; i < npriv->window; i++) {
+			struct nfs_read_slot *slot = &priv->slots[i];
+
+			if (slot->id == id && !slot->reply) {
+				slot->reply = packet;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+/*
+ * nfs_read_reply - Process the reply of a READ request
+ */
+static int nfs_read_reply(struct file_priv *priv, struct nfs_read_slot *slot)
+{
+	struct packet *nfs_packet = slot->reply;
+	uint32_t *p;
+	int ret, nfserr;
+	uint32_t rlen, eof;
+
+	/*
 	 * struct READ3resok {
 	 * 	post_op_attr file_attributes;
 	 * 	count3 count;
@@ -1000,26 +1212,22 @@ static int nfs_read_req(struct file_priv *priv, uint64_t offset,
 	 * 	READ3resfail resfail;
 	 * };
 	 */
-	p = &(data[0]);
-	p = rpc_add_credentials(p);
-
-	p = nfs_add_fh3(p, &priv->fh);
-	p = nfs_add_uint64(p, offset);
-	p = nfs_add_uint32(p, readlen);
+	ret = rpc_check_reply(nfs_packet, PROG_NFS, slot->id, &nfserr);
 
-	len = p - &(data[0]);
+	slot->reply = NULL;
+	slot->id = 0;
 
-	nfs_packet = rpc_req(priv->npriv, PROG_NFS, NFSPROC3_READ, data, len);
-	if (IS_ERR(nfs_packet))
-		return PTR_ERR(nfs_packet);
+	if (ret)
+		goto out;
 
-	p = (void *)nfs_packet->data + sizeof(struct rpc_reply);
-	status = ntoh32(net_read_uint32(p++));
-	if (status != NFS3_OK) {
-		pr_err("Read failed: %s\n", nfserrstr(status, &ret));
-		return ret;
+	if (nfserr) {
+		pr_err("Read failed: %s\n", nfserrstr(-nfserr, &ret));
+		goto out;
 	}
 
+	/* skip over status */
+	p = (void *)nfs_packet->data + sizeof(struct rpc_reply) + 4;
+
 	p = nfs_read_post_op_attr(p, NULL);
 
 	rlen = ntoh32(net_read_uint32(p));
@@ -1035,14 +1243,81 @@ static int nfs_read_req(struct file_priv *priv, uint64_t offset,
 	 */
 	p += 2;
 
-	if (readlen && !rlen && !eof) {
-		nfs_free_packet(nfs_packet);
-		return -EIO;
+	if ((slot->len && !rlen && !eof) || rlen > slot->len ||
+	    (void *)p + rlen > (void *)nfs_packet->data + nfs_packet->len) {
+		ret = -EIO;
+		goto out;
 	}
 
 	kfifo_put(priv->fifo, (char *)p, rlen);
 
-	nfs_free_packet(nfs_packet);
+	/*
+	 * The requests following a short read do not start where this one
+	 * ended, so drop them and continue directly after the received data.
+	 */
+	if (eof || rlen < slot->len) {
+		nfs_read_cancel(priv);
+		priv->next_offset = slot->offset + rlen;
+		priv->eof = eof;
+	}
+
+	ret = 0;
+out:
+	free(nfs_packet);
+
+	return ret;
+}
+
+/*
+ * nfs_read_req - Read File on NFS Server
+ *
+ * Waits for the data at @offset to arrive and puts it into the fifo. The
+ * window is refilled afterwards, so the following requests are already in
+ * flight while the caller consumes the data.
+ */
+static int nfs_read_req(struct file_priv *priv, uint64_t offset)
+{
+	struct nfs_read_slot *slot;
+	int i, ret;
+
+	slot = nfs_read_find_slot(priv, offset);
+	if (!slot) {
+		nfs_read_cancel(priv);
+		priv->next_offset = offset;
+		priv->eof = false;
+		nfs_read_fill_window(priv);
+
+		slot = nfs_read_find_slot(priv, offset);
+		if (!slot)
+			return 0;
+	}
+
+	while (!slot->reply) {
+		net_poll();
+
+		for (i = 0; i < priv->npriv->window; i++) {
+			struct nfs_read_slot *s = &priv->slots[i];
+
+			if (!s->id || s->reply ||
+			    !is_timeout(s->sent, NFS_TIMEOUT))
+				continue;
+
+			if (++s->tries == NFS_MAX_RESEND) {
+				nfs_read_cancel(priv);
+				return -ETIMEDOUT;
+			}
+
+			nfs_read_send(priv, s);
+		}
+	}
+
+	ret = nfs_read_reply(priv, slot);
+	if (ret) {
+		nfs_read_cancel(priv);
+		return ret;
+	}
+
+	nfs_read_fill_window(priv);
 
 	return 0;
 }
@@ -1053,10 +1328,16 @@ static void nfs_handler(void *ctx, char *p, unsigned len)
 	struct nfs_priv *npriv = ctx;
 	struct packet *packet;
 
+	/* len covers the whole frame, we only store the UDP payload */
+	len = min_t(unsigned, net_eth_to_udplen(p), len - (pkt - p));
+
 	packet = xmalloc(sizeof(*packet) + len);
 	memcpy(packet->data, pkt, len);
 	packet->len = len;
 
+	if (nfs_read_claim(npriv, packet))
+		return;
+
 	list_add_tail(&packet->list, &npriv->packets);
 }
 
@@ -1067,6 +1348,9 @@ static int nfs_truncate(struct device_d *dev, FILE *f, loff_t size)
 
 static void nfs_do_close(struct file_priv *priv)
 {
+	list_del(&priv->list);
+	nfs_read_cancel(priv);
+
 	if (priv->fifo)
 		kfifo_free(priv->fifo);
 
@@ -1163,13 +1447,16 @@ static int nfs_open(struct device_d *dev, FILE *file, const char *filename)
 	priv->npriv = npriv;
 	file->priv = priv;
 	file->size = inode->i_size;
+	priv->size = inode->i_size;
 
-	priv->fifo = kfifo_alloc(1024);
+	priv->fifo = kfifo_alloc(npriv->rsize);
 	if (!priv->fifo) {
 		free(priv);
 		return -ENOMEM;
 	}
 
+	list_add_tail(&priv->list, &npriv->files);
+
 	return 0;
 }
 
@@ -1192,11 +1479,8 @@ static int nfs_read(struct device_d *dev, FILE *file, void *buf, size_t insize)
 {
 	struct file_priv *priv = file->priv;
 
-	if (insize > 1024)
-		insize = 1024;
-
 	if (insize && !kfifo_len(priv->fifo)) {
-		int ret = nfs_read_req(priv, file->pos, insize);
+		int ret = nfs_read_req(priv, file->pos);
 		if (ret)
 			return ret;
 	}
@@ -1209,6 +1493,7 @@ static int nfs_lseek(struct device_d *dev, FILE *file, loff_t pos)
 	struct file_priv *priv = file->priv;
 
 	kfifo_reset(priv->fifo);
+	nfs_read_cancel(priv);
 
 	return 0;
 }
@@ -1428,11 +1713,13 @@ static int nfs_probe(struct device_d *dev)
 	char *tmp = xstrdup(fsdev->backingstore);
 	char *path;
 	struct inode *inode;
+	unsigned short opt;
 	int ret;
 
 	dev->priv = npriv;
 
 	INIT_LIST_HEAD(&npriv->packets);
+	INIT_LIST_HEAD(&npriv->files);
 
 	debug("nfs: mount: %s\n", fsdev->backingstore);
 
@@ -1495,6 +1782,24 @@ static int nfs_probe(struct device_d *dev)
 		goto err2;
 	}
 
+	npriv->rsize = NFS_RSIZE_MAX;
+	ret = nfs_fsinfo_req(npriv);
+	if (ret > 0)
+		npriv->rsize = min_t(uint32_t, npriv->rsize, ret);
+
+	opt = 0;
+	parseopt_hu(fsdev->options, "rsize", &opt);
+	if (opt)
+		npriv->rsize = min_t(uint32_t, npriv->rsize, opt);
+
+	npriv->rsize = max_t(uint32_t, npriv->rsize & ~3, 4);
+
+	opt = nfs_window;
+	parseopt_hu(fsdev->options, "window", &opt);
+	npriv->window = clamp_t(unsigned int, opt, 1, NFS_READ_WINDOW_MAX);
+
+	debug("rsize: %u window: %u\n", npriv->rsize, npriv->window);
+
 	nfs_set_rootarg(npriv, fsdev);
 
 	free(tmp);
@@ -1551,7 +1856,11 @@ static int nfs_init(void)
 	rootnfsopts = xstrdup("v3,tcp");
 
 	globalvar_add_simple_string("linux.rootnfsopts", &rootnfsopts);
+	globalvar_add_simple_int("nfs.window", &nfs_window, "%u");
 
 	return register_fs_driver(&nfs_driver);
 }
 coredevice_initcall(nfs_init);
+
+BAREBOX_MAGICVAR(global.nfs.window,
+		 "Default number of NFS READ requests kept in flight");
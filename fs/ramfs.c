@@ -24,14 +24,21 @@
 #include <linux/stat.h>
 #include <xfuncs.h>
 #include <linux/sizes.h>
+#include <linux/rbtree.h>
 
-#define CHUNK_SIZE	(4096 * 2)
-
+/*
+ * File data is stored in chunks kept in an rbtree sorted by their offset.
+ * Files grow geometrically: the last chunk is extended with realloc() by at
+ * least the current file size, so that files written in small pieces (tftp)
+ * still end up in a single chunk which can be memory mapped. Only when that
+ * fails, new chunks are added. With the dummy allocator, which has no
+ * realloc(), files always grow by adding chunks.
+ */
 struct ramfs_chunk {
 	char *data;
 	unsigned long ofs;
-	int size;
-	struct list_head list;
+	unsigned long size;
+	struct rb_node node;
 };
 
 struct ramfs_inode {
@@ -45,7 +52,8 @@ struct ramfs_inode {
 	/* bytes currently allocated for this inode */
 	unsigned long alloc_size;
 
-	struct list_head data;
+	/* ramfs_chunks sorted by offset */
+	struct rb_root chunks;
 
 	struct ramfs_chunk *current_chunk;
 };
@@ -106,7 +114,7 @@ static struct ramfs_chunk *ramfs_get_chunk(unsigned long size)
 	if (size < MIN_SIZE)
 		size = MIN_SIZE;
 
-	data->data = calloc(size, 1);
+	data->data = malloc(size);
 	if (!data->data) {
 		free(data);
 		return NULL;
@@ -195,30 +203,112 @@ static const struct inode_operations ramfs_dir_inode_operations =
 	.create = ramfs_create,
 };
 
-static struct ramfs_chunk *ramfs_find_chunk(struct ramfs_inode *node,
-					    unsigned long pos, int *ofs, int *len)
+static inline bool ramfs_chunk_contains(struct ramfs_chunk *data,
+					unsigned long pos)
+{
+	return pos >= data->ofs && pos - data->ofs < data->size;
+}
+
+static struct ramfs_chunk *ramfs_lookup_chunk(struct ramfs_inode *node,
+					      unsigned long pos)
 {
 	struct ramfs_chunk *data, *cur = node->current_chunk;
+	struct rb_node *n;
+
+	/* fast path for sequential access */
+	if (cur) {
+		if (ramfs_chunk_contains(cur, pos))
+			return cur;
+
+		n = rb_next(&cur->node);
+		if (n) {
+			data = rb_entry(n, struct ramfs_chunk, node);
+			if (ramfs_chunk_contains(data, pos))
+				return data;
+		}
+	}
 
-	if (cur && pos >= cur->ofs)
-		data = cur;
-	else
-		data = list_first_entry(&node->data, struct ramfs_chunk, list);
+	n = node->chunks.rb_node;
+	while (n) {
+		data = rb_entry(n, struct ramfs_chunk, node);
+
+		if (pos < data->ofs)
+			n = n->rb_left;
+		else if (pos - data->ofs >= data->size)
+			n = n->rb_right;
+		else
+			return data;
+	}
 
-	list_for_each_entry_from(data, &node->data, list) {
-		if (data->ofs + data->size > pos) {
-			*ofs = pos - data->ofs;
-			*len = data->ofs + data->size - pos;
+	return NULL;
+}
 
-			node->current_chunk = data;
+static struct ramfs_chunk *ramfs_find_chunk(struct ramfs_inode *node,
+					    unsigned long pos,
+					    unsigned long *ofs,
+					    unsigned long *len)
+{
+	struct ramfs_chunk *data;
 
-			return data;
-		}
+	data = ramfs_lookup_chunk(node, pos);
+	if (!data) {
+		pr_err("%s: no chunk for pos %ld found\n", __func__, pos);
+		return NULL;
 	}
 
-	pr_err("%s: no chunk for pos %ld found\n", __func__, pos);
+	*ofs = pos - data->ofs;
+	*len = data->size - *ofs;
 
-	return NULL;
+	node->current_chunk = data;
+
+	return data;
+}
+
+static void ramfs_insert_chunk(struct ramfs_inode *node,
+			       struct ramfs_chunk *data)
+{
+	struct rb_node **p = &node->chunks.rb_node, *parent = NULL;
+
+	while (*p) {
+		struct ramfs_chunk *cur = rb_entry(*p, struct ramfs_chunk, node);
+
+		parent = *p;
+		if (data->ofs < cur->ofs)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+
+	rb_link_node(&data->node, parent, p);
+	rb_insert_color(&data->node, &node->chunks);
+}
+
+static struct ramfs_chunk *ramfs_last_chunk(struct ramfs_inode *node)
+{
+	struct rb_node *n = rb_last(&node->chunks);
+
+	return n ? rb_entry(n, struct ramfs_chunk, node) : NULL;
+}
+
+/*
+ * Zero the range [start, end) of a file. Data is allocated uninitialized,
+ * so this has to be done whenever a file grows.
+ */
+static void ramfs_zero_range(struct ramfs_inode *node, unsigned long start,
+			     unsigned long end)
+{
+	struct ramfs_chunk *data;
+	unsigned long ofs, len, now;
+
+	while (start < end) {
+		data = ramfs_find_chunk(node, start, &ofs, &len);
+		if (!data)
+			return;
+
+		now = min(end - start, len);
+		memset(data->data + ofs, 0, now);
+		start += now;
+	}
 }
 
 static int ramfs_read(struct device_d *_dev, FILE *f, void *buf, size_t insize)
@@ -226,9 +316,9 @@ static int ramfs_read(struct device_d *_dev, FILE *f, void *buf, size_t insize)
 	struct inode *inode = f->f_inode;
 	struct ramfs_inode *node = to_ramfs_inode(inode);
 	struct ramfs_chunk *data;
-	int ofs, len, now;
+	unsigned long ofs, len, now;
 	unsigned long pos = f->pos;
-	int size = insize;
+	size_t size = insize;
 
 	debug("%s: %p %zu @ %lld\n", __func__, node, insize, f->pos);
 
@@ -237,7 +327,7 @@ static int ramfs_read(struct device_d *_dev, FILE *f, void *buf, size_t insize)
 		if (!data)
 			return -EINVAL;
 
-		debug("%s: pos: %lu ofs: %d len: %d\n", __func__, pos, ofs, len);
+		debug("%s: pos: %lu ofs: %lu len: %lu\n", __func__, pos, ofs, len);
 
 		now = min(size, len);
 
@@ -256,9 +346,9 @@ static int ramfs_write(struct device_d *_dev, FILE *f, const void *buf, size_t i
 	struct inode *inode = f->f_inode;
 	struct ramfs_inode *node = to_ramfs_inode(inode);
 	struct ramfs_chunk *data;
-	int ofs, len, now;
+	unsigned long ofs, len, now;
 	unsigned long pos = f->pos;
-	int size = insize;
+	size_t size = insize;
 
 	debug("%s: %p %zu @ %lld\n", __func__, node, insize, f->pos);
 
@@ -267,7 +357,7 @@ static int ramfs_write(struct device_d *_dev, FILE *f, const void *buf, size_t i
 		if (!data)
 			return -EINVAL;
 
-		debug("%s: pos: %lu ofs: %d len: %d\n", __func__, pos, ofs, len);
+		debug("%s: pos: %lu ofs: %lu len: %lu\n", __func__, pos, ofs, len);
 
 		now = min(size, len);
 
@@ -283,29 +373,45 @@ static int ramfs_write(struct device_d *_dev, FILE *f, const void *buf, size_t i
 
 static void ramfs_truncate_down(struct ramfs_inode *node, unsigned long size)
 {
-	struct ramfs_chunk *data, *tmp;
+	struct ramfs_chunk *data;
 
-	list_for_each_entry_safe(data, tmp, &node->data, list) {
-		if (data->ofs >= size) {
-			list_del(&data->list);
-			node->alloc_size -= data->size;
-			ramfs_put_chunk(data);
-		}
+	while ((data = ramfs_last_chunk(node)) && data->ofs >= size) {
+		rb_erase(&data->node, &node->chunks);
+		node->alloc_size -= data->size;
+		ramfs_put_chunk(data);
 	}
 
 	node->current_chunk = NULL;
 }
 
-static int ramfs_truncate_up(struct ramfs_inode *node, unsigned long size)
+/*
+ * Try to grow the last chunk in place (or by moving it) so that the file
+ * stays contiguous.
+ */
+static int ramfs_extend_last_chunk(struct ramfs_inode *node, unsigned long add)
 {
-	struct ramfs_chunk *data, *tmp;
-	LIST_HEAD(list);
-	unsigned long add = size - node->alloc_size;
-	unsigned long chunksize = add;
-	unsigned long alloc_size = 0;
+	struct ramfs_chunk *data = ramfs_last_chunk(node);
+	char *buf;
 
-	if (node->alloc_size >= size)
-		return 0;
+	if (!data)
+		return -ENOENT;
+
+	buf = realloc(data->data, data->size + add);
+	if (!buf)
+		return -ENOMEM;
+
+	data->data = buf;
+	data->size += add;
+	node->alloc_size += add;
+
+	return 0;
+}
+
+static int ramfs_add_chunks(struct ramfs_inode *node, unsigned long add)
+{
+	struct ramfs_chunk *data;
+	unsigned long chunksize = add;
+	unsigned long alloc_size = node->alloc_size;
 
 	/*
 	 * We first try to allocate all space we need in a single chunk.
@@ -328,11 +434,10 @@ static int ramfs_truncate_up(struct ramfs_inode *node, unsigned long size)
 			continue;
 		}
 
-		data->ofs = node->alloc_size + alloc_size;
+		data->ofs = node->alloc_size;
+		node->alloc_size += data->size;
 
-		alloc_size += data->size;
-
-		list_add_tail(&data->list, &list);
+		ramfs_insert_chunk(node, data);
 
 		if (add <= data->size)
 			break;
@@ -340,21 +445,39 @@ static int ramfs_truncate_up(struct ramfs_inode *node, unsigned long size)
 		add -= data->size;
 	}
 
-	list_splice_tail(&list, &node->data);
-
-	node->alloc_size += alloc_size;
-
 	return 0;
 
 out:
-	list_for_each_entry_safe(data, tmp, &list, list) {
-		list_del(&data->list);
-		ramfs_put_chunk(data);
-	}
+	ramfs_truncate_down(node, alloc_size);
 
 	return -ENOSPC;
 }
 
+static int ramfs_truncate_up(struct ramfs_inode *node, unsigned long size)
+{
+	unsigned long add, grow;
+
+	if (node->alloc_size >= size)
+		return 0;
+
+	add = size - node->alloc_size;
+
+	/* the dummy allocator has no realloc() and never frees memory */
+	if (IS_ENABLED(CONFIG_MALLOC_DUMMY))
+		return ramfs_add_chunks(node, add);
+
+	/* grow by at least the current size to keep the number of reallocs low */
+	grow = max(add, node->alloc_size);
+
+	if (grow > add && (!ramfs_extend_last_chunk(node, grow) ||
+			   !ramfs_add_chunks(node, grow)))
+		return 0;
+	if (!ramfs_extend_last_chunk(node, add))
+		return 0;
+
+	return ramfs_add_chunks(node, add);
+}
+
 static int ramfs_truncate(struct device_d *dev, FILE *f, loff_t size)
 {
 	struct inode *inode = f->f_inode;
@@ -380,6 +503,8 @@ static int ramfs_truncate(struct device_d *dev, FILE *f, loff_t size)
 		ret = ramfs_truncate_up(node, size);
 		if (ret)
 			return ret;
+
+		ramfs_zero_range(node, node->size, size);
 	}
 
 	node->size = size;
@@ -387,20 +512,51 @@ static int ramfs_truncate(struct device_d *dev, FILE *f, loff_t size)
 	return 0;
 }
 
+/*
+ * Give back what geometric growth allocated in excess once a file is no
+ * longer written to. Shrinking with realloc() does not move the data.
+ */
+static int ramfs_close(struct device_d *dev, FILE *f)
+{
+	struct ramfs_inode *node = to_ramfs_inode(f->f_inode);
+	struct ramfs_chunk *data = ramfs_last_chunk(node);
+	unsigned long size;
+	char *buf;
+
+	if (IS_ENABLED(CONFIG_MALLOC_DUMMY))
+		return 0;
+
+	if (!data || data->ofs + data->size - node->size < MIN_SIZE)
+		return 0;
+
+	size = max_t(unsigned long, node->size - data->ofs, MIN_SIZE);
+
+	buf = realloc(data->data, size);
+	if (!buf)
+		return 0;
+
+	node->alloc_size -= data->size - size;
+	data->data = buf;
+	data->size = size;
+
+	return 0;
+}
+
 static int ramfs_memmap(struct device_d *_dev, FILE *f, void **map, int flags)
 {
 	struct inode *inode = f->f_inode;
 	struct ramfs_inode *node = to_ramfs_inode(inode);
+	struct rb_node *n = rb_first(&node->chunks);
 	struct ramfs_chunk *data;
 
-	if (list_empty(&node->data))
+	if (!n)
 		return -EINVAL;
 
-	if (!list_is_singular(&node->data))
+	/* only possible when the whole file is in one chunk */
+	data = rb_entry(n, struct ramfs_chunk, node);
+	if (data->size < node->size)
 		return -EINVAL;
 
-	data = list_first_entry(&node->data, struct ramfs_chunk, list);
-
 	*map = data->data;
 
 	return 0;
@@ -412,7 +568,7 @@ static struct inode *ramfs_alloc_inode(struct super_block *sb)
 
 	node = xzalloc(sizeof(*node));
 
-	INIT_LIST_HEAD(&node->data);
+	node->chunks = RB_ROOT;
 
 	return &node->inode;
 }
@@ -452,6 +608,7 @@ static void ramfs_remove(struct device_d *dev)
 static struct fs_driver_d ramfs_driver = {
 	.read      = ramfs_read,
 	.write     = ramfs_write,
+	.close     = ramfs_close,
 	.memmap    = ramfs_memmap,
 	.truncate  = ramfs_truncate,
 	.flags     = FS_DRIVER_NO_DEV,
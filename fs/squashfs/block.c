@@ -168,6 +168,7 @@ int squashfs_read_data(struct super_block *sb, u64 index, int length,
 			output);
 		if (length < 0)
 			goto read_failure;
+		msblk->bytes_decompressed += length;
 	} else {
 		/*
 		 * Block is uncompressed.
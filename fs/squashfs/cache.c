@@ -68,6 +68,7 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		}
 
 		if (n == cache->entries) {
+			cache->misses++;
 
 			/*
 			 * At least one unused cache entry.  A simple
@@ -111,6 +112,7 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		 * previously unused there's one less cache entry available
 		 * for reuse.
 		 */
+		cache->hits++;
 		entry = &cache->entry[i];
 		if (entry->refcount == 0)
 			cache->unused--;
@@ -130,6 +132,34 @@ out:
 }
 
 
+/*
+ * Look-up block in cache without reading it on a miss.  If found, the usage
+ * count is incremented and the entry has to be released with
+ * squashfs_cache_put(), otherwise NULL is returned.
+ */
+struct squashfs_cache_entry *squashfs_cache_lookup(struct squashfs_cache *cache,
+	u64 block)
+{
+	struct squashfs_cache_entry *entry;
+	int i;
+
+	for (i = 0; i < cache->entries; i++) {
+		entry = &cache->entry[i];
+		if (entry->block != block || entry->error)
+			continue;
+
+		cache->hits++;
+		if (entry->refcount == 0)
+			cache->unused--;
+		entry->refcount++;
+
+		return entry;
+	}
+
+	return NULL;
+}
+
+
 /*
  * Release cache entry, once usage count is zero it can be reused.
  */
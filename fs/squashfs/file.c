@@ -46,6 +46,7 @@
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
+#include "page_actor.h"
 
 /*
  * Locate cache slot in range [offset, index] for specified inode.  If
@@ -356,7 +357,7 @@ void squashfs_copy_cache(struct page *page, struct squashfs_cache_entry *buffer,
 	 * grab the pages from the page cache, except for the page that we've
 	 * been called to fill.
 	 */
-	for (i = 0; i < 32 && bytes > 0; i++,
+	for (i = 0; i < sq_page->pages && bytes > 0; i++,
 			bytes -= PAGE_CACHE_SIZE, offset += PAGE_CACHE_SIZE) {
 		int avail = buffer ? min_t(int, bytes, PAGE_CACHE_SIZE) : 0;
 
@@ -443,3 +444,71 @@ out:
 
 	return 0;
 }
+
+/*
+ * Read the full datablock @index of a file straight into @buf, which must be
+ * block_size bytes large. A cached copy of the block is used if there is one,
+ * otherwise the block is decompressed into @buf directly, without going
+ * through (and evicting entries of) the data cache.
+ *
+ * Returns 0 on success, 1 if the block has to be read through the page
+ * buffers (it is stored in a fragment or it is the partial last block) and
+ * a negative error code otherwise.
+ */
+int squashfs_read_block_direct(struct inode *inode, int index, void *buf)
+{
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int file_end = i_size_read(inode) >> msblk->block_log;
+	int pages = msblk->block_size >> PAGE_CACHE_SHIFT;
+	struct squashfs_cache_entry *entry;
+	struct squashfs_page_actor *actor;
+	void **data;
+	u64 block = 0;
+	int bsize, res, i;
+
+	if (index >= file_end)
+		return 1;
+
+	bsize = read_blocklist(inode, index, &block);
+	if (bsize < 0)
+		return bsize;
+
+	if (bsize == 0) {
+		memset(buf, 0, msblk->block_size);
+		return 0;
+	}
+
+	entry = squashfs_cache_lookup(msblk->read_page, block);
+	if (entry) {
+		res = squashfs_copy_data(buf, entry, 0, msblk->block_size);
+		squashfs_cache_put(entry);
+		return res == msblk->block_size ? 0 : -EIO;
+	}
+
+	data = kcalloc(pages, sizeof(void *), GFP_KERNEL);
+	if (data == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < pages; i++)
+		data[i] = buf + i * PAGE_CACHE_SIZE;
+
+	actor = squashfs_page_actor_init(data, pages, 0);
+	if (actor == NULL) {
+		kfree(data);
+		return -ENOMEM;
+	}
+
+	res = squashfs_read_data(inode->i_sb, block, bsize, NULL, actor);
+
+	kfree(actor);
+	kfree(data);
+
+	if (res < 0)
+		return res;
+	if (res != msblk->block_size)
+		return -EIO;
+
+	msblk->direct_reads++;
+
+	return 0;
+}
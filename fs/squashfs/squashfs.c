@@ -88,6 +88,37 @@ static const struct super_operations squashfs_super_ops = {
 	.destroy_inode = squashfs_destroy_inode,
 };
 
+static void squashfs_add_cache_params(struct device_d *dev,
+				      struct squashfs_cache *cache)
+{
+	char *name;
+
+	if (!cache)
+		return;
+
+	name = basprintf("%s_cache_hits", cache->name);
+	dev_add_param_uint32_ro(dev, name, &cache->hits, "%u");
+	free(name);
+
+	name = basprintf("%s_cache_misses", cache->name);
+	dev_add_param_uint32_ro(dev, name, &cache->misses, "%u");
+	free(name);
+}
+
+static void squashfs_add_params(struct fs_device_d *fsdev)
+{
+	struct squashfs_sb_info *msblk = fsdev->sb.s_fs_info;
+	struct device_d *dev = &fsdev->dev;
+
+	squashfs_add_cache_params(dev, msblk->block_cache);
+	squashfs_add_cache_params(dev, msblk->fragment_cache);
+	squashfs_add_cache_params(dev, msblk->read_page);
+	dev_add_param_uint32_ro(dev, "direct_reads", &msblk->direct_reads,
+				"%u");
+	dev_add_param_uint64_ro(dev, "bytes_decompressed",
+				&msblk->bytes_decompressed, "%llu");
+}
+
 static int squashfs_probe(struct device_d *dev)
 {
 	struct fs_device_d *fsdev;
@@ -110,6 +141,7 @@ static int squashfs_probe(struct device_d *dev)
 	}
 
 	squashfs_set_rootarg(fsdev);
+	squashfs_add_params(fsdev);
 
 	return 0;
 
@@ -132,12 +164,14 @@ static void squashfs_remove(struct device_d *dev)
 static int squashfs_open(struct device_d *dev, FILE *file, const char *filename)
 {
 	struct inode *inode = file->f_inode;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
 	struct squashfs_page *page;
 	int i;
 
 	page = malloc(sizeof(struct squashfs_page));
-	page->buf = calloc(32, sizeof(*page->buf));
-	for (i = 0; i < 32; i++) {
+	page->pages = msblk->block_size >> PAGE_CACHE_SHIFT;
+	page->buf = calloc(page->pages, sizeof(*page->buf));
+	for (i = 0; i < page->pages; i++) {
 		page->buf[i] = malloc(PAGE_CACHE_SIZE);
 		if (page->buf[i] == NULL) {
 			dev_err(dev, "error allocation read buffer\n");
@@ -168,7 +202,7 @@ static int squashfs_close(struct device_d *dev, FILE *f)
 	struct squashfs_page *page = f->priv;
 	int i;
 
-	for (i = 0; i < 32; i++)
+	for (i = 0; i < page->pages; i++)
 		free(page->buf[i]);
 
 	free(page->buf);
@@ -179,13 +213,14 @@ static int squashfs_close(struct device_d *dev, FILE *f)
 
 static int squashfs_read_buf(struct squashfs_page *page, int pos, void **buf)
 {
-	unsigned int data_block = pos / (32 * PAGE_CACHE_SIZE);
-	unsigned int data_block_pos = pos % (32 * PAGE_CACHE_SIZE);
+	struct squashfs_sb_info *msblk = page->real_page.inode->i_sb->s_fs_info;
+	unsigned int data_block = pos >> msblk->block_log;
+	unsigned int data_block_pos = pos & (msblk->block_size - 1);
 	unsigned int idx = data_block_pos / PAGE_CACHE_SIZE;
 
 	if (data_block != page->data_block || page->idx == 0) {
 		page->idx = 0;
-		page->real_page.index = data_block * 32;
+		page->real_page.index = data_block * page->pages;
 		squashfs_readpage(NULL, &page->real_page);
 		page->data_block = data_block;
 	}
@@ -204,6 +239,8 @@ static int squashfs_read(struct device_d *_dev, FILE *f, void *buf,
 	unsigned int now;
 	void *pagebuf;
 	struct squashfs_page *page = f->priv;
+	struct squashfs_sb_info *msblk = f->f_inode->i_sb->s_fs_info;
+	int ret;
 
 	/* Read till end of current buffer page */
 	ofs = pos % PAGE_CACHE_SIZE;
@@ -220,6 +257,25 @@ static int squashfs_read(struct device_d *_dev, FILE *f, void *buf,
 
 	/* Do full buffer pages */
 	while (size >= PAGE_CACHE_SIZE) {
+		/*
+		 * Decompress whole blocks straight into the caller's buffer
+		 * unless they are already in the page buffers.
+		 */
+		if (!(pos & (msblk->block_size - 1)) &&
+		    size >= msblk->block_size &&
+		    (page->idx == 0 || page->data_block != pos >> msblk->block_log)) {
+			ret = squashfs_read_block_direct(f->f_inode,
+					pos >> msblk->block_log, buf);
+			if (ret < 0)
+				return ret;
+			if (!ret) {
+				size -= msblk->block_size;
+				pos += msblk->block_size;
+				buf += msblk->block_size;
+				continue;
+			}
+		}
+
 		squashfs_read_buf(page, pos, &pagebuf);
 
 		memcpy(buf, pagebuf, PAGE_CACHE_SIZE);
@@ -38,6 +38,7 @@ struct page {
 struct squashfs_page {
 	struct page real_page;
 	char **buf;
+	int pages;
 	int idx;
 	int data_block;
 };
@@ -67,6 +68,8 @@ extern struct squashfs_cache *squashfs_cache_init(char *, int, int);
 extern void squashfs_cache_delete(struct squashfs_cache *);
 extern struct squashfs_cache_entry *squashfs_cache_get(struct super_block *,
 				struct squashfs_cache *, u64, int);
+extern struct squashfs_cache_entry *squashfs_cache_lookup(
+				struct squashfs_cache *, u64);
 extern void squashfs_cache_put(struct squashfs_cache_entry *);
 extern int squashfs_copy_data(void *, struct squashfs_cache_entry *, int, int);
 extern int squashfs_read_metadata(struct super_block *, void *, u64 *,
@@ -96,6 +99,7 @@ extern __le64 *squashfs_read_fragment_index_table(struct super_block *,
 void squashfs_copy_cache(struct page *, struct squashfs_cache_entry *, int,
 				int);
 extern int squashfs_readpage(struct file *file, struct page *page);
+extern int squashfs_read_block_direct(struct inode *, int, void *);
 
 /* file_xxx.c */
 extern int squashfs_readpage_block(struct page *, u64, int);
@@ -34,6 +34,8 @@ struct squashfs_cache {
 	int			unused;
 	int			block_size;
 	int			pages;
+	uint32_t		hits;
+	uint32_t		misses;
 	spinlock_t		lock;
 	wait_queue_head_t	wait_queue;
 	struct squashfs_cache_entry *entry;
@@ -76,6 +78,8 @@ struct squashfs_sb_info {
 	long long				bytes_used;
 	unsigned int				inodes;
 	int					xattr_ids;
+	uint32_t				direct_reads;
+	uint64_t				bytes_decompressed;
 	struct cdev				*cdev;
 	struct device_d				*dev;
 };
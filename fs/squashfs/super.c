@@ -26,6 +26,7 @@
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
 #include <errno.h>
+#include <parseopt.h>
 #include <linux/fs.h>
 #include <linux/kernel.h>
 #include <linux/pagemap.h>
@@ -39,6 +40,15 @@
 #include "squashfs.h"
 #include "decompressor.h"
 
+/*
+ * Default number of cache entries, can be changed with the metadata_cache,
+ * fragment_cache and data_cache mount options. Metadata entries are
+ * SQUASHFS_METADATA_SIZE large, fragment and data entries block_size.
+ */
+#define SQUASHFS_DEFAULT_METADATA_CACHE	32
+#define SQUASHFS_DEFAULT_FRAGMENT_CACHE	8
+#define SQUASHFS_DEFAULT_DATA_CACHE	4
+
 static const struct squashfs_decompressor *supported_squashfs_filesystem(short
 	major, short minor, short id)
 {
@@ -98,6 +108,9 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	unsigned short flags;
 	unsigned int fragments;
 	u64 lookup_table_start, next_table;
+	unsigned short metadata_cache = SQUASHFS_DEFAULT_METADATA_CACHE;
+	unsigned short fragment_cache = SQUASHFS_DEFAULT_FRAGMENT_CACHE;
+	unsigned short data_cache = SQUASHFS_DEFAULT_DATA_CACHE;
 	int err;
 
 	TRACE("Entered squashfs_fill_superblock\n");
@@ -211,16 +224,30 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	sb->s_maxbytes = MAX_LFS_FILESIZE;
 	sb->s_flags |= MS_RDONLY;
 
+	parseopt_hu(fsdev->options, "metadata_cache", &metadata_cache);
+	parseopt_hu(fsdev->options, "fragment_cache", &fragment_cache);
+	parseopt_hu(fsdev->options, "data_cache", &data_cache);
+
+	/* The block index cache relies on SQUASHFS_CACHED_BLKS metadata blocks */
+	metadata_cache = max_t(unsigned short, metadata_cache,
+			       SQUASHFS_CACHED_BLKS);
+	fragment_cache = max_t(unsigned short, fragment_cache, 1);
+	data_cache = max_t(unsigned short, data_cache,
+			   squashfs_max_decompressors());
+
+	TRACE("Cache entries: metadata %u, fragment %u, data %u\n",
+		metadata_cache, fragment_cache, data_cache);
+
 	err = -ENOMEM;
 
 	msblk->block_cache = squashfs_cache_init("metadata",
-			SQUASHFS_CACHED_BLKS, SQUASHFS_METADATA_SIZE);
+			metadata_cache, SQUASHFS_METADATA_SIZE);
 	if (msblk->block_cache == NULL)
 		goto failed_mount;
 
 	/* Allocate read_page block */
 	msblk->read_page = squashfs_cache_init("data",
-		squashfs_max_decompressors(), msblk->block_size);
+		data_cache, msblk->block_size);
 	if (msblk->read_page == NULL) {
 		ERROR("Failed to allocate read_page block\n");
 		goto failed_mount;
@@ -257,7 +284,7 @@ handle_fragments:
 	if (fragments == 0)
 		goto check_directory_table;
 	msblk->fragment_cache = squashfs_cache_init("fragment",
-		SQUASHFS_CACHED_FRAGMENTS, msblk->block_size);
+		fragment_cache, msblk->block_size);
 	if (msblk->fragment_cache == NULL) {
 		err = -ENOMEM;
 		goto failed_mount;
@@ -30,6 +30,8 @@
 #include <linux/stat.h>
 #include <linux/err.h>
 #include <kfifo.h>
+#include <globalvar.h>
+#include <magicvar.h>
 #include <linux/sizes.h>
 
 #define TFTP_PORT	69	/* Well known TFTP port number */
@@ -66,6 +68,12 @@
 #define TFTP_BLOCK_SIZE		512	/* default TFTP block size */
 #define TFTP_FIFO_SIZE		4096
 
+/* largest block size which fits into an unfragmented ethernet frame */
+#define TFTP_MTU_SIZE		(1500 - sizeof(struct iphdr) - \
+				 sizeof(struct udphdr) - 4)
+
+#define TFTP_MAX_WINDOW_SIZE	CONFIG_FS_TFTP_MAX_WINDOW_SIZE
+
 #define TFTP_ERR_RESEND	1
 
 struct file_priv {
@@ -83,12 +91,20 @@ struct file_priv {
 	void *buf;
 	int blocksize;
 	int block_requested;
+	int windowsize;
+	bool lost;
+	bool resend_requested;	/* early retransmit requested for this window */
+	struct tftp_priv *tpriv;
 };
 
 struct tftp_priv {
 	IPaddr_t server;
+	/* window size to request, adapted to the packet loss we see */
+	int windowsize;
 };
 
+static int tftp_windowsize = TFTP_MAX_WINDOW_SIZE;
+
 static int tftp_truncate(struct device_d *dev, FILE *f, loff_t size)
 {
 	return 0;
@@ -134,15 +150,24 @@ static int tftp_send(struct file_priv *priv)
 				"tsize%c"
 				"%lld%c"
 				"blksize%c"
-				"1432",
+				"%d",
 				priv->filename + 1, 0,
 				0,
 				0,
 				TIMEOUT, 0,
 				0,
 				priv->filesize, 0,
-				0);
+				0,
+				(int)TFTP_MTU_SIZE);
 		pkt++;
+		if (priv->state == STATE_RRQ && priv->tpriv->windowsize > 1) {
+			pkt += sprintf((unsigned char *)pkt,
+					"windowsize%c"
+					"%d",
+					0,
+					priv->tpriv->windowsize);
+			pkt++;
+		}
 		len = pkt - xp;
 		break;
 
@@ -186,6 +211,22 @@ static int tftp_send_write(struct file_priv *priv, void *buf, int len)
 	return ret;
 }
 
+/*
+ * With a window (RFC 7440) the server sends windowsize blocks before it
+ * waits for an ACK. Only acknowledge when the window is complete (or has to
+ * be restarted) and the fifo has room for the whole next window.
+ */
+static bool tftp_window_done(struct file_priv *priv)
+{
+	unsigned int space = priv->fifo->size - kfifo_len(priv->fifo);
+
+	if (space < priv->windowsize * priv->blocksize)
+		return false;
+
+	return priv->block_requested < 0 ||
+		(uint16_t)(priv->block - priv->block_requested) >= priv->windowsize;
+}
+
 static int tftp_poll(struct file_priv *priv)
 {
 	if (ctrlc()) {
@@ -198,6 +239,8 @@ static int tftp_poll(struct file_priv *priv)
 		printf("T ");
 		priv->resend_timeout = get_time_ns();
 		priv->block_requested = -1;
+		priv->resend_requested = false;
+		priv->lost = true;
 		return TFTP_ERR_RESEND;
 	}
 
@@ -234,6 +277,9 @@ static void tftp_parse_oack(struct file_priv *priv, unsigned char *pkt, int len)
 			priv->filesize = simple_strtoull(val, NULL, 10);
 		if (!strcmp(opt, "blksize"))
 			priv->blocksize = simple_strtoul(val, NULL, 10);
+		if (!strcmp(opt, "windowsize"))
+			priv->windowsize = clamp_t(int, simple_strtoul(val, NULL, 10),
+						   1, priv->tpriv->windowsize);
 		pr_debug("OACK opt: %s val: %s\n", opt, val);
 		s = val + strlen(val) + 1;
 	}
@@ -247,7 +293,7 @@ static void tftp_timer_reset(struct file_priv *priv)
 static void tftp_recv(struct file_priv *priv,
 			uint8_t *pkt, unsigned len, uint16_t uh_sport)
 {
-	uint16_t opcode;
+	uint16_t opcode, block;
 
 	/* according to RFC1350 minimal tftp packet length is 4 bytes */
 	if (len < 4)
@@ -306,28 +352,53 @@ static void tftp_recv(struct file_priv *priv,
 		break;
 	case TFTP_DATA:
 		len -= 2;
-		priv->block = ntohs(*(uint16_t *)pkt);
+		block = ntohs(*(uint16_t *)pkt);
 
 		if (priv->state == STATE_RRQ || priv->state == STATE_OACK) {
 			/* first block received */
-			priv->state = STATE_RDATA;
 			priv->tftp_con->udp->uh_dport = uh_sport;
 			priv->last_block = 0;
 
-			if (priv->block != 1) {	/* Assertion */
+			/* with a window block 1 may simply have been lost */
+			if (priv->state == STATE_RRQ && block != 1) {	/* Assertion */
 				pr_err("error: First block is not block 1 (%d)\n",
-					priv->block);
+					block);
 				priv->err = -EINVAL;
 				priv->state = STATE_DONE;
 				break;
 			}
+
+			priv->state = STATE_RDATA;
 		}
 
-		if (priv->block == priv->last_block)
-			/* Same block again; ignore it. */
+		if (block != (uint16_t)(priv->last_block + 1)) {
+			uint16_t ahead = block - priv->last_block;
+
+			/*
+			 * A block within the current window is missing (RFC 7440).
+			 * Acknowledge the last block received in order so that
+			 * the server resends the window from there, but only once
+			 * for the remaining out of order blocks of that window.
+			 * Anything else is the same block again; ignore it.
+			 */
+			if (ahead > 1 && ahead <= priv->windowsize &&
+			    !priv->resend_requested) {
+				pr_vdebug("lost block %d, got %d\n",
+					  priv->last_block + 1, block);
+				priv->block_requested = -1;
+				priv->resend_requested = true;
+				priv->lost = true;
+			}
 			break;
+		}
+
+		priv->block = block;
+		priv->last_block = block;
 
-		priv->last_block = priv->block;
+		/* the window the retransmit was requested for is complete */
+		if (priv->block_requested >= 0 &&
+		    (uint16_t)(block - priv->block_requested) >= priv->windowsize)
+			priv->resend_requested = false;
 
 		tftp_timer_reset(priv);
 
@@ -398,8 +469,11 @@ static struct file_priv *tftp_do_open(struct device_d *dev,
 	priv->filename = dpath(dentry, fsdev->vfsmount.mnt_root);
 	priv->blocksize = TFTP_BLOCK_SIZE;
 	priv->block_requested = -1;
+	priv->windowsize = 1;
+	priv->tpriv = tpriv;
 
-	priv->fifo = kfifo_alloc(TFTP_FIFO_SIZE);
+	priv->fifo = kfifo_alloc(max_t(unsigned int, TFTP_FIFO_SIZE,
+				tpriv->windowsize * TFTP_MTU_SIZE));
 	if (!priv->fifo) {
 		ret = -ENOMEM;
 		goto out;
@@ -458,10 +532,28 @@ static int tftp_open(struct device_d *dev, FILE *file, const char *filename)
 	return 0;
 }
 
+/*
+ * Adapt the window size requested for the next transfer: Halve it when
+ * packets got lost, otherwise grow it again up to global.tftp.windowsize.
+ */
+static void tftp_adapt_window(struct file_priv *priv)
+{
+	struct tftp_priv *tpriv = priv->tpriv;
+	int max = clamp_t(int, tftp_windowsize, 1, TFTP_MAX_WINDOW_SIZE);
+
+	if (priv->lost)
+		tpriv->windowsize = max(tpriv->windowsize / 2, 1);
+	else
+		tpriv->windowsize = min(tpriv->windowsize * 2, max);
+}
+
 static int tftp_do_close(struct file_priv *priv)
 {
 	int ret;
 
+	if (!priv->push && priv->state == STATE_DONE && !priv->err)
+		tftp_adapt_window(priv);
+
 	if (priv->push && priv->state != STATE_DONE) {
 		int len;
 
@@ -556,7 +648,7 @@ static int tftp_read(struct device_d *dev, FILE *f, void *buf, size_t insize)
 		if (priv->state == STATE_DONE)
 			return outsize;
 
-		if (TFTP_FIFO_SIZE - kfifo_len(priv->fifo) >= priv->blocksize)
+		if (tftp_window_done(priv))
 			tftp_send(priv);
 
 		ret = tftp_poll(priv);
@@ -704,6 +796,7 @@ static int tftp_probe(struct device_d *dev)
 	int ret;
 
 	dev->priv = priv;
+	priv->windowsize = clamp_t(int, tftp_windowsize, 1, TFTP_MAX_WINDOW_SIZE);
 
 	ret = resolv(fsdev->backingstore, &priv->server);
 	if (ret) {
@@ -748,6 +841,11 @@ static struct fs_driver_d tftp_driver = {
 
 static int tftp_init(void)
 {
+	globalvar_add_simple_int("tftp.windowsize", &tftp_windowsize, "%u");
+
 	return register_fs_driver(&tftp_driver);
 }
 coredevice_initcall(tftp_init);
+
+BAREBOX_MAGICVAR(global.tftp.windowsize,
+		 "Maximum TFTP window size (RFC 7440) to request from the server");
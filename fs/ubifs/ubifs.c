@@ -247,23 +247,15 @@ int __init ubifs_compressors_init(void)
 
 /* file.c */
 
-static int read_block(struct inode *inode, void *addr, unsigned int block,
-		      struct ubifs_data_node *dn)
+static int ubifs_bulk_read_enabled = 1;
+
+static int decompress_block(struct inode *inode, void *addr, unsigned int block,
+			    struct ubifs_data_node *dn)
 {
 	struct ubifs_info *c = inode->i_sb->s_fs_info;
 	int err, len, out_len;
-	union ubifs_key key;
 	unsigned int dlen;
 
-	data_key_init(c, &key, inode->i_ino, block);
-	err = ubifs_tnc_lookup(c, &key, dn);
-	if (err) {
-		if (err == -ENOENT)
-			/* Not found, so it must be a hole */
-			memset(addr, 0, UBIFS_BLOCK_SIZE);
-		return err;
-	}
-
 	ubifs_assert(c, le64_to_cpu(dn->ch.sqnum) > ubifs_inode(inode)->creat_sqnum);
 
 	len = le32_to_cpu(dn->size);
@@ -294,11 +286,40 @@ dump:
 	return -EINVAL;
 }
 
+static int read_block(struct inode *inode, void *addr, unsigned int block,
+		      struct ubifs_data_node *dn)
+{
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	union ubifs_key key;
+	int err;
+
+	data_key_init(c, &key, inode->i_ino, block);
+	err = ubifs_tnc_lookup(c, &key, dn);
+	if (err) {
+		if (err == -ENOENT)
+			/* Not found, so it must be a hole */
+			memset(addr, 0, UBIFS_BLOCK_SIZE);
+		return err;
+	}
+
+	return decompress_block(inode, addr, block, dn);
+}
+
+/*
+ * Each open file caches a run of decompressed blocks. The cache is filled
+ * with a bulk-read, i.e. the data nodes following the requested block which
+ * are stored consecutively in the same LEB are read with a single flash read
+ * and decompressed in one go, so sequential reads neither walk the TNC nor
+ * access the flash for every block.
+ */
 struct ubifs_file {
 	struct inode *inode;
 	void *buf;
-	unsigned int block;
+	unsigned int block;		/* first block in @buf */
+	unsigned int blk_cnt;		/* number of valid blocks in @buf */
+	unsigned int max_blocks;	/* capacity of @buf in blocks */
 	struct ubifs_data_node *dn;
+	struct bu_info *bu;
 };
 
 static int ubifs_open(struct device_d *dev, FILE *file, const char *filename)
@@ -309,9 +330,13 @@ static int ubifs_open(struct device_d *dev, FILE *file, const char *filename)
 	uf = xzalloc(sizeof(*uf));
 
 	uf->inode = inode;
-	uf->buf = xmalloc(UBIFS_BLOCK_SIZE);
+	uf->max_blocks = DIV_ROUND_UP(inode->i_size, UBIFS_BLOCK_SIZE);
+	uf->max_blocks = clamp_t(unsigned int, uf->max_blocks, 1,
+				 UBIFS_MAX_BULK_READ);
+	uf->buf = xmalloc(uf->max_blocks * UBIFS_BLOCK_SIZE);
 	uf->dn = xzalloc(UBIFS_MAX_DATA_NODE_SZ);
-	uf->block = -1;
+	if (uf->max_blocks > 1)
+		uf->bu = xzalloc(sizeof(*uf->bu));
 
 	file->size = inode->i_size;
 	file->priv = uf;
@@ -325,23 +350,98 @@ static int ubifs_close(struct device_d *dev, FILE *f)
 
 	free(uf->buf);
 	free(uf->dn);
+	free(uf->bu);
 	free(uf);
 
 	return 0;
 }
 
+static int ubifs_bulk_read(struct ubifs_file *uf, unsigned int block)
+{
+	struct inode *inode = uf->inode;
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	struct bu_info *bu = uf->bu;
+	unsigned int i, n, nn, last;
+	int offs, err;
+
+	/* The raw node buffer is shared by all files */
+	if (!c->bu.buf) {
+		c->bu.buf = kmalloc(c->max_bu_buf_len, GFP_NOFS);
+		if (!c->bu.buf)
+			return -ENOMEM;
+	}
+
+	data_key_init(c, &bu->key, inode->i_ino, block);
+	bu->buf = c->bu.buf;
+	bu->buf_len = c->max_bu_buf_len;
+
+	err = ubifs_tnc_get_bu_keys(c, bu);
+	if (err)
+		return err;
+
+	if (!bu->cnt)
+		return -ENOENT;
+
+	err = ubifs_tnc_bulk_read(c, bu);
+	if (err)
+		return err;
+
+	/* Cover all nodes read and, at the end of file, the holes following */
+	last = key_block(c, &bu->zbranch[bu->cnt - 1].key) + 1;
+	if (bu->eof)
+		last = max_t(unsigned int, last,
+			     DIV_ROUND_UP(inode->i_size, UBIFS_BLOCK_SIZE));
+	n = min(last - block, uf->max_blocks);
+
+	offs = bu->zbranch[0].offs;
+	for (i = 0, nn = 0; i < n; i++) {
+		void *addr = uf->buf + i * UBIFS_BLOCK_SIZE;
+
+		if (nn < bu->cnt &&
+		    key_block(c, &bu->zbranch[nn].key) == block + i) {
+			struct ubifs_data_node *dn;
+
+			dn = bu->buf + (bu->zbranch[nn].offs - offs);
+			err = decompress_block(inode, addr, block + i, dn);
+			if (err)
+				return err;
+			nn++;
+		} else {
+			memset(addr, 0, UBIFS_BLOCK_SIZE);
+		}
+	}
+
+	uf->block = block;
+	uf->blk_cnt = n;
+
+	return 0;
+}
+
 static int ubifs_get_block(struct ubifs_file *uf, unsigned int pos)
 {
 	int ret;
 	unsigned int block = pos / UBIFS_BLOCK_SIZE;
 
-	if (block != uf->block) {
-		ret = read_block(uf->inode, uf->buf, block, uf->dn);
-		if (ret && ret != -ENOENT)
-			return ret;
-		uf->block = block;
+	if (block >= uf->block && block - uf->block < uf->blk_cnt)
+		return 0;
+
+	uf->blk_cnt = 0;
+
+	if (uf->bu && ubifs_bulk_read_enabled) {
+		ret = ubifs_bulk_read(uf, block);
+		if (!ret)
+			return 0;
+		/* Fall back to reading a single block */
+		uf->blk_cnt = 0;
 	}
 
+	ret = read_block(uf->inode, uf->buf, block, uf->dn);
+	if (ret && ret != -ENOENT)
+		return ret;
+
+	uf->block = block;
+	uf->blk_cnt = 1;
+
 	return 0;
 }
 
@@ -354,14 +454,14 @@ static int ubifs_read(struct device_d *_dev, FILE *f, void *buf, size_t insize)
 	unsigned int size = insize;
 	int ret;
 
-	/* Read till end of current block */
-	ofs = f->pos % UBIFS_BLOCK_SIZE;
-	if (ofs) {
+	while (size) {
 		ret = ubifs_get_block(uf, pos);
 		if (ret)
 			return ret;
 
-		now = min(size, UBIFS_BLOCK_SIZE - ofs);
+		/* Copy as much as possible from the cached blocks */
+		ofs = pos - uf->block * UBIFS_BLOCK_SIZE;
+		now = min(size, uf->blk_cnt * UBIFS_BLOCK_SIZE - ofs);
 
 		memcpy(buf, uf->buf + ofs, now);
 		size -= now;
@@ -369,26 +469,6 @@ static int ubifs_read(struct device_d *_dev, FILE *f, void *buf, size_t insize)
 		buf += now;
 	}
 
-	/* Do full blocks */
-	while (size >= UBIFS_BLOCK_SIZE) {
-		ret = ubifs_get_block(uf, pos);
-		if (ret)
-			return ret;
-
-		memcpy(buf, uf->buf, UBIFS_BLOCK_SIZE);
-		size -= UBIFS_BLOCK_SIZE;
-		pos += UBIFS_BLOCK_SIZE;
-		buf += UBIFS_BLOCK_SIZE;
-	}
-
-	/* And the rest */
-	if (size) {
-		ret = ubifs_get_block(uf, pos);
-		if (ret)
-			return ret;
-		memcpy(buf, uf->buf, size);
-	}
-
 	return insize;
 }
 
@@ -506,6 +586,7 @@ static int ubifs_init(void)
 	}
 
 	globalvar_add_simple_bool("ubifs.allow_encrypted", &ubifs_allow_encrypted);
+	globalvar_add_simple_bool("ubifs.bulk_read", &ubifs_bulk_read_enabled);
 	globalvar_add_simple_bool("ubifs.allow_authenticated_unauthenticated",
 				  &ubifs_allow_authenticated_unauthenticated);
 
@@ -518,3 +599,5 @@ BAREBOX_MAGICVAR(global.ubifs.allow_encrypted,
 		 "If true, allow to mount UBIFS with encrypted files");
 BAREBOX_MAGICVAR(global.ubifs.allow_authenticated_unauthenticated,
 		 "If true, allow to mount authenticated UBIFS images without doing authentication");
+BAREBOX_MAGICVAR(global.ubifs.bulk_read,
+		 "If true (default), read consecutive data nodes of a file in one go");
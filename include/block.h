@@ -30,6 +30,13 @@ struct block_device {
 
 	struct list_head buffered_blocks;
 	struct list_head idle_blocks;
+	struct hlist_head *chunk_hash;
+	unsigned int num_chunks;
+	sector_t ra_next;	/* start of the next chunk on sequential reads */
+	void *iobuf;		/* bounce buffer for batched requests */
+
+	/* cache size in bytes, 0 to use global.block.cache_size */
+	size_t cache_size;
 
 	struct cdev cdev;
 };
@@ -44,6 +51,8 @@ int blockdevice_unregister(struct block_device *blk);
 int block_read(struct block_device *blk, void *buf, sector_t block, blkcnt_t num_blocks);
 int block_write(struct block_device *blk, void *buf, sector_t block, blkcnt_t num_blocks);
 
+struct block_device *cdev_get_block_device(const struct cdev *cdev);
+
 static inline int block_flush(struct block_device *blk)
 {
 	return cdev_flush(&blk->cdev);
@@ -36,6 +36,7 @@ struct command {
 	const char	*opts;		/* command options */
 
 	struct list_head list;		/* List of commands		*/
+	struct hlist_node hash;		/* Name hash chain		*/
 	uint32_t	group;
 #ifdef	CONFIG_LONGHELP
 	const char	*help;		/* Help  message	(long)	*/
@@ -80,6 +80,7 @@ struct digest {
 int digest_algo_register(struct digest_algo *d);
 void digest_algo_unregister(struct digest_algo *d);
 void digest_algo_prints(const char *prefix);
+int digest_algo_bench(const char *name, unsigned long size);
 
 struct digest *digest_alloc(const char *name);
 struct digest *digest_alloc_by_algo(enum hash_algo);
@@ -4,6 +4,7 @@
 #include <common.h>
 #include <file-list.h>
 #include <net.h>
+#include <work.h>
 
 #define FASTBOOT_MAX_CMD_LEN  64
 
@@ -33,6 +34,11 @@ struct fastboot {
 	size_t download_bytes;
 	size_t download_size;
 	struct list_head variables;
+
+	/* partition sparse images are written to while being downloaded */
+	struct file_list_entry *stream_entry;
+	struct fastboot_stream *stream;
+	struct work_queue stream_wq;
 };
 
 /**
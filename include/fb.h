@@ -88,6 +88,8 @@ struct fb_ops {
 	void (*fb_disable)(struct fb_info *info);
 	int (*fb_activate_var)(struct fb_info *info);
 	void (*fb_flush)(struct fb_info *info);
+	/* show the framebuffer starting at line info->yoffset */
+	int (*fb_pan_display)(struct fb_info *info);
 };
 
 /*
@@ -129,6 +131,8 @@ struct fb_info {
 
 	u32 xres;			/* visible resolution		*/
 	u32 yres;
+	u32 yres_virtual;		/* virtual resolution for panning */
+	u32 yoffset;			/* first visible line		*/
 	u32 bits_per_pixel;		/* guess what			*/
 	u32 line_length;		/* length of a line in bytes	*/
 
@@ -155,6 +159,7 @@ int register_framebuffer(struct fb_info *info);
 int fb_enable(struct fb_info *info);
 int fb_disable(struct fb_info *info);
 void fb_flush(struct fb_info *info);
+int fb_pan_display(struct fb_info *info, u32 yoffset);
 
 #define FBIOGET_SCREENINFO	_IOR('F', 1, loff_t)
 #define	FBIO_ENABLE		_IO('F', 2)
@@ -55,6 +55,7 @@ enum filetype {
 	filetype_zynq_image,
 	filetype_mxs_sd_image,
 	filetype_rockchip_rkns_image,
+	filetype_zstd_compressed,
 	filetype_max,
 };
 
@@ -79,6 +80,7 @@ static inline bool file_is_compressed_file(enum filetype ft)
 	case filetype_gzip:
 	case filetype_bzip2:
 	case filetype_xz_compressed:
+	case filetype_zstd_compressed:
 		return true;
 	default:
 		return false;
@@ -7,12 +7,20 @@
 #define __IMAGE_FIT_H__
 
 #include <linux/types.h>
+#include <linux/list.h>
 #include <bootm.h>
 
+struct fit_image_buf {
+	struct list_head list;
+	void *data;
+};
+
 struct fit_handle {
 	const void *fit;
 	void *fit_alloc;
 	size_t size;
+	int fd;			/* FIT file for external data, -1 if none */
+	struct list_head buffers;	/* external data read by fit_open_image() */
 
 	bool verbose;
 	enum bootm_verify verify;
@@ -32,6 +40,10 @@ int fit_has_image(struct fit_handle *handle, void *configuration,
 int fit_open_image(struct fit_handle *handle, void *configuration,
 		   const char *name, const void **outdata,
 		   unsigned long *outsize);
+int fit_get_image_size(struct fit_handle *handle, void *configuration,
+		       const char *name, unsigned long *size);
+int fit_load_image(struct fit_handle *handle, void *configuration,
+		   const char *name, void *dest, unsigned long size);
 int fit_get_image_address(struct fit_handle *handle, void *configuration,
 			  const char *name, const char *property,
 			  unsigned long *address);
@@ -64,4 +64,25 @@ int sparse_image_read(struct sparse_image_ctx *si, void *buf,
 void sparse_image_close(struct sparse_image_ctx *si);
 loff_t sparse_image_size(struct sparse_image_ctx *si);
 
+/**
+ * struct sparse_stream_ops - callbacks for a sparse image stream
+ * @start:	called once the image header is parsed with the size of the
+ *		unsparsed image (optional)
+ * @write:	write @len bytes of image data to @pos
+ * @dont_care:	the @len bytes at @pos are not part of the image (optional)
+ */
+struct sparse_stream_ops {
+	int (*start)(void *priv, loff_t size);
+	int (*write)(void *priv, loff_t pos, const void *buf, size_t len);
+	int (*dont_care)(void *priv, loff_t pos, loff_t len);
+};
+
+struct sparse_stream;
+
+struct sparse_stream *sparse_stream_new(const struct sparse_stream_ops *ops,
+					void *priv, size_t align);
+int sparse_stream_feed(struct sparse_stream *ss, const void *buf, size_t len);
+int sparse_stream_finish(struct sparse_stream *ss);
+void sparse_stream_free(struct sparse_stream *ss);
+
 #endif /* _IMAGE_SPARSE_H */
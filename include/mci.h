@@ -51,10 +51,15 @@
 #define MMC_CAP_SD_HIGHSPEED		(1 << 3)
 #define MMC_CAP_MMC_HIGHSPEED		(1 << 4)
 #define MMC_CAP_MMC_HIGHSPEED_52MHZ	(1 << 5)
+#define MMC_CAP_MMC_HS200_1_8V		(1 << 6)
+#define MMC_CAP_MMC_HS400_1_8V		(1 << 7)
+#define MMC_CAP_MMC_HS400_ES		(1 << 8)
+#define MMC_CAP_CMD23			(1 << 9)
 /* Mask of all caps for bus width */
 #define MMC_CAP_BIT_DATA_MASK		(MMC_CAP_4_BIT_DATA | MMC_CAP_8_BIT_DATA)
 
 #define SD_DATA_4BIT		0x00040000
+#define SD_SCR_CMD23_SUPPORT	0x00000002
 
 #define IS_SD(x) (x->version & SD_VERSION_SD)
 
@@ -77,6 +82,8 @@
 #define MMC_CMD_SET_BLOCKLEN		16
 #define MMC_CMD_READ_SINGLE_BLOCK	17
 #define MMC_CMD_READ_MULTIPLE_BLOCK	18
+#define MMC_CMD_SEND_TUNING_BLOCK_HS200	21
+#define MMC_CMD_SET_BLOCK_COUNT		23
 #define MMC_CMD_WRITE_SINGLE_BLOCK	24
 #define MMC_CMD_WRITE_MULTIPLE_BLOCK	25
 #define MMC_CMD_APP_CMD			55
@@ -97,6 +104,12 @@
 
 #define MMC_HS_TIMING		0x00000100
 
+#define MMC_HS200_MAX_DTR	200000000
+
+/* CMD23 argument */
+#define MMC_CMD23_ARG_REL_WR	(1 << 31)
+#define MMC_CMD23_MAX_BLOCKS	0xffff
+
 #define OCR_BUSY		0x80000000
 /** card's response in its OCR if it is a high capacity card */
 #define OCR_HCS			0x40000000
@@ -283,7 +296,7 @@
 #define EXT_CSD_CMD_SET_SECURE		(1<<1)
 #define EXT_CSD_CMD_SET_CPSECURE	(1<<2)
 
-#define EXT_CSD_CARD_TYPE_MASK		0x3f
+#define EXT_CSD_CARD_TYPE_MASK		0xff
 #define EXT_CSD_CARD_TYPE_26		(1<<0)	/* Card can run at 26MHz */
 #define EXT_CSD_CARD_TYPE_52		(1<<1)	/* Card can run at 52MHz */
 #define EXT_CSD_CARD_TYPE_DDR_1_8V	(1<<2)	/* Card can run at 52MHz */
@@ -293,6 +306,8 @@
 #define EXT_CSD_CARD_TYPE_SDR_1_8V	(1<<4)	/* Card can run at 200MHz */
 #define EXT_CSD_CARD_TYPE_SDR_1_2V	(1<<5)	/* Card can run at 200MHz */
 						/* SDR mode @1.2V I/O */
+#define EXT_CSD_CARD_TYPE_HS400_1_8V	(1<<6)	/* Card can run at 200MHz DDR, 1.8V */
+#define EXT_CSD_CARD_TYPE_HS400_1_2V	(1<<7)	/* Card can run at 200MHz DDR, 1.2V */
 
 /* register PARTITIONS_ATTRIBUTE [156] */
 #define EXT_CSD_ENH_USR_MASK		(1 << 0)
@@ -300,12 +315,22 @@
 /* register PARTITIONING_SUPPORT [160] */
 #define EXT_CSD_ENH_ATTRIBUTE_EN_MASK	(1 << 0)
 
+/* register WR_REL_PARAM [166] */
+#define EXT_CSD_WR_REL_PARAM_EN		(1 << 2)
+
 /* register BUS_WIDTH [183], field Bus Mode Selection [4:0] */
 #define EXT_CSD_BUS_WIDTH_1	0	/* Card is in 1 bit mode */
 #define EXT_CSD_BUS_WIDTH_4	1	/* Card is in 4 bit mode */
 #define EXT_CSD_BUS_WIDTH_8	2	/* Card is in 8 bit mode */
 #define EXT_CSD_DDR_BUS_WIDTH_4	5	/* Card is in 4 bit DDR mode */
 #define EXT_CSD_DDR_BUS_WIDTH_8	6	/* Card is in 8 bit DDR mode */
+#define EXT_CSD_BUS_WIDTH_STROBE	(1 << 7)	/* Enhanced strobe mode */
+
+/* register HS_TIMING [185], field Timing Interface [3:0] */
+#define EXT_CSD_TIMING_BC	0	/* Backwards compatibility */
+#define EXT_CSD_TIMING_HS	1	/* High speed */
+#define EXT_CSD_TIMING_HS200	2	/* HS200 */
+#define EXT_CSD_TIMING_HS400	3	/* HS400 */
 
 #define R1_ILLEGAL_COMMAND		(1 << 22)
 #define R1_APP_CMD			(1 << 5)
@@ -380,6 +405,8 @@ struct mci_ios {
 
 	enum mci_timing	timing;			/* timing specification used */
 
+	bool enhanced_strobe;			/* HS400 enhanced strobe */
+
 #define MMC_SDR_MODE		0
 #define MMC_1_2V_DDR_MODE	1
 #define MMC_1_8V_DDR_MODE	2
@@ -401,6 +428,7 @@ struct mci_host {
 	unsigned clock;		/**< Current clock used to talk to the card */
 	unsigned bus_width;	/**< used data bus width to the card */
 	enum mci_timing timing;	/**< used timing specification to the card */
+	bool enhanced_strobe;	/**< HS400 enhanced strobe in use */
 	unsigned max_req_size;
 	unsigned dsr_val;	/**< optional dsr value */
 	int use_dsr;		/**< optional dsr usage flag */
@@ -419,6 +447,8 @@ struct mci_host {
 	int (*card_present)(struct mci_host *);
 	/** check if a card is write protected */
 	int (*card_write_protected)(struct mci_host *);
+	/** tune the sampling point, opcode is the tuning command to use */
+	int (*execute_tuning)(struct mci_host *, u32 opcode);
 };
 
 #define MMC_NUM_BOOT_PARTITION	2
@@ -464,6 +494,11 @@ struct mci {
 	int probe;
 	struct param_d *param_boot;
 	int bootpart;
+	bool cmd23;		/**< use pre-defined multi block transfers (CMD23) */
+	unsigned rel_wr_sectors;	/**< reliable write granularity, 0 if unsupported */
+	uint32_t reliable_write;	/**< use reliable writes */
+	char *timing_str;	/**< bus mode in use, exposed as "timing" parameter */
+	uint32_t read_speed;	/**< throughput of the last large read in KiB/s */
 
 	struct mci_part part[MMC_NUM_PHY_PARTITION];
 	int nr_parts;
@@ -1064,6 +1064,7 @@ int of_device_disable_by_alias(const char *alias);
 
 phandle of_get_tree_max_phandle(struct device_node *root);
 phandle of_node_create_phandle(struct device_node *node);
+void of_node_set_phandle(struct device_node *node, phandle phandle);
 int of_set_property_to_child_phandle(struct device_node *node, char *prop_name);
 
 static inline struct device_node *of_find_root_node(struct device_node *node)
@@ -17,4 +17,14 @@ int uncompress_fd_to_buf(int infd, void *output,
 
 void uncompress_err_stdout(char *);
 
+struct uncompress_stream;
+
+struct uncompress_stream *uncompress_stream_init(
+		int (*flush)(void *priv, const void *buf, unsigned int len),
+		void *priv, void (*error_fn)(char *x));
+int uncompress_stream_feed(struct uncompress_stream *s, const void *buf,
+			   unsigned int len);
+int uncompress_stream_finish(struct uncompress_stream *s);
+void uncompress_stream_free(struct uncompress_stream *s);
+
 #endif /* __UNCOMPRESS_H */
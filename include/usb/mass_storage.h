@@ -13,6 +13,7 @@
 #define UMS_CABLE_READY_TIMEOUT	60
 
 struct fsg_common;
+struct block_device;
 
 struct f_ums_opts {
 	struct usb_function_instance func_inst;
@@ -20,6 +21,9 @@ struct f_ums_opts {
 	struct file_list *files;
 	unsigned int num_sectors;
 	int fd;
+	/* set when the LUN is backed by a block device with 512 byte sectors */
+	struct block_device *blk;
+	sector_t blk_start;
 	char name[16];
 };
 
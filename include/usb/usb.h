@@ -158,6 +158,8 @@ struct usb_host {
 	int (*update_hub_device)(struct usb_device *dev);
 
 	bool no_desc_before_addr;
+	/* maximum length of a bulk transfer, 0 if unknown */
+	size_t max_xfer_size;
 
 	struct list_head list;
 
@@ -244,3 +244,391 @@ void sparse_image_close(struct sparse_image_ctx *si)
 	close(si->fd);
 	free(si);
 }
+
+/*
+ * Streaming parser: Unlike sparse_image_read() this does not need the whole
+ * image in a file, the image can be passed in pieces of arbitrary size as
+ * it arrives, for example while it is still being downloaded.
+ */
+
+#define SPARSE_STREAM_BUF_SIZE	SZ_128K
+
+enum sparse_stream_state {
+	SPARSE_STREAM_FILE_HEADER,
+	SPARSE_STREAM_CHUNK_HEADER,
+	SPARSE_STREAM_RAW,
+	SPARSE_STREAM_FILL,
+	SPARSE_STREAM_DONE,
+};
+
+struct sparse_stream {
+	const struct sparse_stream_ops *ops;
+	void *priv;
+	enum sparse_stream_state state;
+	struct sparse_header sparse;
+	struct chunk_header chunk;
+	unsigned int processed_chunks;
+	/* bytes of the current header or fill value collected so far */
+	size_t hdr_len;
+	/* input bytes to ignore before continuing in the current state */
+	size_t skip;
+	/* output position */
+	loff_t pos;
+	/* remaining input bytes of a raw chunk */
+	uint64_t remaining;
+	uint32_t fill_val;
+	/* granularity of the pieces passed to ops->write */
+	size_t align;
+	/* buffer for fill data and for raw data split across feed calls */
+	void *buf;
+	size_t buf_size;
+	size_t buf_len;
+};
+
+/**
+ * sparse_stream_new - create a sparse image stream
+ * @ops:	callbacks for the image data
+ * @priv:	passed to the callbacks
+ * @align:	alignment the output device needs for writes, 1 for none
+ *
+ * Except for the last piece of a chunk, the pieces passed to @ops->write
+ * are multiples of both the image block size and @align. The last piece of
+ * a chunk is a multiple of the image block size.
+ */
+struct sparse_stream *sparse_stream_new(const struct sparse_stream_ops *ops,
+					void *priv, size_t align)
+{
+	struct sparse_stream *ss;
+
+	ss = xzalloc(sizeof(*ss));
+	ss->ops = ops;
+	ss->priv = priv;
+	ss->align = align ? align : 1;
+	ss->state = SPARSE_STREAM_FILE_HEADER;
+
+	return ss;
+}
+
+/*
+ * Collect a header of @size bytes into @dst. Returns the number of bytes
+ * consumed from @buf, ss->hdr_len equals @size once the header is complete.
+ */
+static size_t sparse_stream_collect(struct sparse_stream *ss, void *dst,
+				    size_t size, const void *buf, size_t len)
+{
+	size_t now = min(size - ss->hdr_len, len);
+
+	memcpy(dst + ss->hdr_len, buf, now);
+	ss->hdr_len += now;
+
+	return now;
+}
+
+static void sparse_stream_next_chunk(struct sparse_stream *ss)
+{
+	ss->hdr_len = 0;
+
+	if (ss->processed_chunks == le32_to_cpu(ss->sparse.total_chunks))
+		ss->state = SPARSE_STREAM_DONE;
+	else
+		ss->state = SPARSE_STREAM_CHUNK_HEADER;
+}
+
+static int sparse_stream_file_header(struct sparse_stream *ss)
+{
+	struct sparse_header *sparse = &ss->sparse;
+	size_t blk_sz, align;
+	int ret;
+
+	if (!is_sparse_image(sparse))
+		return -EINVAL;
+
+	if (le16_to_cpu(sparse->file_hdr_sz) < sizeof(struct sparse_header) ||
+	    le16_to_cpu(sparse->chunk_hdr_sz) < sizeof(struct chunk_header) ||
+	    !le32_to_cpu(sparse->blk_sz) || le32_to_cpu(sparse->blk_sz) & 3)
+		return -EINVAL;
+
+	/* Skip the remaining bytes in a header longer than we expected */
+	ss->skip = le16_to_cpu(sparse->file_hdr_sz) - sizeof(struct sparse_header);
+
+	/* write in multiples of the block size and the device's alignment */
+	blk_sz = le32_to_cpu(sparse->blk_sz);
+	for (align = blk_sz; align % ss->align; align += blk_sz)
+		;
+	ss->align = align;
+	ss->buf_size = max_t(size_t, rounddown(SPARSE_STREAM_BUF_SIZE, align),
+			     align);
+	ss->buf = malloc(ss->buf_size);
+	if (!ss->buf)
+		return -ENOMEM;
+
+	if (ss->ops->start) {
+		ret = ss->ops->start(ss->priv, (loff_t)le32_to_cpu(sparse->blk_sz) *
+				     le32_to_cpu(sparse->total_blks));
+		if (ret)
+			return ret;
+	}
+
+	sparse_stream_next_chunk(ss);
+
+	return 0;
+}
+
+static int sparse_stream_chunk_header(struct sparse_stream *ss)
+{
+	unsigned int chunk_hdr_sz = le16_to_cpu(ss->sparse.chunk_hdr_sz);
+	uint32_t total_sz = le32_to_cpu(ss->chunk.total_sz);
+	uint64_t chunk_data_sz;
+	uint32_t payload;
+	int ret;
+
+	pr_debug("=== Chunk Header ===\n");
+	pr_debug("chunk_type: 0x%x\n", le16_to_cpu(ss->chunk.chunk_type));
+	pr_debug("chunk_data_sz: 0x%x\n", le32_to_cpu(ss->chunk.chunk_sz));
+	pr_debug("total_size: 0x%x\n", total_sz);
+
+	if (total_sz < chunk_hdr_sz)
+		return -EINVAL;
+
+	chunk_data_sz = (uint64_t)le32_to_cpu(ss->sparse.blk_sz) *
+			le32_to_cpu(ss->chunk.chunk_sz);
+	payload = total_sz - chunk_hdr_sz;
+
+	/* Skip the remaining bytes in a header longer than we expected */
+	ss->skip = chunk_hdr_sz - sizeof(struct chunk_header);
+	ss->hdr_len = 0;
+	ss->processed_chunks++;
+
+	switch (le16_to_cpu(ss->chunk.chunk_type)) {
+	case CHUNK_TYPE_RAW:
+		if (payload != chunk_data_sz)
+			return -EINVAL;
+
+		ss->remaining = payload;
+		ss->state = SPARSE_STREAM_RAW;
+
+		if (!payload)
+			sparse_stream_next_chunk(ss);
+
+		break;
+
+	case CHUNK_TYPE_FILL:
+		if (payload != sizeof(uint32_t))
+			return -EINVAL;
+
+		ss->state = SPARSE_STREAM_FILL;
+
+		break;
+
+	case CHUNK_TYPE_DONT_CARE:
+		if (ss->ops->dont_care && chunk_data_sz) {
+			ret = ss->ops->dont_care(ss->priv, ss->pos, chunk_data_sz);
+			if (ret)
+				return ret;
+		}
+
+		ss->pos += chunk_data_sz;
+		ss->skip += payload;
+		sparse_stream_next_chunk(ss);
+
+		break;
+
+	case CHUNK_TYPE_CRC32:
+		if (payload != sizeof(uint32_t))
+			return -EINVAL;
+
+		ss->skip += payload;
+		sparse_stream_next_chunk(ss);
+
+		break;
+
+	default:
+		pr_err("Unknown chunk type 0x%04x\n",
+		       le16_to_cpu(ss->chunk.chunk_type));
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int sparse_stream_fill(struct sparse_stream *ss)
+{
+	uint64_t remaining = (uint64_t)le32_to_cpu(ss->sparse.blk_sz) *
+			     le32_to_cpu(ss->chunk.chunk_sz);
+	size_t bufsiz = min_t(uint64_t, remaining, ss->buf_size);
+	uint32_t *buf32;
+	int i, ret;
+
+	if (!remaining)
+		goto out;
+
+	buf32 = ss->buf;
+	for (i = 0; i < bufsiz / sizeof(uint32_t); i++)
+		buf32[i] = ss->fill_val;
+
+	while (remaining) {
+		size_t now = min_t(uint64_t, remaining, bufsiz);
+
+		ret = ss->ops->write(ss->priv, ss->pos, ss->buf, now);
+		if (ret)
+			return ret;
+
+		ss->pos += now;
+		remaining -= now;
+	}
+out:
+	sparse_stream_next_chunk(ss);
+
+	return 0;
+}
+
+/*
+ * Pass raw chunk data to ops->write. Input is written directly in multiples
+ * of ss->align. Only pieces which are smaller or split across feed calls
+ * are collected in ss->buf first. The end of the chunk is always written.
+ */
+static int sparse_stream_raw(struct sparse_stream *ss, const void *buf,
+			     size_t len, size_t *retlen)
+{
+	size_t now = min_t(uint64_t, ss->remaining, len);
+	const void *data = buf;
+	size_t wlen = 0;
+	int ret;
+
+	if (!ss->buf_len) {
+		wlen = now == ss->remaining ? now : rounddown(now, ss->align);
+		now = wlen;
+	}
+
+	if (!wlen) {
+		now = min(now, ss->buf_size - ss->buf_len);
+		memcpy(ss->buf + ss->buf_len, buf, now);
+		ss->buf_len += now;
+
+		if (ss->buf_len == ss->buf_size || now == ss->remaining) {
+			data = ss->buf;
+			wlen = ss->buf_len;
+			ss->buf_len = 0;
+		}
+	}
+
+	ss->remaining -= now;
+	*retlen = now;
+
+	if (wlen) {
+		ret = ss->ops->write(ss->priv, ss->pos, data, wlen);
+		if (ret)
+			return ret;
+
+		ss->pos += wlen;
+	}
+
+	if (!ss->remaining)
+		sparse_stream_next_chunk(ss);
+
+	return 0;
+}
+
+/**
+ * sparse_stream_feed - pass the next piece of a sparse image
+ * @ss:		the sparse stream
+ * @buf:	the input data
+ * @len:	length of @buf
+ *
+ * The data is parsed and the stream's callbacks are called for the data and
+ * holes contained in the image as soon as they are complete. Data after the
+ * last chunk is ignored.
+ *
+ * Return: 0 for success or a negative error code
+ */
+int sparse_stream_feed(struct sparse_stream *ss, const void *buf, size_t len)
+{
+	size_t now;
+	int ret;
+
+	while (len) {
+		if (ss->skip) {
+			now = min(ss->skip, len);
+			ss->skip -= now;
+			goto next;
+		}
+
+		switch (ss->state) {
+		case SPARSE_STREAM_FILE_HEADER:
+			now = sparse_stream_collect(ss, &ss->sparse,
+						    sizeof(ss->sparse), buf, len);
+			if (ss->hdr_len < sizeof(ss->sparse))
+				break;
+
+			ret = sparse_stream_file_header(ss);
+			if (ret)
+				return ret;
+
+			break;
+
+		case SPARSE_STREAM_CHUNK_HEADER:
+			now = sparse_stream_collect(ss, &ss->chunk,
+						    sizeof(ss->chunk), buf, len);
+			if (ss->hdr_len < sizeof(ss->chunk))
+				break;
+
+			ret = sparse_stream_chunk_header(ss);
+			if (ret)
+				return ret;
+
+			break;
+
+		case SPARSE_STREAM_RAW:
+			ret = sparse_stream_raw(ss, buf, len, &now);
+			if (ret)
+				return ret;
+
+			break;
+
+		case SPARSE_STREAM_FILL:
+			now = sparse_stream_collect(ss, &ss->fill_val,
+						    sizeof(ss->fill_val), buf, len);
+			if (ss->hdr_len < sizeof(ss->fill_val))
+				break;
+
+			ret = sparse_stream_fill(ss);
+			if (ret)
+				return ret;
+
+			break;
+
+		case SPARSE_STREAM_DONE:
+		default:
+			return 0;
+		}
+next:
+		buf += now;
+		len -= now;
+	}
+
+	return 0;
+}
+
+/**
+ * sparse_stream_finish - check a sparse stream for completeness
+ * @ss:		the sparse stream
+ *
+ * Return: 0 if all chunks of the image have been passed to
+ * sparse_stream_feed(), -EINVAL if the image is truncated
+ */
+int sparse_stream_finish(struct sparse_stream *ss)
+{
+	if (ss->state != SPARSE_STREAM_DONE || ss->skip)
+		return -EINVAL;
+
+	return 0;
+}
+
+void sparse_stream_free(struct sparse_stream *ss)
+{
+	if (!ss)
+		return;
+
+	free(ss->buf);
+	free(ss);
+}
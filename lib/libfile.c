@@ -18,7 +18,10 @@
 #include <libfile.h>
 #include <progress.h>
 #include <stdlib.h>
+#include <clock.h>
 #include <linux/stat.h>
+#include <linux/sizes.h>
+#include <linux/math64.h>
 
 /*
  * pwrite_full - write to filedescriptor at offset
@@ -100,10 +103,46 @@ int read_full(int fd, void *buf, size_t size)
 }
 EXPORT_SYMBOL(read_full);
 
+/*
+ * Copying in big chunks lets the block layer and the filesystems transfer
+ * many blocks per request instead of going through RW_BUF_SIZE sized
+ * bounce buffers.
+ */
+#define COPY_BUF_SIZE_MAX	SZ_1M
+
+/*
+ * copy_buf_alloc - allocate a buffer for copying @size bytes
+ *
+ * The buffer is at most COPY_BUF_SIZE_MAX and not (much) bigger than @size
+ * if that is known. When memory is tight smaller buffers down to RW_BUF_SIZE
+ * are tried.
+ */
+static void *copy_buf_alloc(loff_t size, size_t *bufsize)
+{
+	size_t bs = COPY_BUF_SIZE_MAX;
+	void *buf;
+
+	if (size > 0 && size != FILESIZE_MAX)
+		while (bs > RW_BUF_SIZE && bs / 2 >= size)
+			bs /= 2;
+
+	while (1) {
+		buf = malloc(bs);
+		if (buf || bs <= RW_BUF_SIZE)
+			break;
+		bs /= 2;
+	}
+
+	*bufsize = bs;
+
+	return buf;
+}
+
 int copy_fd(int in, int out)
 {
-	int bs = 4096, ret;
-	void *buf = malloc(bs);
+	size_t bs;
+	int ret;
+	void *buf = copy_buf_alloc(FILESIZE_MAX, &bs);
 
 	if (!buf)
 		return -ENOMEM;
@@ -341,6 +380,25 @@ out_close:
 }
 EXPORT_SYMBOL(write_file_flash);
 
+static void copy_file_show_progress(loff_t total, loff_t size)
+{
+	if (size && size != FILESIZE_MAX)
+		show_progress(total);
+	else
+		show_progress(total / 16384);
+}
+
+static void copy_file_show_rate(loff_t total, uint64_t start)
+{
+	uint64_t ms = div_u64(get_time_ns() - start, MSECOND);
+
+	printf("%s in %llu ms", size_human_readable(total), ms);
+	if (ms)
+		printf(" (%s/s)",
+		       size_human_readable(div64_u64(total * 1000, ms)));
+	putchar('\n');
+}
+
 /**
  * copy_file - Copy a file
  * @src:	The source filename
@@ -357,9 +415,10 @@ int copy_file(const char *src, const char *dst, int verbose)
 	int ret = 1, err1 = 0;
 	int mode;
 	loff_t total = 0;
+	size_t bufsize;
+	uint64_t start = get_time_ns();
 	struct stat srcstat, dststat;
-
-	rw_buf = xmalloc(RW_BUF_SIZE);
+	const void *map;
 
 	srcfd = open(src, O_RDONLY);
 	if (srcfd < 0) {
@@ -404,8 +463,40 @@ int copy_file(const char *src, const char *dst, int verbose)
 	if (verbose)
 		init_progression_bar(srcstat.st_size);
 
+	/*
+	 * If the source is memory mapped (RAM, SRAM, memory mapped flash,
+	 * ramfs) write directly from it without copying to a buffer first.
+	 */
+	map = srcstat.st_size != FILESIZE_MAX ?
+		memmap(srcfd, PROT_READ) : MAP_FAILED;
+	if (map != MAP_FAILED) {
+		while (total < srcstat.st_size) {
+			size_t now = min_t(loff_t, srcstat.st_size - total,
+					   COPY_BUF_SIZE_MAX);
+
+			ret = write_full(dstfd, map + total, now);
+			if (ret < 0) {
+				perror("write");
+				goto out;
+			}
+
+			total += now;
+
+			if (verbose)
+				copy_file_show_progress(total, srcstat.st_size);
+		}
+
+		goto done;
+	}
+
+	rw_buf = copy_buf_alloc(srcstat.st_size, &bufsize);
+	if (!rw_buf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
 	while (1) {
-		r = read(srcfd, rw_buf, RW_BUF_SIZE);
+		r = read_full(srcfd, rw_buf, bufsize);
 		if (r < 0) {
 			perror("read");
 			ret = r;
@@ -422,18 +513,21 @@ int copy_file(const char *src, const char *dst, int verbose)
 
 		total += r;
 
-		if (verbose) {
-			if (srcstat.st_size && srcstat.st_size != FILESIZE_MAX)
-				show_progress(total);
-			else
-				show_progress(total / 16384);
-		}
+		if (verbose)
+			copy_file_show_progress(total, srcstat.st_size);
+
+		if (r < bufsize)
+			break;
 	}
 
+done:
 	ret = 0;
 out:
-	if (verbose)
+	if (verbose) {
 		putchar('\n');
+		if (!ret)
+			copy_file_show_rate(total, start);
+	}
 
 	free(rw_buf);
 	if (srcfd > 0)
@@ -498,6 +592,7 @@ int compare_file(const char *f1, const char *f2)
 	int fd1, fd2, ret;
 	struct stat s1, s2;
 	void *buf1, *buf2;
+	size_t bufsize;
 	loff_t left;
 
 	fd1 = open(f1, O_RDONLY);
@@ -521,12 +616,16 @@ int compare_file(const char *f1, const char *f2)
 	if (s1.st_size != s2.st_size)
 		return 1;
 
-	buf1 = xmalloc(RW_BUF_SIZE);
-	buf2 = xmalloc(RW_BUF_SIZE);
+	buf1 = copy_buf_alloc(s1.st_size, &bufsize);
+	buf2 = copy_buf_alloc(bufsize, &bufsize);
+	if (!buf1 || !buf2) {
+		ret = -ENOMEM;
+		goto err_out3;
+	}
 
 	left = s1.st_size;
 	while (left) {
-		loff_t now = min(left, (loff_t)RW_BUF_SIZE);
+		loff_t now = min(left, (loff_t)bufsize);
 
 		ret = read_full(fd1, buf1, now);
 		if (ret < 0)
@@ -19,45 +19,1110 @@
 #include <gunzip.h>
 #include <lzo.h>
 #include <linux/xz.h>
+#include <linux/zlib.h>
+#include <linux/zstd.h>
+#include <linux/lz4.h>
 #include <linux/decompress/unlz4.h>
+#include <linux/sizes.h>
+#include <asm/unaligned.h>
 #include <errno.h>
 #include <filetype.h>
 #include <malloc.h>
 #include <fs.h>
 #include <libfile.h>
 
-static void *uncompress_buf;
-static unsigned int uncompress_size;
+/* Size of the chunks read from a file descriptor */
+#define UNCOMPRESS_IN_SIZE	SZ_64K
+/* Default size of the buffer decompressed data is collected in */
+#define UNCOMPRESS_OUT_SIZE	SZ_64K
 
 void uncompress_err_stdout(char *x)
 {
 	printf("%s\n", x);
 }
 
-static int (*uncompress_fill_fn)(void*, unsigned int);
+/*
+ * Streaming decompression
+ *
+ * A struct uncompress_stream holds the complete state of one decompression,
+ * so that any number of them can be active at the same time. Compressed
+ * data is pushed in with uncompress_stream_feed() in chunks of arbitrary
+ * size, decompressed data is drained to the flush() callback as soon as
+ * it is available. The compression format is detected from the first bytes
+ * of the input.
+ */
+struct uncompress_stream;
+
+struct uncompress_backend {
+	enum filetype filetype;
+	unsigned int out_size;
+	int (*init)(struct uncompress_stream *s);
+	int (*feed)(struct uncompress_stream *s, const u8 *buf, unsigned int len);
+	int (*finish)(struct uncompress_stream *s);
+	void (*exit)(struct uncompress_stream *s);
+};
+
+struct uncompress_stream {
+	const struct uncompress_backend *backend;
+	int (*flush)(void *priv, const void *buf, unsigned int len);
+	void *priv;
+	void (*error_fn)(char *x);
+	int error;
+
+	/* first bytes of the input, used to detect the compression format */
+	u8 magic[32];
+	unsigned int magic_len;
 
-static int uncompress_fill(void *buf, unsigned int len)
+	/* set when the input so far forms a complete compressed stream */
+	bool done;
+
+	u8 *out;
+	unsigned int out_size;
+
+	/* staging buffer for headers and blocks split across feed calls */
+	u8 *buf;
+	unsigned int buf_len;
+	unsigned int buf_size;
+
+	void *state;
+};
+
+static void uncompress_error(struct uncompress_stream *s, char *msg)
 {
-	int total = 0;
+	if (s->error_fn)
+		s->error_fn(msg);
+}
 
-	if (uncompress_size) {
-		int now = min(len, uncompress_size);
+static int uncompress_output(struct uncompress_stream *s, const void *buf,
+			     unsigned int len)
+{
+	int ret;
 
-		memcpy(buf, uncompress_buf, now);
-		uncompress_size -= now;
-		len -= now;
-		total = now;
-		buf += now;
+	if (!len)
+		return 0;
+
+	ret = s->flush(s->priv, buf, len);
+	if (ret < 0)
+		return ret;
+	if (ret != len) {
+		uncompress_error(s, "write error");
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/*
+ * Append input to the staging buffer until it holds @want bytes. Returns 1
+ * when the staging buffer is complete, 0 when more input is needed.
+ */
+static int uncompress_fill_buf(struct uncompress_stream *s, const u8 **buf,
+			       unsigned int *len, unsigned int want)
+{
+	unsigned int now;
+
+	if (want > s->buf_size) {
+		u8 *tmp = realloc(s->buf, want);
+
+		if (!tmp)
+			return -ENOMEM;
+
+		s->buf = tmp;
+		s->buf_size = want;
 	}
 
-	if (len) {
-		int ret = uncompress_fill_fn(buf, len);
-		if (ret < 0)
+	now = min(*len, want - s->buf_len);
+	memcpy(s->buf + s->buf_len, *buf, now);
+	s->buf_len += now;
+	*buf += now;
+	*len -= now;
+
+	return s->buf_len == want;
+}
+
+/*
+ * Get the next @want bytes of input in one piece. They are taken directly
+ * from the input when possible and only copied when they are split across
+ * feed calls. Returns 1 and sets @data when the bytes are available, 0 when
+ * more input is needed.
+ */
+static int uncompress_get(struct uncompress_stream *s, const u8 **buf,
+			  unsigned int *len, unsigned int want, const u8 **data)
+{
+	int ret;
+
+	if (!s->buf_len && *len >= want) {
+		*data = *buf;
+		*buf += want;
+		*len -= want;
+		return 1;
+	}
+
+	ret = uncompress_fill_buf(s, buf, len, want);
+	if (ret <= 0)
+		return ret;
+
+	*data = s->buf;
+	s->buf_len = 0;
+
+	return 1;
+}
+
+#ifdef CONFIG_ZLIB
+#define GZIP_FHCRC	0x02
+#define GZIP_FEXTRA	0x04
+#define GZIP_FNAME	0x08
+#define GZIP_FCOMMENT	0x10
+
+struct gzip_stream {
+	struct z_stream_s strm;
+	bool header_done;
+};
+
+/*
+ * Return the length of the gzip header in @h, or a length larger than @len
+ * when more bytes are needed to determine it.
+ */
+static int gzip_header_len(const u8 *h, unsigned int len)
+{
+	unsigned int need = 10, i;
+
+	if (len < need)
+		return need;
+
+	if (h[0] != 0x1f || h[1] != 0x8b || h[2] != 0x08)
+		return -EINVAL;
+
+	if (h[3] & GZIP_FEXTRA) {
+		need += 2;
+		if (len < need)
+			return need;
+		need += get_unaligned_le16(h + 10);
+		if (len < need)
+			return need;
+	}
+
+	if (h[3] & GZIP_FNAME) {
+		for (i = need; i < len && h[i]; i++)
+			;
+		if (i == len)
+			return len + 1;
+		need = i + 1;
+	}
+
+	if (h[3] & GZIP_FCOMMENT) {
+		for (i = need; i < len && h[i]; i++)
+			;
+		if (i == len)
+			return len + 1;
+		need = i + 1;
+	}
+
+	if (h[3] & GZIP_FHCRC)
+		need += 2;
+
+	return need;
+}
+
+static int gzip_stream_init(struct uncompress_stream *s)
+{
+	struct gzip_stream *gz;
+
+	gz = xzalloc(sizeof(*gz));
+	gz->strm.workspace = malloc(zlib_inflate_workspacesize());
+	if (!gz->strm.workspace) {
+		free(gz);
+		return -ENOMEM;
+	}
+
+	if (zlib_inflateInit2(&gz->strm, -MAX_WBITS) != Z_OK) {
+		free(gz->strm.workspace);
+		free(gz);
+		return -EINVAL;
+	}
+
+	s->state = gz;
+
+	return 0;
+}
+
+static int gzip_stream_feed(struct uncompress_stream *s, const u8 *buf,
+			    unsigned int len)
+{
+	struct gzip_stream *gz = s->state;
+	struct z_stream_s *strm = &gz->strm;
+	int ret;
+
+	while (!gz->header_done) {
+		int need = gzip_header_len(s->buf, s->buf_len);
+
+		if (need < 0) {
+			uncompress_error(s, "Not a gzip file");
+			return need;
+		}
+
+		if (need > SZ_64K) {
+			uncompress_error(s, "header error");
+			return -EINVAL;
+		}
+
+		if (s->buf_len == need) {
+			gz->header_done = true;
+			s->buf_len = 0;
+			break;
+		}
+
+		ret = uncompress_fill_buf(s, &buf, &len, need);
+		if (ret <= 0)
 			return ret;
-		total += ret;
 	}
 
-	return total;
+	/* Anything after the end of the deflate stream is the gzip trailer */
+	if (s->done)
+		return 0;
+
+	strm->next_in = buf;
+	strm->avail_in = len;
+
+	do {
+		strm->next_out = s->out;
+		strm->avail_out = s->out_size;
+
+		ret = zlib_inflate(strm, Z_SYNC_FLUSH);
+		if (ret == Z_STREAM_END) {
+			s->done = true;
+		} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			uncompress_error(s, "uncompression error");
+			return -EIO;
+		}
+
+		ret = uncompress_output(s, s->out, s->out_size - strm->avail_out);
+		if (ret)
+			return ret;
+	} while (!s->done && (strm->avail_in || !strm->avail_out));
+
+	return 0;
+}
+
+static int gzip_stream_finish(struct uncompress_stream *s)
+{
+	struct gzip_stream *gz = s->state;
+	struct z_stream_s *strm = &gz->strm;
+	u8 zerostuff = 0;
+	int ret;
+
+	if (s->done || !gz->header_done)
+		return 0;
+
+	/*
+	 * zlib sometimes wants to taste an extra byte when being used in
+	 * raw deflate mode, see deflate_decompress().
+	 */
+	strm->next_in = &zerostuff;
+	strm->avail_in = 1;
+	strm->next_out = s->out;
+	strm->avail_out = s->out_size;
+
+	if (zlib_inflate(strm, Z_FINISH) != Z_STREAM_END)
+		return 0;
+
+	s->done = true;
+
+	ret = uncompress_output(s, s->out, s->out_size - strm->avail_out);
+
+	return ret;
+}
+
+static void gzip_stream_exit(struct uncompress_stream *s)
+{
+	struct gzip_stream *gz = s->state;
+
+	zlib_inflateEnd(&gz->strm);
+	free(gz->strm.workspace);
+	free(gz);
+}
+#endif
+
+#ifdef CONFIG_XZ_DECOMPRESS
+static int xz_stream_init(struct uncompress_stream *s)
+{
+#if XZ_INTERNAL_CRC32
+	xz_crc32_init();
+#endif
+	s->state = xz_dec_init(XZ_DYNALLOC, (uint32_t)-1);
+	if (!s->state)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int xz_stream_feed(struct uncompress_stream *s, const u8 *buf,
+			  unsigned int len)
+{
+	struct xz_buf b = {
+		.in = buf,
+		.in_size = len,
+	};
+	enum xz_ret xret;
+	int ret;
+
+	if (s->done)
+		return 0;
+
+	do {
+		b.out = s->out;
+		b.out_pos = 0;
+		b.out_size = s->out_size;
+
+		xret = xz_dec_run(s->state, &b);
+		if (xret == XZ_STREAM_END) {
+			s->done = true;
+		} else if (xret != XZ_OK) {
+			uncompress_error(s, "uncompression error");
+			return -EIO;
+		}
+
+		ret = uncompress_output(s, b.out, b.out_pos);
+		if (ret)
+			return ret;
+	} while (!s->done && (b.in_pos < b.in_size || b.out_pos == b.out_size));
+
+	return 0;
+}
+
+static void xz_stream_exit(struct uncompress_stream *s)
+{
+	xz_dec_end(s->state);
+}
+#endif
+
+#ifdef CONFIG_ZSTD_DECOMPRESS
+struct zstd_stream {
+	ZSTD_DStream *dstream;
+	void *workspace;
+};
+
+static int zstd_stream_init(struct uncompress_stream *s)
+{
+	struct zstd_stream *zs;
+	ZSTD_frameParams params;
+	size_t wksp_size;
+
+	if (ZSTD_getFrameParams(&params, s->magic, s->magic_len)) {
+		uncompress_error(s, "invalid zstd frame header");
+		return -EINVAL;
+	}
+
+	zs = xzalloc(sizeof(*zs));
+
+	wksp_size = ZSTD_DStreamWorkspaceBound(params.windowSize);
+	zs->workspace = malloc(wksp_size);
+	if (!zs->workspace) {
+		free(zs);
+		return -ENOMEM;
+	}
+
+	zs->dstream = ZSTD_initDStream(params.windowSize, zs->workspace,
+				       wksp_size);
+	if (!zs->dstream) {
+		free(zs->workspace);
+		free(zs);
+		return -EINVAL;
+	}
+
+	s->state = zs;
+
+	return 0;
+}
+
+static int zstd_stream_feed(struct uncompress_stream *s, const u8 *buf,
+			    unsigned int len)
+{
+	struct zstd_stream *zs = s->state;
+	ZSTD_inBuffer in = {
+		.src = buf,
+		.size = len,
+	};
+	ZSTD_outBuffer out;
+	size_t zret;
+	int ret;
+
+	if (s->done)
+		return 0;
+
+	do {
+		out.dst = s->out;
+		out.pos = 0;
+		out.size = s->out_size;
+
+		zret = ZSTD_decompressStream(zs->dstream, &out, &in);
+		if (ZSTD_isError(zret)) {
+			uncompress_error(s, "uncompression error");
+			return -EIO;
+		}
+
+		/*
+		 * A return value of 0 means the frame is complete and fully
+		 * flushed. Whatever follows it, like the size appended to
+		 * compressed kernel images or padding, is ignored.
+		 */
+		s->done = !zret;
+
+		ret = uncompress_output(s, out.dst, out.pos);
+		if (ret)
+			return ret;
+	} while (!s->done && (in.pos < in.size || out.pos == out.size));
+
+	return 0;
+}
+
+static void zstd_stream_exit(struct uncompress_stream *s)
+{
+	struct zstd_stream *zs = s->state;
+
+	free(zs->workspace);
+	free(zs);
+}
+#endif
+
+#ifdef CONFIG_LZ4_DECOMPRESS
+/* See lib/decompress_unlz4.c for the legacy lz4 format */
+#define LZ4_LEGACY_MAGIC	0x184C2102
+#define LZ4_LEGACY_CHUNK_SIZE	(8 << 20)
+
+struct lz4_stream {
+	bool magic_seen;
+	bool end;
+	u32 chunksize;
+};
+
+static int lz4_stream_init(struct uncompress_stream *s)
+{
+	s->state = xzalloc(sizeof(struct lz4_stream));
+
+	return 0;
+}
+
+static int lz4_stream_feed(struct uncompress_stream *s, const u8 *buf,
+			   unsigned int len)
+{
+	struct lz4_stream *lz = s->state;
+	const u8 *data;
+	size_t dest_len;
+	int ret;
+
+	if (lz->end)
+		return 0;
+
+	while (len) {
+		if (!lz->chunksize) {
+			ret = uncompress_get(s, &buf, &len, 4, &data);
+			if (ret <= 0)
+				return ret;
+
+			lz->chunksize = get_unaligned_le32(data);
+			if (lz->chunksize == LZ4_LEGACY_MAGIC) {
+				lz->magic_seen = true;
+				lz->chunksize = 0;
+				s->done = true;
+				continue;
+			}
+
+			if (!lz->magic_seen) {
+				uncompress_error(s, "invalid header");
+				return -EINVAL;
+			}
+
+			if (!lz->chunksize ||
+			    lz->chunksize > lz4_compressbound(LZ4_LEGACY_CHUNK_SIZE)) {
+				/*
+				 * The legacy format has no end marker. Like
+				 * the size appended to compressed kernel
+				 * images or padding, anything after the last
+				 * chunk that is not a chunk is ignored.
+				 */
+				if (s->done) {
+					lz->chunksize = 0;
+					lz->end = true;
+					return 0;
+				}
+
+				uncompress_error(s, "chunk length is longer than allocated");
+				return -EINVAL;
+			}
+
+			continue;
+		}
+
+		ret = uncompress_get(s, &buf, &len, lz->chunksize, &data);
+		if (ret <= 0)
+			return ret;
+
+		dest_len = s->out_size;
+		ret = lz4_decompress_unknownoutputsize(data, lz->chunksize,
+						       s->out, &dest_len);
+		if (ret < 0) {
+			uncompress_error(s, "Decoding failed");
+			return -EIO;
+		}
+
+		lz->chunksize = 0;
+		s->done = true;
+
+		ret = uncompress_output(s, s->out, dest_len);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int lz4_stream_finish(struct uncompress_stream *s)
+{
+	struct lz4_stream *lz = s->state;
+
+	/*
+	 * A chunk length without any chunk data at the very end is taken as
+	 * trailer, like the size appended to compressed kernel images. A
+	 * partially received chunk means the input was truncated.
+	 */
+	if (lz->chunksize && s->buf_len)
+		s->done = false;
+
+	return 0;
+}
+
+static void lz4_stream_exit(struct uncompress_stream *s)
+{
+	free(s->state);
+}
+#endif
+
+#ifdef CONFIG_LZO_DECOMPRESS
+/* See lib/decompress_unlzo.c for the lzop format */
+#define LZOP_BLOCK_SIZE		(256 * 1024)
+#define LZOP_HAS_FILTER		0x00000800L
+
+static const u8 lzop_magic[] = {
+	0x89, 0x4c, 0x5a, 0x4f, 0x00, 0x0d, 0x0a, 0x1a, 0x0a };
+
+enum lzop_state {
+	LZOP_HEADER,
+	LZOP_BLOCK_HEADER,
+	LZOP_BLOCK_DATA,
+	LZOP_END,
+};
+
+struct lzop_stream {
+	enum lzop_state state;
+	u32 dst_len;
+	u32 src_len;
+};
+
+/*
+ * Return the length of the lzop header in @h, or a length larger than
+ * @len when more bytes are needed to determine it.
+ */
+static int lzop_header_len(const u8 *h, unsigned int len)
+{
+	unsigned int need = 9 + 2;
+	u16 version;
+
+	if (len < need)
+		return need;
+
+	if (memcmp(h, lzop_magic, sizeof(lzop_magic)))
+		return -EINVAL;
+
+	/*
+	 * version, library version, 'need to be extracted' version and
+	 * method, the level for newer versions, then the flags
+	 */
+	version = get_unaligned_be16(h + 9);
+	need = 9 + 7 + 4;
+	if (version >= 0x0940)
+		need++;
+	if (len < need)
+		return need;
+
+	if (get_unaligned_be32(h + need - 4) & LZOP_HAS_FILTER)
+		need += 4;
+
+	/* mode, mtime_low, mtime_high for newer versions, filename length */
+	need += 8 + 1;
+	if (version >= 0x0940)
+		need += 4;
+	if (len < need)
+		return need;
+
+	/* filename and header checksum */
+	return need + h[need - 1] + 4;
+}
+
+static int lzop_stream_init(struct uncompress_stream *s)
+{
+	s->state = xzalloc(sizeof(struct lzop_stream));
+
+	return 0;
+}
+
+static int lzop_stream_feed(struct uncompress_stream *s, const u8 *buf,
+			    unsigned int len)
+{
+	struct lzop_stream *lzop = s->state;
+	const u8 *data;
+	size_t dst_len;
+	int ret, need;
+
+	while (len) {
+		switch (lzop->state) {
+		case LZOP_HEADER:
+			need = lzop_header_len(s->buf, s->buf_len);
+			if (need < 0) {
+				uncompress_error(s, "invalid header");
+				return need;
+			}
+
+			if (s->buf_len == need) {
+				s->buf_len = 0;
+				lzop->state = LZOP_BLOCK_HEADER;
+				break;
+			}
+
+			ret = uncompress_fill_buf(s, &buf, &len, need);
+			if (ret < 0)
+				return ret;
+			break;
+		case LZOP_BLOCK_HEADER:
+			/* uncompressed size, compressed size, block checksum */
+			ret = uncompress_get(s, &buf, &len, 4, &data);
+			if (ret <= 0)
+				return ret;
+
+			lzop->dst_len = get_unaligned_be32(data);
+			if (!lzop->dst_len) {
+				lzop->state = LZOP_END;
+				s->done = true;
+				break;
+			}
+
+			if (lzop->dst_len > LZOP_BLOCK_SIZE) {
+				uncompress_error(s, "dest len longer than block size");
+				return -EINVAL;
+			}
+
+			lzop->src_len = 0;
+			lzop->state = LZOP_BLOCK_DATA;
+			break;
+		case LZOP_BLOCK_DATA:
+			if (!lzop->src_len) {
+				ret = uncompress_get(s, &buf, &len, 8, &data);
+				if (ret <= 0)
+					return ret;
+
+				lzop->src_len = get_unaligned_be32(data);
+				if (!lzop->src_len ||
+				    lzop->src_len > lzop->dst_len) {
+					uncompress_error(s, "file corrupted");
+					return -EINVAL;
+				}
+				break;
+			}
+
+			ret = uncompress_get(s, &buf, &len, lzop->src_len, &data);
+			if (ret <= 0)
+				return ret;
+
+			lzop->state = LZOP_BLOCK_HEADER;
+
+			/* Uncompressed blocks are stored as they are */
+			if (lzop->src_len == lzop->dst_len) {
+				ret = uncompress_output(s, data, lzop->dst_len);
+				if (ret)
+					return ret;
+				break;
+			}
+
+			dst_len = lzop->dst_len;
+			ret = lzo1x_decompress_safe(data, lzop->src_len, s->out,
+						    &dst_len);
+			if (ret != LZO_E_OK || dst_len != lzop->dst_len) {
+				uncompress_error(s, "decompressor error");
+				return -EIO;
+			}
+
+			ret = uncompress_output(s, s->out, dst_len);
+			if (ret)
+				return ret;
+			break;
+		case LZOP_END:
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+static void lzop_stream_exit(struct uncompress_stream *s)
+{
+	free(s->state);
+}
+#endif
+
+#ifdef CONFIG_BZLIB
+/*
+ * The bzip2 decoder pulls its input through a fill callback and cannot be
+ * suspended in between, so bzip2 input is collected and decompressed at
+ * once in uncompress_stream_finish(). As its flush callback has no context
+ * pointer, only one bzip2 stream can be decompressed at a time.
+ */
+static struct uncompress_stream *bzip2_active;
+
+static int bzip2_stream_feed(struct uncompress_stream *s, const u8 *buf,
+			     unsigned int len)
+{
+	unsigned int size = s->buf_size;
+	u8 *tmp;
+
+	if (s->buf_len + len > size) {
+		size = max(2 * size, (unsigned int)UNCOMPRESS_IN_SIZE);
+		while (size < s->buf_len + len)
+			size *= 2;
+
+		tmp = realloc(s->buf, size);
+		if (!tmp)
+			return -ENOMEM;
+
+		s->buf = tmp;
+		s->buf_size = size;
+	}
+
+	memcpy(s->buf + s->buf_len, buf, len);
+	s->buf_len += len;
+
+	return 0;
+}
+
+static int bzip2_stream_flush(void *buf, unsigned int len)
+{
+	struct uncompress_stream *s = bzip2_active;
+
+	return s->flush(s->priv, buf, len);
+}
+
+static int bzip2_stream_finish(struct uncompress_stream *s)
+{
+	int ret;
+
+	if (bzip2_active)
+		return -EBUSY;
+
+	bzip2_active = s;
+	ret = bunzip2(s->buf, s->buf_len, NULL, bzip2_stream_flush, NULL, NULL,
+		      s->error_fn);
+	bzip2_active = NULL;
+
+	if (ret)
+		return -EIO;
+
+	s->done = true;
+
+	return 0;
+}
+#endif
+
+static const struct uncompress_backend uncompress_backends[] = {
+#ifdef CONFIG_ZLIB
+	{
+		.filetype = filetype_gzip,
+		.out_size = UNCOMPRESS_OUT_SIZE,
+		.init = gzip_stream_init,
+		.feed = gzip_stream_feed,
+		.finish = gzip_stream_finish,
+		.exit = gzip_stream_exit,
+	},
+#endif
+#ifdef CONFIG_XZ_DECOMPRESS
+	{
+		.filetype = filetype_xz_compressed,
+		.out_size = UNCOMPRESS_OUT_SIZE,
+		.init = xz_stream_init,
+		.feed = xz_stream_feed,
+		.exit = xz_stream_exit,
+	},
+#endif
+#ifdef CONFIG_ZSTD_DECOMPRESS
+	{
+		.filetype = filetype_zstd_compressed,
+		.out_size = UNCOMPRESS_OUT_SIZE,
+		.init = zstd_stream_init,
+		.feed = zstd_stream_feed,
+		.exit = zstd_stream_exit,
+	},
+#endif
+#ifdef CONFIG_LZ4_DECOMPRESS
+	{
+		.filetype = filetype_lz4_compressed,
+		.out_size = LZ4_LEGACY_CHUNK_SIZE,
+		.init = lz4_stream_init,
+		.feed = lz4_stream_feed,
+		.finish = lz4_stream_finish,
+		.exit = lz4_stream_exit,
+	},
+#endif
+#ifdef CONFIG_LZO_DECOMPRESS
+	{
+		.filetype = filetype_lzo_compressed,
+		.out_size = LZOP_BLOCK_SIZE,
+		.init = lzop_stream_init,
+		.feed = lzop_stream_feed,
+		.exit = lzop_stream_exit,
+	},
+#endif
+#ifdef CONFIG_BZLIB
+	{
+		.filetype = filetype_bzip2,
+		.feed = bzip2_stream_feed,
+		.finish = bzip2_stream_finish,
+	},
+#endif
+};
+
+static int uncompress_stream_start(struct uncompress_stream *s)
+{
+	const struct uncompress_backend *backend = NULL;
+	u8 magic[sizeof(s->magic)] = {};
+	enum filetype ft;
+	char *err;
+	int i, ret;
+
+	/* file_detect_type() wants a complete buffer, even for tiny streams */
+	memcpy(magic, s->magic, s->magic_len);
+	ft = file_detect_type(magic, sizeof(magic));
+
+	for (i = 0; i < ARRAY_SIZE(uncompress_backends); i++) {
+		if (uncompress_backends[i].filetype == ft) {
+			backend = &uncompress_backends[i];
+			break;
+		}
+	}
+
+	if (!backend) {
+		err = basprintf("cannot handle filetype %s",
+				file_type_to_string(ft));
+		uncompress_error(s, err);
+		free(err);
+		return -ENOSYS;
+	}
+
+	if (backend->out_size) {
+		s->out = malloc(backend->out_size);
+		if (!s->out) {
+			uncompress_error(s, "Out of memory while allocating output buffer");
+			return -ENOMEM;
+		}
+		s->out_size = backend->out_size;
+	}
+
+	if (backend->init) {
+		ret = backend->init(s);
+		if (ret)
+			return ret;
+	}
+
+	s->backend = backend;
+
+	return backend->feed(s, s->magic, s->magic_len);
+}
+
+/**
+ * uncompress_stream_init - start a streaming decompression
+ * @flush:	called with the decompressed data, must return @len on success
+ * @priv:	passed to @flush
+ * @error_fn:	called with error messages, may be NULL
+ *
+ * Return: a new stream to pass compressed data to with uncompress_stream_feed()
+ */
+struct uncompress_stream *uncompress_stream_init(
+		int (*flush)(void *priv, const void *buf, unsigned int len),
+		void *priv, void (*error_fn)(char *x))
+{
+	struct uncompress_stream *s;
+
+	s = xzalloc(sizeof(*s));
+	s->flush = flush;
+	s->priv = priv;
+	s->error_fn = error_fn ?: uncompress_err_stdout;
+
+	return s;
+}
+EXPORT_SYMBOL(uncompress_stream_init);
+
+/**
+ * uncompress_stream_feed - pass compressed data to a stream
+ * @s:		the stream
+ * @buf:	compressed data
+ * @len:	length of @buf
+ *
+ * The data is decompressed and passed to the flush callback as far as
+ * possible, incomplete headers or blocks are kept until the next call.
+ *
+ * Return: 0 for success or a negative error code. Errors are sticky, all
+ * further calls return the same error.
+ */
+int uncompress_stream_feed(struct uncompress_stream *s, const void *buf,
+			   unsigned int len)
+{
+	unsigned int now;
+	int ret = 0;
+
+	if (s->error)
+		return s->error;
+
+	if (!s->backend) {
+		now = min(len, (unsigned int)sizeof(s->magic) - s->magic_len);
+		memcpy(s->magic + s->magic_len, buf, now);
+		s->magic_len += now;
+		buf += now;
+		len -= now;
+
+		if (s->magic_len < sizeof(s->magic))
+			return 0;
+
+		ret = uncompress_stream_start(s);
+		if (ret)
+			goto out;
+	}
+
+	if (len)
+		ret = s->backend->feed(s, buf, len);
+out:
+	s->error = ret;
+
+	return ret;
+}
+EXPORT_SYMBOL(uncompress_stream_feed);
+
+/**
+ * uncompress_stream_finish - signal the end of the compressed data
+ * @s:		the stream
+ *
+ * Return: 0 when the compressed data was complete and decompressed
+ * successfully, a negative error code otherwise.
+ */
+int uncompress_stream_finish(struct uncompress_stream *s)
+{
+	int ret;
+
+	if (s->error)
+		return s->error;
+
+	if (!s->backend) {
+		if (!s->magic_len) {
+			uncompress_error(s, "no input data");
+			ret = -ENODATA;
+			goto out;
+		}
+
+		ret = uncompress_stream_start(s);
+		if (ret)
+			goto out;
+	}
+
+	if (s->backend->finish) {
+		ret = s->backend->finish(s);
+		if (ret)
+			goto out;
+	}
+
+	if (!s->done) {
+		uncompress_error(s, "unexpected end of compressed data");
+		ret = -EIO;
+	}
+out:
+	s->error = ret;
+
+	return ret;
+}
+EXPORT_SYMBOL(uncompress_stream_finish);
+
+/**
+ * uncompress_stream_free - free a stream
+ * @s:		the stream
+ */
+void uncompress_stream_free(struct uncompress_stream *s)
+{
+	if (!s)
+		return;
+
+	if (s->backend && s->backend->exit)
+		s->backend->exit(s);
+
+	free(s->out);
+	free(s->buf);
+	free(s);
+}
+EXPORT_SYMBOL(uncompress_stream_free);
+
+/*
+ * Adapter for the traditional interface: Decompressed data is either passed
+ * to a flush function without context pointer or written to a buffer.
+ */
+struct uncompress_output {
+	int (*flush)(void *, unsigned int);
+	unsigned char *output;
+};
+
+static int uncompress_output_flush(void *priv, const void *buf,
+				   unsigned int len)
+{
+	struct uncompress_output *out = priv;
+
+	if (out->flush)
+		return out->flush((void *)buf, len);
+
+	memcpy(out->output, buf, len);
+	out->output += len;
+
+	return len;
+}
+
+static int uncompress_fill_stream(int (*fill)(void *priv, void *buf, unsigned int len),
+				  void *fill_priv,
+				  int (*flush)(void *priv, const void *buf, unsigned int len),
+				  void *flush_priv,
+				  void (*error_fn)(char *x))
+{
+	struct uncompress_stream *s;
+	void *buf;
+	int ret;
+
+	buf = malloc(UNCOMPRESS_IN_SIZE);
+	if (!buf)
+		return -ENOMEM;
+
+	s = uncompress_stream_init(flush, flush_priv, error_fn);
+
+	while ((ret = fill(fill_priv, buf, UNCOMPRESS_IN_SIZE)) > 0) {
+		ret = uncompress_stream_feed(s, buf, ret);
+		if (ret)
+			goto out;
+	}
+
+	if (!ret)
+		ret = uncompress_stream_finish(s);
+out:
+	uncompress_stream_free(s);
+	free(buf);
+
+	return ret;
+}
+
+static int uncompress_fill_legacy(void *priv, void *buf, unsigned int len)
+{
+	int (*fill)(void *, unsigned int) = *(int (**)(void *, unsigned int))priv;
+
+	return fill(buf, len);
 }
 
 int uncompress(unsigned char *inbuf, int len,
@@ -67,6 +1132,10 @@ int uncompress(unsigned char *inbuf, int len,
 	   int *pos,
 	   void(*error_fn)(char *x))
 {
+	struct uncompress_output out = {
+		.flush = flush,
+		.output = output,
+	};
 	enum filetype ft;
 	int (*compfn)(unsigned char *inbuf, int len,
             int(*fill)(void*, unsigned int),
@@ -74,28 +1143,20 @@ int uncompress(unsigned char *inbuf, int len,
             unsigned char *output,
             int *pos,
             void(*error)(char *x));
+	struct uncompress_stream *s;
 	int ret;
-	char *err;
 
-	if (inbuf) {
-		ft = file_detect_type(inbuf, len);
-		uncompress_buf = NULL;
-		uncompress_size = 0;
-	} else {
+	if (!inbuf) {
 		if (!fill)
 			return -EINVAL;
 
-		uncompress_fill_fn = fill;
-		uncompress_buf = xzalloc(32);
-		uncompress_size = 32;
-
-		ret = fill(uncompress_buf, 32);
-		if (ret < 0)
-			goto err;
-
-		ft = file_detect_type(uncompress_buf, 32);
+		return uncompress_fill_stream(uncompress_fill_legacy, &fill,
+					      uncompress_output_flush, &out,
+					      error_fn);
 	}
 
+	ft = file_detect_type(inbuf, len);
+
 	switch (ft) {
 #ifdef CONFIG_BZLIB
 	case filetype_bzip2:
@@ -123,52 +1184,49 @@ int uncompress(unsigned char *inbuf, int len,
 		break;
 #endif
 	default:
-		err = basprintf("cannot handle filetype %s",
-				  file_type_to_string(ft));
-		error_fn(err);
-		free(err);
-		ret = -ENOSYS;
-		goto err;
+		/* Formats only implemented as stream, like zstd */
+		s = uncompress_stream_init(uncompress_output_flush, &out,
+					   error_fn);
+		ret = uncompress_stream_feed(s, inbuf, len);
+		if (!ret)
+			ret = uncompress_stream_finish(s);
+		uncompress_stream_free(s);
+		if (!ret && pos)
+			*pos = len;
+		return ret;
 	}
 
-	ret = compfn(inbuf, len, fill ? uncompress_fill : NULL,
-			flush, output, pos, error_fn);
-err:
-	free(uncompress_buf);
-
-	return ret;
+	return compfn(inbuf, len, NULL, flush, output, pos, error_fn);
 }
 
-static int uncompress_infd, uncompress_outfd;
-
-static int fill_fd(void *buf, unsigned int len)
+static int uncompress_fill_fd(void *priv, void *buf, unsigned int len)
 {
-	return read_full(uncompress_infd, buf, len);
+	int *fd = priv;
+
+	return read(*fd, buf, len);
 }
 
-static int flush_fd(void *buf, unsigned int len)
+static int uncompress_flush_fd(void *priv, const void *buf, unsigned int len)
 {
-	return write(uncompress_outfd, buf, len);
+	int *fd = priv;
+
+	return write_full(*fd, buf, len);
 }
 
 int uncompress_fd_to_fd(int infd, int outfd,
 	   void(*error_fn)(char *x))
 {
-	uncompress_infd = infd;
-	uncompress_outfd = outfd;
-
-	return uncompress(NULL, 0,
-	   fill_fd,
-	   flush_fd,
-	   NULL,
-	   NULL,
-	   error_fn);
+	return uncompress_fill_stream(uncompress_fill_fd, &infd,
+				      uncompress_flush_fd, &outfd, error_fn);
 }
 
 int uncompress_fd_to_buf(int infd, void *output,
 		void(*error_fn)(char *x))
 {
-	uncompress_infd = infd;
+	struct uncompress_output out = {
+		.output = output,
+	};
 
-	return uncompress(NULL, 0, fill_fd, NULL, output, NULL, error_fn);
+	return uncompress_fill_stream(uncompress_fill_fd, &infd,
+				      uncompress_output_flush, &out, error_fn);
 }
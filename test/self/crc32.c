@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Test cases and benchmark for crc32()
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <common.h>
+#include <bselftest.h>
+#include <clock.h>
+#include <crc.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <linux/math64.h>
+#include <linux/sizes.h>
+
+BSELFTEST_GLOBALS();
+
+#define TEST_BUF_SIZE	4096
+#define BENCH_BUF_SIZE	SZ_1M
+#define BENCH_LOOPS	16
+
+static void __init __ok(bool cond, const char *func, int line)
+{
+	total_tests++;
+	if (!cond) {
+		failed_tests++;
+		printf("%s:%d: assertion failure\n", func, line);
+	}
+}
+
+#define ok(cond) \
+	__ok(cond, __func__, __LINE__)
+
+/* bit at a time reference implementation */
+static u32 __init crc32_ref(u32 crc, const u8 *buf, unsigned int len)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *buf++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+	}
+
+	return crc;
+}
+
+static void __init test_crc32_vectors(void)
+{
+	ok(crc32(0, "", 0) == 0);
+	ok(crc32(0, "123456789", 9) == 0xcbf43926);
+	ok(crc32(0, "The quick brown fox jumps over the lazy dog", 43) ==
+	   0x414fa339);
+	ok(crc32_no_comp(0, "123456789", 9) ==
+	   crc32_ref(0, (const u8 *)"123456789", 9));
+}
+
+static void __init test_crc32_random(u8 *buf)
+{
+	unsigned int ofs, len, split;
+	u32 ref;
+
+	get_random_bytes(buf, TEST_BUF_SIZE);
+
+	/* all alignments and short lengths to cover head and tail handling */
+	for (ofs = 0; ofs < 8; ofs++) {
+		for (len = 0; len <= 64; len++) {
+			ref = crc32_ref(~0, buf + ofs, len) ^ ~0;
+			ok(crc32(0, buf + ofs, len) == ref);
+			ok(crc32_no_comp(0x12345678, buf + ofs, len) ==
+			   crc32_ref(0x12345678, buf + ofs, len));
+		}
+	}
+
+	ref = crc32_ref(~0, buf, TEST_BUF_SIZE) ^ ~0;
+	ok(crc32(0, buf, TEST_BUF_SIZE) == ref);
+
+	/* calculating in pieces must give the same result */
+	for (split = 1; split < TEST_BUF_SIZE; split = split * 3 + 1)
+		ok(crc32(crc32(0, buf, split), buf + split,
+			 TEST_BUF_SIZE - split) == ref);
+}
+
+static void __init bench_crc32(u8 *buf)
+{
+	uint64_t start, ns;
+	int i;
+
+	memset(buf, 0x5a, BENCH_BUF_SIZE);
+
+	start = get_time_ns();
+	for (i = 0; i < BENCH_LOOPS; i++)
+		crc32(0, buf, BENCH_BUF_SIZE);
+	ns = get_time_ns() - start;
+
+	if (ns)
+		pr_info("%u MiB in %llu us: %llu KiB/s\n", BENCH_LOOPS,
+			div_u64(ns, 1000),
+			div64_u64((u64)BENCH_LOOPS * SZ_1K * NSEC_PER_SEC, ns));
+}
+
+static void __init test_crc32(void)
+{
+	u8 *buf;
+
+	buf = malloc(BENCH_BUF_SIZE);
+	if (!buf) {
+		total_tests++;
+		skipped_tests++;
+		return;
+	}
+
+	test_crc32_vectors();
+	test_crc32_random(buf);
+	bench_crc32(buf);
+
+	free(buf);
+}
+bselftest(core, test_crc32);